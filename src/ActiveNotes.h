@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Tracks which notes are sounding on each of the 16 midi channels
+ * as a 16x128 bitset. Each note also has a generation counter that goes
+ * up every time the note starts, so a note off queued by an earlier
+ * trigger of the same note can be told apart from the current one.
+ * All operations are O(1) apart from forEachActive, which
+ * only visits the words of the bitset, and none allocate.
+ * Not thread safe.
+ */
+class ActiveNoteTable
+{
+  public:
+    ActiveNoteTable()
+    {
+      clear();
+    }
+    /** mark the note as sounding, returns the generation to pass to noteOff*/
+    uint16_t noteOn(int channel, int note)
+    {
+      channel &= 15;
+      note &= 127;
+      if (!isActive(channel, note))
+      {
+        bits[channel][note >> 6] |= bit(note);
+        ++activeCount;
+      }
+      return ++generations[channel][note];
+    }
+    /** end the note if the generation is the one from its latest noteOn.
+     * Returns false, changing nothing, if the note was retriggered since
+     * or is not sounding, i.e. the note off is stale
+     */
+    bool noteOff(int channel, int note, uint16_t generation)
+    {
+      channel &= 15;
+      note &= 127;
+      if (!isActive(channel, note) || generations[channel][note] != generation) return false;
+      bits[channel][note >> 6] &= ~bit(note);
+      --activeCount;
+      return true;
+    }
+    bool isActive(int channel, int note) const
+    {
+      return (bits[channel & 15][(note & 127) >> 6] & bit(note & 127)) != 0;
+    }
+    /** how many notes are sounding across all channels*/
+    int getActiveCount() const
+    {
+      return activeCount;
+    }
+    /** call f(channel, note) for every sounding note*/
+    template<typename Func>
+    void forEachActive(Func&& f) const
+    {
+      for (int channel = 0; channel < 16; ++channel)
+      {
+        for (int word = 0; word < 2; ++word)
+        {
+          uint64_t w = bits[channel][word];
+          while (w != 0)
+          {
+            int low = __builtin_ctzll(w);
+            f(channel, word * 64 + low);
+            w &= w - 1;
+          }
+        }
+      }
+    }
+    /** mark every note as silent. Generations keep counting
+     * so note offs still queued from before stay stale
+    */
+    void clear()
+    {
+      for (int channel = 0; channel < 16; ++channel)
+      {
+        bits[channel][0] = 0;
+        bits[channel][1] = 0;
+      }
+      activeCount = 0;
+    }
+  private:
+    static uint64_t bit(int note)
+    {
+      return (uint64_t) 1 << (note & 63);
+    }
+    uint64_t bits[16][2];
+    uint16_t generations[16][128] = {};
+    int activeCount;
+};
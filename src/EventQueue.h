@@ -1,125 +1,138 @@
 #include <functional>
 #include <vector>
-#include <list>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
 
 #pragma once
 
 typedef std::function<void()> SequencerCallback;
 typedef std::vector<SequencerCallback> CallbackVector;
 
-/** models a vedtor of functions mapped to a timestamp*/
-struct TimestampedCallbacks{
-    long timestamp;
-    CallbackVector callbacks;
-};
-
 
 /**
- * Class used to maintain a sorted list of timestamped events
+ * Class used to maintain a time ordered queue of timestamped events
  * The idea is that c clock function triggers the calling of these evens
- * by sending in the current time
+ * by sending in the current time, or by calling triggerAndClearEventsAtNow.
+ * Events are kept in a binary min-heap on timestamp, so adding is O(log n)
+ * and firing the due events only looks at the ones that are due.
+ * addEvent is lock free and can be called from any thread. Events
+ * go onto a lock free stack and are moved into the heap by the thread
+ * that triggers them, so only one thread should call the trigger and get functions.
+ * Timestamps are in whatever unit the time source returns,
+ * monotonic nanoseconds by default.
  */
-
 class EventQueue
 {
     public:
-        EventQueue();
-        /** add an event to the queue with the specified timestamp */
-        void addEvent(long timestamp, SequencerCallback callback);
-        /** trigger events at the sent timestamp */
-        void triggerAndClearEventsAtTimestamp(long timestamp);
-        /** trigger events now - it will internally work out what the current time is */
-        void triggerAndClearEventsAtNow();
+        EventQueue() : incoming{nullptr}, nextOrder{0}, timeSource{EventQueue::getMonotonicNs}
+        {
+            heap.reserve(64);
+        }
+        ~EventQueue()
+        {
+            takeIncoming();
+            for (Event* event : heap) delete event;
+        }
+        EventQueue(const EventQueue&) = delete;
+        EventQueue& operator=(const EventQueue&) = delete;
+
+        /** add an event to the queue with the specified timestamp. Safe to call from any thread */
+        void addEvent(int64_t timestamp, SequencerCallback callback)
+        {
+            // order breaks ties so events with the same timestamp fire in the order they were added
+            Event* event = new Event{timestamp, nextOrder.fetch_add(1), std::move(callback), nullptr};
+            event->next = incoming.load(std::memory_order_relaxed);
+            while (!incoming.compare_exchange_weak(event->next, event,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed)){}
+        }
+        /** trigger all events due at or before the sent timestamp, removing them from the queue.
+         * Events added by the callbacks are not triggered until the next call
+         */
+        void triggerAndClearEventsAtTimestamp(int64_t timestamp)
+        {
+            takeIncoming();
+            while (!heap.empty() && heap.front()->timestamp <= timestamp)
+            {
+                std::pop_heap(heap.begin(), heap.end(), EventQueue::laterThan);
+                Event* event = heap.back();
+                heap.pop_back();
+                event->callback();
+                delete event;
+            }
+        }
+        /** trigger events now - everything due up to the time source's current time */
+        void triggerAndClearEventsAtNow()
+        {
+            triggerAndClearEventsAtTimestamp(timeSource());
+        }
         /** returns the vector of callbacks attached to the sent timestamp */
-        CallbackVector getEventsAtTimestamp(long timestamp);        
+        CallbackVector getEventsAtTimestamp(int64_t timestamp)
+        {
+            takeIncoming();
+            CallbackVector callbacks{};
+            for (Event* event : heap)
+            {
+                if (event->timestamp == timestamp) callbacks.push_back(event->callback);
+            }
+            return callbacks;
+        }
+        /** timestamp of the next event to fire, or false if there are no events */
+        bool getNextTimestamp(int64_t& timestamp)
+        {
+            takeIncoming();
+            if (heap.empty()) return false;
+            timestamp = heap.front()->timestamp;
+            return true;
+        }
+        /** how many events are waiting to be triggered */
+        std::size_t size()
+        {
+            takeIncoming();
+            return heap.size();
+        }
+        /** set the function triggerAndClearEventsAtNow uses to find the current time,
+         * e.g. the sequencer clock's tick count
+        */
+        void setTimeSource(std::function<int64_t()> source)
+        {
+            timeSource = source;
+        }
+        /** current time on the monotonic clock in nanoseconds*/
+        static int64_t getMonotonicNs()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
     private:
-        std::list<TimestampedCallbacks> timesAndCallbacks;
-        bool timestampCloseEnough(long ts1, long ts2);
-};
-
-
-bool EventQueue::timestampCloseEnough(long ts1, long ts2)
-{
-//     long diff = ts1 - ts2;
-//     diff = diff * diff;
-//    if (diff < 25) return true; // max 5 ms
-   if (ts1 == ts2) return true;
-    return false;
-}
-
-
-EventQueue::EventQueue()
-{
-
-}
-
-void EventQueue::addEvent(long timestamp, SequencerCallback callback)
-{
-    // iterate over the list and insert the event 
-    // at a point where the ts ==  or < 
-    bool done = false;
-    for ( TimestampedCallbacks & item : timesAndCallbacks)
-    {
-        if (timestampCloseEnough(item.timestamp, timestamp))
-            //item.timestamp == timestamp) // insert it here
+        struct Event{
+            int64_t timestamp;
+            uint64_t order;
+            SequencerCallback callback;
+            Event* next;
+        };
+        /** heap comparison - puts the earliest event at the front*/
+        static bool laterThan(const Event* a, const Event* b)
         {
-            //std::cout << "EventQueue::addEvent ts match. inserting here. "<< std::endl;
-            item.callbacks.push_back(callback);
-            //std::cout << "EventQueue::addEvent ts match. inserting here. new len "<< item.callbacks.size() << std::endl;       
-            done = true;
-            break;
-        } 
-    }
-    if (!done)
-    {
-       // std::cout << "EventQueue::addEvent no timestapm match for " << timestamp << std::endl;        
-        TimestampedCallbacks item {timestamp, CallbackVector{callback}};
-        timesAndCallbacks.push_back(item);
-    }
-}
-/** trigger events at the sent timestamp, removing them from the list afterwards */
-void EventQueue::triggerAndClearEventsAtTimestamp(long timestamp)
-{
-    std::list<TimestampedCallbacks>::iterator it = timesAndCallbacks.begin();
-    while (it != timesAndCallbacks.end())
-    {
-        if (timestampCloseEnough(it->timestamp, timestamp))
+            if (a->timestamp != b->timestamp) return a->timestamp > b->timestamp;
+            return a->order > b->order;
+        }
+        /** move everything added since the last call from the stack into the heap*/
+        void takeIncoming()
         {
-            // trigger all the callbacks 
-            for (SequencerCallback& callback : it->callbacks)
+            Event* event = incoming.exchange(nullptr, std::memory_order_acquire);
+            while (event != nullptr)
             {
-                callback();            
+                Event* next = event->next;
+                heap.push_back(event);
+                std::push_heap(heap.begin(), heap.end(), EventQueue::laterThan);
+                event = next;
             }
-            // erase it and assign the previous item
-            // to it: https://stackoverflow.com/questions/596162/can-you-remove-elements-from-a-stdlist-while-iterating-through-it
-            it = timesAndCallbacks.erase(it);
-            // go back one so we can process the next one
         }
-        else  ++it;
-    }  
-}
-/** trigger events now - it will internally work out what the current time is */
-void EventQueue::triggerAndClearEventsAtNow()
-{
+        std::vector<Event*> heap;
+        std::atomic<Event*> incoming;
+        std::atomic<uint64_t> nextOrder;
+        std::function<int64_t()> timeSource;
+};
 
-}   
-/** returns the vector of callbacks attached to the sent timestamp */
-CallbackVector EventQueue::getEventsAtTimestamp(long timestamp)
-{
-    CallbackVector callbacks{};
-    for ( TimestampedCallbacks & item : timesAndCallbacks)
-    {
-        if (timestampCloseEnough(item.timestamp, timestamp))
-        //if (item.timestamp == timestamp) // insert it here
-        {
-              callbacks.insert(
-                    callbacks.end(),
-                    item.callbacks.begin(), 
-                    item.callbacks.end()
-                );
-        } 
-    }
-    return callbacks;
-}
- 
- 
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <atomic>
+#include <iostream>
+#include <cstdint>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include "SimpleClock.h"
+
+/**
+ * Runs a tick timer and any number of readable file descriptors
+ * (stdin, an evdev keyboard, serial ports, raw midi devices) and pollers on one thread
+ * with a single epoll_wait, in place of a thread for each.
+ * The timer is a timerfd armed for each absolute deadline on the monotonic clock,
+ * so like SimpleClock lateness does not build up and changing the interval keeps the phase.
+ * Everything that is ready after a wait is handled in a fixed order:
+ * the timer first, then the readers in the order they were added.
+ * Add readers before run, not from inside a handler.
+ * Only stop may be called from another thread.
+*/
+class EventReactor
+{
+  public:
+    EventReactor() : timerRunning{false}, timerIntervalNs{0}, nextDeadlineNs{0},
+      stopRequested{false}, wakeupCount{0}, tickCount{0}, missedTicks{0}
+    {
+      epollFd = epoll_create1(EPOLL_CLOEXEC);
+      timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+      stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (epollFd < 0 || timerFd < 0 || stopFd < 0)
+      {
+        std::cout << "EventReactor::EventReactor could not create its file descriptors" << std::endl;
+      }
+      watch(timerFd, timerSource);
+      watch(stopFd, stopSource);
+    }
+    ~EventReactor()
+    {
+      if (epollFd >= 0) close(epollFd);
+      if (timerFd >= 0) close(timerFd);
+      if (stopFd >= 0) close(stopFd);
+      for (int fd : pollerFds) close(fd);
+    }
+    /** call onTick(deadlineNs) every intervalNs, the first one intervalNs from now.
+     * If the loop falls a whole interval behind it catches up with a tick
+     * for each deadline missed, as SimpleClock does
+    */
+    void startTimer(int64_t intervalNs, std::function<void(int64_t)> onTick)
+    {
+      this->onTick = onTick;
+      timerIntervalNs = intervalNs < 1 ? 1 : intervalNs;
+      nextDeadlineNs = SimpleClock::getNowNs() + timerIntervalNs;
+      timerRunning = true;
+      armTimer();
+    }
+    void stopTimer()
+    {
+      timerRunning = false;
+      struct itimerspec off{};
+      timerfd_settime(timerFd, 0, &off, nullptr);
+    }
+    /** change the interval from the next tick on: the one after it is the new interval after it*/
+    void setTimerIntervalNs(int64_t intervalNs)
+    {
+      timerIntervalNs = intervalNs < 1 ? 1 : intervalNs;
+    }
+    int64_t getTimerIntervalNs() const { return timerIntervalNs; }
+    /** call onReadable(fd) when fd has something to read, until removeReader.
+     * The reactor does not read or close fd
+    */
+    bool addReader(int fd, std::function<void(int)> onReadable)
+    {
+      if (fd < 0) return false;
+      readers.push_back(Reader{fd, onReadable});
+      if (watch(fd, firstReaderSource + readers.size() - 1)) return true;
+      readers.pop_back();
+      return false;
+    }
+    /** call poll every intervalNs from a timer of its own, for devices that have to be
+     * polled such as the grove joysticks. It is handled as a reader, in the order added.
+     * Returns the timer's fd, for removeReader, or -1 if it could not be made
+    */
+    int addPoller(int64_t intervalNs, std::function<void()> poll)
+    {
+      int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+      if (fd < 0) return -1;
+      if (intervalNs < 1) intervalNs = 1;
+      struct itimerspec every{};
+      every.it_value.tv_sec = intervalNs / 1000000000;
+      every.it_value.tv_nsec = intervalNs % 1000000000;
+      every.it_interval = every.it_value;
+      timerfd_settime(fd, 0, &every, nullptr);
+      bool added = addReader(fd, [poll](int fd){
+        uint64_t expirations;
+        // however many went by, one poll catches up
+        if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations)) poll();
+      });
+      if (!added)
+      {
+        close(fd);
+        return -1;
+      }
+      pollerFds.push_back(fd);
+      return fd;
+    }
+    void removeReader(int fd)
+    {
+      for (Reader& reader : readers)
+      {
+        if (reader.fd != fd) continue;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        // the slot stays so the other readers keep their place in the order
+        reader.fd = -1;
+      }
+    }
+    /** handle events until stop is called*/
+    void run()
+    {
+      while (runOnce(-1)) {}
+    }
+    /** wait up to timeoutMs (-1 for as long as it takes) and handle whatever is ready.
+     * Returns false once stop has been called
+    */
+    bool runOnce(int timeoutMs)
+    {
+      struct epoll_event events[maxEvents];
+      int count = epoll_wait(epollFd, events, maxEvents, timeoutMs);
+      if (count < 0) return errno == EINTR;
+      wakeupCount ++;
+      // fixed order whatever order epoll gives them in: the sources are few
+      // so an insertion sort on the source number is plenty
+      for (int i = 1; i < count; ++i)
+      {
+        struct epoll_event event = events[i];
+        int j = i;
+        for (; j > 0 && events[j - 1].data.u32 > event.data.u32; --j) events[j] = events[j - 1];
+        events[j] = event;
+      }
+      for (int i = 0; i < count; ++i)
+      {
+        uint32_t source = events[i].data.u32;
+        if (source == timerSource) handleTimer();
+        else if (source == stopSource)
+        {
+          // clear it so the reactor can be run again
+          uint64_t stops;
+          ssize_t got = read(stopFd, &stops, sizeof(stops));
+          (void) got;
+          stopRequested = false;
+          return false;
+        }
+        else
+        {
+          // a handler earlier in this round might have removed it
+          Reader& reader = readers[source - firstReaderSource];
+          if (reader.fd >= 0) reader.onReadable(reader.fd);
+        }
+      }
+      return true;
+    }
+    /** make run return once it has finished handling the current round. 
+     * A timer catching up on missed ticks stops straight away, so no tick 
+     * is handled after one that calls stop. Safe from any thread
+    */
+    void stop()
+    {
+      stopRequested = true;
+      uint64_t one = 1;
+      ssize_t written = write(stopFd, &one, sizeof(one));
+      (void) written;
+    }
+    /** how many times epoll_wait has returned with something to do*/
+    long getWakeupCount() const { return wakeupCount; }
+    long getTickCount() const { return tickCount; }
+    /** ticks that were due before the one before them had been handled*/
+    long getMissedTicks() const { return missedTicks; }
+
+  private:
+    struct Reader{
+      int fd;
+      std::function<void(int)> onReadable;
+    };
+    const static uint32_t timerSource{0};
+    const static uint32_t stopSource{1};
+    const static uint32_t firstReaderSource{2};
+    const static int maxEvents{16};
+
+    bool watch(int fd, uint32_t source)
+    {
+      struct epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.u32 = source;
+      return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+    void armTimer()
+    {
+      struct itimerspec when{};
+      when.it_value.tv_sec = nextDeadlineNs / 1000000000;
+      when.it_value.tv_nsec = nextDeadlineNs % 1000000000;
+      timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &when, nullptr);
+    }
+    void handleTimer()
+    {
+      uint64_t expirations;
+      // clears the timer, it is re-armed below
+      ssize_t got = read(timerFd, &expirations, sizeof(expirations));
+      (void) got;
+      if (!timerRunning) return;
+      int64_t nowNs = SimpleClock::getNowNs();
+      bool caughtUp = true;
+      while (timerRunning && !stopRequested && nextDeadlineNs <= nowNs)
+      {
+        if (!caughtUp) missedTicks ++;
+        caughtUp = false;
+        int64_t deadlineNs = nextDeadlineNs;
+        // the interval is read after the tick so a change made in it applies straight away
+        onTick(deadlineNs);
+        tickCount ++;
+        nextDeadlineNs = deadlineNs + timerIntervalNs;
+      }
+      if (timerRunning) armTimer();
+    }
+
+    int epollFd;
+    int timerFd;
+    int stopFd;
+    std::function<void(int64_t)> onTick;
+    bool timerRunning;
+    int64_t timerIntervalNs;
+    int64_t nextDeadlineNs;
+    /** set by stop until run sees the stop event*/
+    std::atomic<bool> stopRequested;
+    std::vector<Reader> readers;
+    // closed along with the reactor
+    std::vector<int> pollerFds;
+    std::atomic<long> wakeupCount;
+    std::atomic<long> tickCount;
+    std::atomic<long> missedTicks;
+};
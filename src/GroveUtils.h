@@ -17,11 +17,13 @@ class GroveJoystickXY
     public:
     /** Create a GroveJoystick 
      * which will call the sent callback
-     * with a x,y values in the range 0-1 whenever the joystick moves
+     * with a x,y values in the range 0-1 whenever the joystick moves.
+     * With ownPoller false it has no polling thread, 
+     * call pollJoystick every 10ms instead, e.g. from an EventReactor poller
     */
     GroveJoystickXY(
         std::function<void(float,float)> callback,
-        int pinX=0, int pinY=1
+        int pinX=0, int pinY=1, bool ownPoller=true
     ) :
         calling{false}, callback{callback}, pinX{pinX}, pinY{pinY}, inX{0}, inY{0}
     {
@@ -30,7 +32,7 @@ class GroveJoystickXY
             GrovePi::initGrovePi(); 
             GrovePi::pinMode(pinX, GrovePi::INPUT);
             GrovePi::pinMode(pinY, GrovePi::INPUT);
-            poller.start(10);
+            if (ownPoller) poller.start(10);
         }catch (GrovePi::I2CError &error)
         {
             std::cout << "GroveJoystick::GroveJoystick grovepi issue" << std::endl;
@@ -93,14 +95,15 @@ class GroveJoystickXY
 class GroveJoystickDirection
 {
     public:
-    GroveJoystickDirection(std::function<void(JoystickEvent)> callback = [](JoystickEvent e){printf("%d", e);}, int _pinX=0, int _pinY=1) : callback{callback}, pinX{_pinX}, pinY{_pinY}   
+    /** with ownPoller false call pollJoystick every 10ms, as for GroveJoystickXY*/
+    GroveJoystickDirection(std::function<void(JoystickEvent)> callback = [](JoystickEvent e){printf("%d", e);}, int _pinX=0, int _pinY=1, bool ownPoller=true) : callback{callback}, pinX{_pinX}, pinY{_pinY}   
     {
         try
         {
             GrovePi::initGrovePi(); 
             GrovePi::pinMode(pinX, GrovePi::INPUT);
             GrovePi::pinMode(pinY, GrovePi::INPUT);
-            poller.start(10);
+            if (ownPoller) poller.start(10);
         }catch (GrovePi::I2CError &error)
         {
             std::cout << "GroveJoystick::GroveJoystick grovepi issue" << std::endl;
@@ -8,6 +8,10 @@
 #include <iostream>
 #include <termios.h>
 #include <fstream>
+#include <vector>
+#include <cerrno>
+#include <signal.h>
+#include <sys/signalfd.h>
 
 
 class Display{
@@ -67,6 +71,223 @@ class Display{
 
 };
 
+/**
+ * Draws text frames to a terminal by only rewriting the characters
+ * that changed since the last frame, using cursor addressing, 
+ * instead of clearing the screen and printing everything again.
+ * Each frame goes out in a single write() call.
+ * Frames are lines separated by '\n' and each byte is treated as one
+ * terminal cell, so frames should be plain ascii.
+ * The terminal is assumed to hold only what this renderer drew;
+ * call invalidate if something else prints so the next frame is drawn in full.
+ */
+class TerminalDiffRenderer
+{
+    public:
+    TerminalDiffRenderer(int fd = STDOUT_FILENO) : fd{fd}, fullRedraw{true}, writeCount{0}
+    {
+        update.reserve(4096);
+    }
+    /** work out what needs sending to turn the last frame into this one
+     * and write it. Returns the number of bytes written
+    */
+    std::size_t render(const std::string& frame)
+    {
+        const std::string& bytes = makeUpdate(frame);
+        if (bytes.empty()) return 0;
+        writeAll(bytes);
+        return bytes.size();
+    }
+    /** the update render would send for this frame, which becomes the last frame.
+     * Empty if nothing changed
+    */
+    const std::string& makeUpdate(const std::string& frame)
+    {
+        update.clear();
+        splitLines(frame, nextLines);
+        if (fullRedraw)
+        {
+            // clear, home, then the whole frame
+            update += "\x1B[2J\x1B[H";
+            for (std::size_t row = 0; row < nextLines.size(); ++row)
+            {
+                if (row > 0) update += "\r\n";
+                update += nextLines[row];
+            }
+            fullRedraw = false;
+        }
+        else 
+        {
+            std::size_t rows = std::max(lines.size(), nextLines.size());
+            for (std::size_t row = 0; row < rows; ++row)
+            {
+                const std::string& before = row < lines.size() ? lines[row] : empty;
+                const std::string& after = row < nextLines.size() ? nextLines[row] : empty;
+                diffLine(row, before, after);
+            }
+        }
+        if (!update.empty())
+        {
+            // leave the cursor under the frame
+            moveTo(nextLines.size(), 0);
+        }
+        lines.swap(nextLines);
+        return update;
+    }
+    /** draw the next frame in full*/
+    void invalidate()
+    {
+        fullRedraw = true;
+    }
+    /** how many write calls have been made*/
+    long getWriteCount() const
+    {
+        return writeCount;
+    }
+
+    private:
+    /** split into lines, reusing the strings in out */
+    static void splitLines(const std::string& frame, std::vector<std::string>& out)
+    {
+        std::size_t count = 0;
+        std::size_t start = 0;
+        while (start <= frame.size())
+        {
+            std::size_t end = frame.find('\n', start);
+            if (end == std::string::npos) end = frame.size();
+            // a trailing newline does not start another line
+            if (start == frame.size() && start != 0 && end == start) break;
+            if (count == out.size()) out.emplace_back();
+            out[count].assign(frame, start, end - start);
+            ++count;
+            start = end + 1;
+        }
+        out.resize(count);
+    }
+    /** add the updates for one row: each run of changed cells is a cursor move
+     * then the new characters, and a shorter line is cleared to its end
+    */
+    void diffLine(std::size_t row, const std::string& before, const std::string& after)
+    {
+        std::size_t col = 0;
+        while (col < after.size())
+        {
+            if (col < before.size() && before[col] == after[col])
+            {
+                ++col;
+                continue;
+            }
+            // short gaps of unchanged cells are cheaper to resend than to skip
+            std::size_t lastChanged = col;
+            for (std::size_t i = col + 1; i < after.size() && i - lastChanged <= 4; ++i)
+            {
+                if (i >= before.size() || before[i] != after[i]) lastChanged = i;
+            }
+            std::size_t runEnd = lastChanged + 1;
+            moveTo(row, col);
+            update.append(after, col, runEnd - col);
+            col = runEnd;
+        }
+        if (before.size() > after.size())
+        {
+            moveTo(row, after.size());
+            update += "\x1B[K";
+        }
+    }
+    /** cursor to the zero based row and col*/
+    void moveTo(std::size_t row, std::size_t col)
+    {
+        update += "\x1B[";
+        update += std::to_string(row + 1);
+        update += ';';
+        update += std::to_string(col + 1);
+        update += 'H';
+    }
+    void writeAll(const std::string& bytes)
+    {
+        writeCount ++;
+        const char* data = bytes.data();
+        std::size_t size = bytes.size();
+        while (size > 0)
+        {
+            ssize_t written = write(fd, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR) continue;
+                return;
+            }
+            data += written;
+            size -= written;
+        }
+    }
+    int fd;
+    bool fullRedraw;
+    long writeCount;
+    std::vector<std::string> lines;
+    std::vector<std::string> nextLines;
+    std::string update;
+    const std::string empty{};
+};
+
+
+/** switches the terminal to unbuffered input with no echo for as long as it exists,
+ * so keys can be read from stdin as they are pressed without blocking in getCharNoEcho,
+ * e.g. from an EventReactor */
+class RawTerminalInput
+{
+    public:
+        RawTerminalInput()
+        {
+            if (tcgetattr(0, &saved) < 0) return;
+            struct termios raw = saved;
+            raw.c_lflag &= ~ICANON;
+            raw.c_lflag &= ~ECHO;
+            raw.c_cc[VMIN] = 1;
+            raw.c_cc[VTIME] = 0;
+            changed = tcsetattr(0, TCSANOW, &raw) == 0;
+        }
+        ~RawTerminalInput()
+        {
+            if (changed) tcsetattr(0, TCSADRAIN, &saved);
+        }
+    private:
+        struct termios saved{};
+        bool changed{false};
+};
+
+/** receives a signal, e.g. SIGUSR1, by reading a file descriptor instead of in a handler,
+ * so it can be waited on in an EventReactor or on a thread of its own, where anything goes.
+ * The signal is blocked for the creating thread and threads it starts from then on,
+ * so create it before starting any threads */
+class SignalReader
+{
+    public:
+        SignalReader(int signal)
+        {
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigaddset(&mask, signal);
+            pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+            fd = signalfd(-1, &mask, SFD_CLOEXEC);
+            if (fd < 0) perror("SignalReader::SignalReader signalfd ");
+        }
+        ~SignalReader()
+        {
+            if (fd >= 0) close(fd);
+        }
+        int getFd() const
+        {
+            return fd;
+        }
+        /** wait for the signal to arrive, returns false on error*/
+        bool read()
+        {
+            struct signalfd_siginfo info;
+            return fd >= 0 && ::read(fd, &info, sizeof(info)) == sizeof(info);
+        }
+    private:
+        int fd;
+};
 
 /** class that provides keyboard input helpers 
  * including low level keyboard input */
@@ -75,10 +296,15 @@ class KeyReader
     public:
         KeyReader(std::string device = "/dev/input/event0")
         {
-            if ((file_ref = open("/dev/input/event0", O_RDONLY)) < 0) {
+            if ((file_ref = open(device.c_str(), O_RDONLY)) < 0) {
                 perror("KeyReader::construct cannot read keyboard device ");
             }
         }
+        /** the keyboard device, e.g. to wait on it in an EventReactor*/
+        int getFd() const
+        {
+            return file_ref;
+        }
         /** 
          * read a char from keyboard with no echo and instant response
          * https://stackoverflow.com/a/912796/1240660
@@ -105,46 +331,40 @@ class KeyReader
         /** read a character from the raw keyboard device */
         char getChar()
         {
-          
-            int rd, code_id, ev_count, key_code;
-            ev_count = 0;
-            key_code = 0;
+            int key_code;
             // keep reading until 
-            // we get a key down or key held event
-            while(1)
-            {
-                rd = read(file_ref, ev, sizeof(struct input_event) * 64);
-                if (rd > 48) continue; // holding lots of keys, ignore.
-                ev_count = rd / sizeof(struct input_event);
-                if(ev_count == 2)
-                {
-                    code_id = 0;
-                }
-                else if (ev_count == 3)
-                {
-                    code_id = 1;
-                }
-
-                // .code tells you the key they pressed
-                key_code = ev[code_id].code;
-                // .value tells you key up, down, hold 
-                //1 and 2 are key down or held events
-               // if (ev[code_id].value == 1 || ev[code_id].value == 2)
-                //printf("KeyUtisl:: %i %i \n", key_code, ev[code_id].value);   
-               
-                if (ev[code_id].value == 0) // only break on key up...
-                {
-          //          std::cout << "KeyUtils:: breaking " << std::endl;
-                    break;
-                }
-                // else {
-                //     std::cout << "KeyUtils:: waiting " << std::endl;
-                // }
-            }
+            // we get a key up event
+            while((key_code = readKeyUp()) < 0){}
             //std::cout << "KeyUtils:: returning " << key_code << std::endl;
-
             return key_code;  
         }
+        /** read what the keyboard device has sent, 
+         * returning the key code if it was a key being let go, -1 otherwise.
+         * Blocks if nothing has been sent
+        */
+        int readKeyUp()
+        {
+            int rd, code_id, ev_count;
+            rd = read(file_ref, ev, sizeof(struct input_event) * 64);
+            if (rd < 0 || rd > 48) return -1; // holding lots of keys, ignore.
+            ev_count = rd / sizeof(struct input_event);
+            if(ev_count == 2)
+            {
+                code_id = 0;
+            }
+            else if (ev_count == 3)
+            {
+                code_id = 1;
+            }
+            else return -1;
+            // .code tells you the key they pressed
+            // .value tells you key up, down, hold 
+            //1 and 2 are key down or held events
+            // if (ev[code_id].value == 1 || ev[code_id].value == 2)
+            //printf("KeyUtisl:: %i %i \n", key_code, ev[code_id].value);   
+            if (ev[code_id].value == 0) return ev[code_id].code; // only key up...
+            return -1;
+        }
 
     private:
         struct input_event ev[64];
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+/**
+ * Counts nanosecond timings in log-linear buckets, as HdrHistogram does:
+ * values below 64ns each get a bucket, above that every power of two
+ * is split into 32 buckets, so any value is reported to within about 3%
+ * from a fixed block of counters covering up to about 18 minutes.
+ * record is lock free and never allocates, so it can be called from the clock
+ * thread while another thread reads percentiles, e.g. to dump them on a signal.
+ * A read taken while values are being recorded may be a few values behind.
+*/
+class LatencyHistogram
+{
+  public:
+    LatencyHistogram()
+    {
+      reset();
+    }
+    /** count one timing, negative values count as 0*/
+    void record(int64_t valueNs)
+    {
+      if (valueNs < 0) valueNs = 0;
+      if (valueNs > maxTrackableNs) valueNs = maxTrackableNs;
+      counts[bucketFor(valueNs)].fetch_add(1, std::memory_order_relaxed);
+      totalCount.fetch_add(1, std::memory_order_relaxed);
+      totalNs.fetch_add(valueNs, std::memory_order_relaxed);
+      int64_t max = maxNs.load(std::memory_order_relaxed);
+      while (valueNs > max && !maxNs.compare_exchange_weak(max, valueNs, std::memory_order_relaxed)) {}
+    }
+    /** clear the counts. Values recorded at the same time might be lost*/
+    void reset()
+    {
+      for (std::atomic<uint64_t>& count : counts) count.store(0, std::memory_order_relaxed);
+      totalCount = 0;
+      totalNs = 0;
+      maxNs = 0;
+    }
+    uint64_t getCount() const { return totalCount; }
+    /** the largest value recorded, exactly*/
+    int64_t getMaxNs() const { return maxNs; }
+    int64_t getMeanNs() const
+    {
+      uint64_t count = totalCount;
+      return count == 0 ? 0 : totalNs / (int64_t) count;
+    }
+    /** the value that percentile (0-100) of the recorded values are at or below,
+     * as the top of its bucket and never more than the max
+    */
+    int64_t getPercentileNs(double percentile) const
+    {
+      uint64_t total = 0;
+      for (const std::atomic<uint64_t>& count : counts) total += count.load(std::memory_order_relaxed);
+      if (total == 0) return 0;
+      if (percentile > 100) percentile = 100;
+      uint64_t wanted = (uint64_t) (percentile / 100.0 * total + 0.5);
+      if (wanted < 1) wanted = 1;
+      uint64_t seen = 0;
+      for (int bucket = 0; bucket < bucketCount; ++bucket)
+      {
+        seen += counts[bucket].load(std::memory_order_relaxed);
+        if (seen < wanted) continue;
+        int64_t top = bucketTopNs(bucket);
+        int64_t max = maxNs;
+        return top < max ? top : max;
+      }
+      return maxNs;
+    }
+    /** name: count, p50, p99 and max in microseconds*/
+    std::string toString(const std::string& name) const
+    {
+      return name + ": " + std::to_string(getCount()) + " values, p50 "
+             + std::to_string(getPercentileNs(50) / 1000.0) + "us p99 "
+             + std::to_string(getPercentileNs(99) / 1000.0) + "us max "
+             + std::to_string(getMaxNs() / 1000.0) + "us";
+    }
+
+  private:
+    // 32 buckets for each power of two from 64ns up to 2^40ns, plus the 64 exact ones below
+    constexpr static int subBucketBits{5};
+    constexpr static int subBucketCount{1 << subBucketBits};
+    constexpr static int maxValueBits{40};
+    constexpr static int bucketCount{2 * subBucketCount + (maxValueBits - subBucketBits - 1) * subBucketCount};
+    constexpr static int64_t maxTrackableNs{((int64_t) 1 << maxValueBits) - 1};
+
+    static int bucketFor(int64_t valueNs)
+    {
+      if (valueNs < 2 * subBucketCount) return (int) valueNs;
+      int topBit = 63 - __builtin_clzll((uint64_t) valueNs);
+      int shift = topBit - subBucketBits;
+      int subBucket = (int) (valueNs >> shift) - subBucketCount;
+      return 2 * subBucketCount + (shift - 1) * subBucketCount + subBucket;
+    }
+    /** the largest value that goes in the bucket*/
+    static int64_t bucketTopNs(int bucket)
+    {
+      if (bucket < 2 * subBucketCount) return bucket;
+      int shift = (bucket - 2 * subBucketCount) / subBucketCount + 1;
+      int64_t subBucket = (bucket - 2 * subBucketCount) % subBucketCount + subBucketCount;
+      return ((subBucket + 1) << shift) - 1;
+    }
+
+    std::atomic<uint64_t> counts[bucketCount];
+    std::atomic<uint64_t> totalCount;
+    std::atomic<int64_t> totalNs;
+    std::atomic<int64_t> maxNs;
+};
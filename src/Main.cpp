@@ -4,6 +4,8 @@
 #include <fstream>
 #include <string>
 #include <assert.h>
+#include <atomic>
+#include <cctype>
 #include "../lib/ml/rapidLib.h"
 
 #include "SimpleClock.h"
@@ -12,193 +14,375 @@
 #include "RapidLibUtils.h"
 #include "MidiUtils.h"
 #include "IOUtils.h"
+#include "RenderThread.h"
+#include "WioLink.h"
+#include "EventReactor.h"
 
+/** the clock reads which sequencer to tick from playingSeqr on every tick,
+ * so switching sequencer does not touch the callback while the clock runs.
+ * Drawing is left to the render thread, the clock only tells it when 
+ * the sequencer's snapshot has changed
+ */
 void updateClockCallback(SimpleClock& clock, 
-                    Sequencer* currentSeqr, 
-                    SequencerEditor& seqEditor, 
+                    std::atomic<Sequencer*>& playingSeqr, 
                     MidiUtils& midiUtils, 
-                    std::string& wioSerial)
+                    RenderThread& renderer)
 {
-  clock.setCallback([currentSeqr, &seqEditor, &midiUtils, &clock, &wioSerial](){
+  uint64_t drawnVersion = 0;
+  clock.setCallback([&playingSeqr, &midiUtils, &clock, &renderer, drawnVersion]() mutable {
+      Sequencer* currentSeqr = playingSeqr;
       midiUtils.sendQueuedMessages(clock.getCurrentTick());
       currentSeqr->tick();
-      std::string output = SequencerViewer::toTextDisplay(9, 13, currentSeqr, &seqEditor);
-      Display::redrawToConsole(output);
-      if (wioSerial != "")
-        Display::redrawToWio(wioSerial, output);    
+      // sends this tick's messages if batching is on
+      midiUtils.flushBatch();
+      uint64_t version = currentSeqr->getSnapshotVersion();
+      if (version == drawnVersion) return;
+      drawnVersion = version;
+      renderer.requestRedraw();
     });
 }
 
-int main()
+/** the clock's lateness and callback time and the midi port's send time.
+ * Safe from any thread while the clock runs
+ */
+void printTimingHistograms(const SimpleClock& clock, MidiUtils& midiUtils, std::ostream& out)
 {
+  out << clock.getHistogramReport() << std::endl;
+  ThreadedMidiBackend* outputStage = midiUtils.getOutputStage();
+  if (outputStage != nullptr) out << outputStage->getSendHistogram().toString("midi send") << std::endl;
+}
+
+/** draws the playing sequencer to the console and the wio terminal.
+ * Called on the render thread
+ */
+void renderSequencer(Sequencer* seqr, 
+                    const EditorCursor& cursor, 
+                    WioSerialLink* wioLink, 
+                    SequencerSnapshot& snapshot, 
+                    TerminalDiffRenderer& console)
+{
+  seqr->readSnapshot(snapshot);
+  std::string output = SequencerViewer::toTextDisplay(9, 13, snapshot, cursor);
+  console.render(output);
+  if (wioLink != nullptr)
+    wioLink->sendFrame(output);
+}
+
+int main(int argc, char** argv)
+{
+  // the numbers come first and any words after them
+    int numberArgs = 1;
+    while (numberArgs < argc && (std::isdigit(argv[numberArgs][0]) || argv[numberArgs][0] == '-')) numberArgs ++;
+    auto hasWord = [argc, argv, numberArgs](const std::string& word){
+      for (int i = numberArgs; i < argc; ++i) if (word == argv[i]) return true;
+      return false;
+    };
+  // what comes after prefix in the word that starts with it
+    auto wordValue = [argc, argv, numberArgs](const std::string& prefix){
+      for (int i = numberArgs; i < argc; ++i)
+      {
+        std::string word{argv[i]};
+        if (word.rfind(prefix, 0) == 0) return word.substr(prefix.size());
+      }
+      return std::string{};
+    };
+  // optional timing resolution, e.g. ./oto-sequencer 960
+    unsigned int ppqn = 4;
+    if (numberArgs > 1) ppqn = std::stoi(argv[1]);
+  // optional display frame rate cap, e.g. ./oto-sequencer 960 60
+    double maxFps = 30;
+    if (numberArgs > 2) maxFps = std::stod(argv[2]);
+  // optional real time clock thread priority and cpu to pin it to, e.g. ./oto-sequencer 960 60 80 3
+    ClockRealTimeSettings realTime{};
+    if (numberArgs > 3) realTime.priority = std::stoi(argv[3]);
+    if (numberArgs > 4) realTime.cpu = std::stoi(argv[4]);
+    if (realTime.priority > 0)
+    {
+      realTime.lockMemory = true;
+      realTime.prefaultStackBytes = 256 * 1024;
+    }
+  // optional spin mode for tighter timing at the cost of cpu, e.g. ./oto-sequencer 960 60 80 3 spin
+    bool spinClock = hasWord("spin");
+  // optional single threaded mode: the clock ticks and the keys are handled 
+  // from one epoll loop, e.g. ./oto-sequencer 960 60 80 3 reactor
+    bool useReactor = hasWord("reactor");
+  // optional raw midi device or serial port to send to instead of an RtMidi port,
+  // and batching of each tick's messages into one write with running status
+  // so chords do not flam, e.g. ./oto-sequencer 960 midi=/dev/snd/midiC1D0 batch
+    std::string rawMidiDevice = wordValue("midi=");
+    bool batchMidi = hasWord("batch");
+  // kill -USR1 dumps the timing histograms to stderr, as does the l key
+  // so they can go to a file with 2> while the display runs. Before any threads start
+    SignalReader dumpSignal{SIGUSR1};
   // wio terminal serial display device if available
     std::string wioSerial = Display::getSerialDevice();
-  // maps computer keyboard to midi notes
-    std::map<char, double> key_to_note = MidiUtils::getKeyboardToMidiNotes();
+  // kept open from here on as opening the port can reset the wio
+    WioSerialLink* wioLink = nullptr;
+    if (wioSerial != "") wioLink = new WioSerialLink{wioSerial};
     
     MidiUtils midiUtils;
-    midiUtils.interactiveInitMidi();
-    midiUtils.allNotesOff();
+    if (rawMidiDevice != "" && !midiUtils.openRawDevice(rawMidiDevice))
+    {
+      std::cout << "Could not open " << rawMidiDevice << ", using RtMidi" << std::endl;
+      rawMidiDevice = "";
+    }
+    if (rawMidiDevice == "") midiUtils.interactiveInitMidi();
+    midiUtils.resetAllChannels();
+    midiUtils.setBatchMode(batchMidi);
   
     SimpleClock clock{};
+    clock.setRealTime(realTime);
+    clock.setSpinMode(spinClock);
 
     // create a vector of sequences
     std::vector<Sequencer*> seqrs{};
     for (int i=0;i<4;i++) seqrs.push_back(new Sequencer{16,8});
+    for (Sequencer* seqr : seqrs) seqr->setPPQN(ppqn);
+    // setPPQN ignores values that are not a multiple of 4
+    ppqn = seqrs[0]->getPPQN();
     Sequencer* currentSeqr = seqrs[0];
+    std::atomic<Sequencer*> playingSeqr{currentSeqr};
     SequencerEditor seqEditor{currentSeqr};
+    // edits from this thread are applied by the clock thread
+    for (Sequencer* seqr : seqrs) seqr->setEditQueueEnabled(true);
    
     for (Sequencer* seqr : seqrs)
     {
       // set up a midi note triggering callback 
-      // on all steps
-      seqr->setAllCallbacks(
-          [&midiUtils, &clock](std::vector<double>* data){
-            if (data->size() >= 3)
-            {
-              double channel = data->at(Step::channelInd);
-              double offTick = clock.getCurrentTick() + data->at(Step::lengthInd);
-              // make the length quantised by steps
-              double noteVolocity = data->at(Step::velInd);
-              double noteOne = data->at(Step::note1Ind);
-              midiUtils.playSingleNote(channel, noteOne, noteVolocity, offTick);            
-            }
+      // for all sequences
+      seqr->setEventCallback(
+          [&midiUtils, &clock](const StepEvent& event){
+            long offTick = clock.getCurrentTick() + event.length;
+            midiUtils.playSingleNote(event.channel, event.note, event.velocity, offTick);            
           }
       );
     }
 
+    // only the render thread uses these
+    SequencerSnapshot renderSnapshot;
+    TerminalDiffRenderer console{};
+    RenderThread renderer{[&playingSeqr, &seqEditor, wioLink, &renderSnapshot, &console](){
+        // the key thread moves the editor, so draw from a copy of its cursor
+        renderSequencer(playingSeqr, seqEditor.getCursor(), wioLink, renderSnapshot, console);
+      }, maxFps};
+
     updateClockCallback(clock, 
-                        currentSeqr, 
-                        seqEditor, 
+                        playingSeqr, 
                         midiUtils, 
-                        wioSerial);
+                        renderer);
     
     // this will map joystick x,y to 16 sequences
     //rapidLib::regression network = NeuralNetwork::getMelodyStepsRegressor();
-    int clockIntervalMs = 125;  
-    clock.start(clockIntervalMs);
-    char input {1};
+    double bpm = 120;  
     bool escaped = false;
     bool redraw = false; 
     bool running = true; 
-
-    while (input != 'q')
-    {
-      input = KeyReader::getCharNoEcho();
-      if (!escaped)
+    // in reactor mode the clock is ticked by the reactor's timer on this thread
+    EventReactor reactor{};
+    auto startClock = [&](){
+      if (!useReactor) 
       {
-        switch(input)
-        {
-          case '\033': // first escape character cursor key?
-            escaped = true;
-            continue;
-          case '\t':  // next 'mode'
-            seqEditor.cycleEditMode();
-            continue;
-          case 'p': // stop / start
-            midiUtils.allNotesOff();
-            if (running) clock.stop();
-            else clock.start(clockIntervalMs);
-            running = !running; 
-            continue;
-          case ' ': // mute
-            seqEditor.cycleAtCursor();
-            continue;
-          case '-': // slower
-            clockIntervalMs += 5;
-            clock.stop();
-            clock.start(clockIntervalMs);
-            continue;
-          case '=': // faster
-            clockIntervalMs -= 5;
-            clock.stop();
-            clock.start(clockIntervalMs);
-            continue;
-          case '\n': // enter
-            //seqEditor.cycleMode();
-            seqEditor.enterAtCursor();
-            continue;
-          case 'r':
-            //seqEditor
-            seqEditor.resetAtCursor();
-            continue;
-//          case (wchar_t)(127): // delete
-//            seqEditor.enterNoteData(0);
-//            continue;
-        }// send switch on key
-        // now check for sequence switch
-        for (int i=0;i<seqrs.size();i++)
+        clock.startBPM(bpm, ppqn);
+        return;
+      }
+      clock.startDriven(SimpleClock::bpmToIntervalNs(bpm, ppqn));
+      reactor.startTimer(clock.getIntervalNs(), [&clock, &reactor](int64_t deadlineNs){
+        // driveTick hands back the next interval, so tempo changes and ramps carry on working
+        reactor.setTimerIntervalNs(clock.driveTick(deadlineNs));
+      });
+    };
+    auto stopClock = [&](){
+      clock.stop();
+      if (useReactor) reactor.stopTimer();
+    };
+    auto handleKey = [&](char input){
+        if (!escaped)
         {
-          if (input == 49 + i) // ascii 1 == 49
-          //if (false)
+          switch(input)
           {
-            assert (i < seqrs.size());
-            midiUtils.allNotesOff();
-            currentSeqr = seqrs[i];
-            // clock needs to know it is calling 
-            // tick on a different sequencer
-            updateClockCallback(clock, 
-                    currentSeqr, 
-                    seqEditor, 
-                    midiUtils, 
-                    wioSerial);
-            seqEditor.setSequencer(currentSeqr);
-            seqEditor.resetCursor();
+            case '\033': // first escape character cursor key?
+              escaped = true;
+              return;
+            case '\t':  // next 'mode'
+              seqEditor.cycleEditMode();
+              return;
+            case 'p': // stop / start
+              if (running) 
+              {
+                stopClock();
+                midiUtils.allNotesOff();
+                // nothing is ticking so edits can go straight in
+                for (Sequencer* seqr : seqrs) seqr->setEditQueueEnabled(false);
+              }
+              else 
+              {
+                for (Sequencer* seqr : seqrs) seqr->setEditQueueEnabled(true);
+                startClock();
+              }
+              running = !running; 
+              return;
+            case ' ': // mute
+              seqEditor.cycleAtCursor();
+              return;
+            case '-': // slower
+              if (bpm > 5) bpm -= 5;
+              clock.setBPM(bpm, ppqn);
+              return;
+            case '=': // faster
+              bpm += 5;
+              clock.setBPM(bpm, ppqn);
+              return;
+            case '_': // ritardando over two bars
+              if (bpm > 25) 
+              {
+                clock.rampBPM(bpm - 20, ppqn, (int64_t) (8 * 60000000000.0 / bpm));
+                bpm -= 20;
+              }
+              return;
+            case '+': // accelerando over two bars
+              clock.rampBPM(bpm + 20, ppqn, (int64_t) (8 * 60000000000.0 / bpm));
+              bpm += 20;
+              return;
+            case '\n': // enter
+              //seqEditor.cycleMode();
+              seqEditor.enterAtCursor();
+              return;
+            case 'r':
+              //seqEditor
+              seqEditor.resetAtCursor();
+              return;
+            case 'l': // latency
+              printTimingHistograms(clock, midiUtils, std::cerr);
+              return;
+  //          case (wchar_t)(127): // delete
+  //            seqEditor.enterNoteData(0);
+  //            return;
+          }// send switch on key
+          // now check for sequence switch
+          for (int i=0;i<seqrs.size();i++)
+          {
+            if (input == 49 + i) // ascii 1 == 49
+            //if (false)
+            {
+              assert (i < seqrs.size());
+              // the clock thread does it if the clock is running
+              if (running) midiUtils.requestAllNotesOff();
+              else midiUtils.allNotesOff();
+              currentSeqr = seqrs[i];
+              // clock needs to know it is calling 
+              // tick on a different sequencer
+              playingSeqr = currentSeqr;
+              seqEditor.setSequencer(currentSeqr);
+              seqEditor.resetCursor();
             
+            }
           }
-        }
-        // now check all the piano keys
-        bool key_note_match{false};
-        for (const std::pair<char, double>& key_note : key_to_note)
-        {
-          if (input == key_note.first) 
-          { 
-            key_note_match = true;
-            seqEditor.enterNoteData(key_note.second); 
+          // now check all the piano keys
+          int key_note = MidiUtils::keyToNote(input);
+          if (key_note >= 0)
+          {
+            seqEditor.enterNoteData(key_note); 
             redraw = true;   
-            break;// break the for loop
+          }
+        } // end if !escapted
+        if (escaped){
+          switch(input){
+            case '[': 
+              return;
+            case 'A':
+              // up
+              seqEditor.moveCursorUp();
+              escaped = false;
+              redraw = true;   
+              return;
+            case 'D':
+              // left
+              seqEditor.moveCursorLeft();
+              escaped = false;
+              redraw = true;   
+              return;
+            case 'C':
+              // right
+              seqEditor.moveCursorRight();
+              escaped = false;
+              redraw = true;   
+              return;
+            case 'B':
+              // down
+              seqEditor.moveCursorDown();
+              escaped = false;
+              redraw = true;   
           }
         }
-        //if (key_note_match) continue; // continue the while loop
-      } // end if !escapted
-      if (escaped){
-        switch(input){
-          case '[': 
-            continue;
-          case 'A':
-            // up
-            seqEditor.moveCursorUp();
-            escaped = false;
-            redraw = true;   
-            continue;
-          case 'D':
-            // left
-            seqEditor.moveCursorLeft();
-            escaped = false;
-            redraw = true;   
-            continue;
-          case 'C':
-            // right
-            seqEditor.moveCursorRight();
-            escaped = false;
-            redraw = true;   
-            continue;
-          case 'B':
-            // down
-            seqEditor.moveCursorDown();
-            escaped = false;
-            redraw = true;   
+        if (redraw) renderer.requestRedraw();
+    };
+
+    if (useReactor)
+    {
+      // keys arrive as they are pressed, on the same thread as the ticks
+      bool watchingKeys = reactor.addReader(0, [&reactor, &handleKey](int fd){
+        char keys[64];
+        ssize_t got = read(fd, keys, sizeof(keys));
+        if (got <= 0) reactor.stop();
+        for (ssize_t i = 0; i < got; ++i)
+        {
+          handleKey(keys[i]);
+          if (keys[i] == 'q') 
+          {
+            reactor.stop();
+            return;
+          }
         }
-      }
-      if (redraw)
+      });
+      if (!watchingKeys)
       {
-        std::string output = SequencerViewer::toTextDisplay(9, 13, currentSeqr, &seqEditor);
-        Display::redrawToConsole(output);
-        if (wioSerial != "")
-          Display::redrawToWio(wioSerial, output);
+        // e.g. stdin is a file, which epoll will not watch
+        std::cout << "Could not watch stdin with the reactor, using the clock thread" << std::endl;
+        useReactor = false;
       }
-    }// end of key input loop
-  clock.stop();
+    }
+    startClock();
+    ClockRealTimeStatus realTimeStatus{};
+    if (useReactor)
+    {
+      // there is no clock thread, this one does the ticks
+      realTimeStatus = SimpleClock::applyRealTime(realTime);
+      RawTerminalInput rawInput{};
+      reactor.addReader(dumpSignal.getFd(), [&](int fd){
+        if (dumpSignal.read()) printTimingHistograms(clock, midiUtils, std::cerr);
+      });
+      reactor.run();
+    }
+    else 
+    {
+      std::atomic<bool> quitting{false};
+      std::thread dumpThread{[&](){
+        while (dumpSignal.read() && !quitting) printTimingHistograms(clock, midiUtils, std::cerr);
+      }};
+      char input {1};
+      while (input != 'q')
+      {
+        input = KeyReader::getCharNoEcho();
+        handleKey(input);
+      }// end of key input loop
+      realTimeStatus = clock.getRealTimeStatus();
+      // wakes the dump thread so it can see it is time to go
+      quitting = true;
+      kill(getpid(), SIGUSR1);
+      dumpThread.join();
+    }
+  stopClock();
+  renderer.stop();
+  std::cout << "render frames: " << renderer.getFrameCount() 
+            << " average ms: " << renderer.getAverageFrameNs() / 1000000.0 
+            << " max ms: " << renderer.getMaxFrameNs() / 1000000.0 << std::endl;
+  std::cout << realTimeStatus.toString() << std::endl;
+  std::cout << clock.getTimingReport() << std::endl;
+  printTimingHistograms(clock, midiUtils, std::cout);
+  if (useReactor) std::cout << "reactor wakeups: " << reactor.getWakeupCount() 
+                            << " ticks: " << reactor.getTickCount() 
+                            << " missed: " << reactor.getMissedTicks() << std::endl;
+  delete wioLink;
 
   midiUtils.allNotesOff();
   for (Sequencer* s : seqrs) delete s;
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <fstream>
 #include <stdio.h>  
+#include <cctype>
 
 #include "../lib/ml/rapidLib.h"
 
@@ -12,13 +13,16 @@
 #include "MidiUtils.h"
 #include "GroveUtils.h"
 #include "IOUtils.h"
+#include "RenderThread.h"
+#include "WioLink.h"
+#include "EventReactor.h"
 #include <unistd.h>
 #include <termios.h>
 
-void redrawGroveLCD(Sequencer& seqr, SequencerEditor& seqEditor, GrovePi::LCD& lcd)
+void redrawGroveLCD(const SequencerSnapshot& snapshot, SequencerEditor& seqEditor, GrovePi::LCD& lcd)
 { 
-    std::string disp = SequencerViewer::toTextDisplay(2, 16, &seqr, &seqEditor);
-    std::cout << disp << std::endl;
+    // not echoed to the console, the render thread owns the terminal
+    std::string disp = SequencerViewer::toTextDisplay(2, 16, snapshot, seqEditor.getCursor());
     lcd.setText(disp.c_str());
 }
 
@@ -64,19 +68,71 @@ void setupMidiViaLCD(MidiUtils& midiUtils, KeyReader& keyReader, GrovePi::LCD& l
     }
     std::cout << "selecting a device " << midiDev << std::endl;
     midiUtils.selectOutputDevice(midiDev);
-    midiUtils.allNotesOff();
+    midiUtils.resetAllChannels();
 }
 
 
-int main()
+/** the clock's lateness and callback time and the midi port's send time.
+ * Safe from any thread while the clock runs
+ */
+void printTimingHistograms(const SimpleClock& clock, MidiUtils& midiUtils, std::ostream& out)
 {
-    KeyReader keyReader;
-    // maps from raw event input keycodes
-    // to midi notes
-    const std::map<char, double> key_to_note = MidiUtils::getKeyboardToMidiNotes();
+    out << clock.getHistogramReport() << std::endl;
+    ThreadedMidiBackend* outputStage = midiUtils.getOutputStage();
+    if (outputStage != nullptr) out << outputStage->getSendHistogram().toString("midi send") << std::endl;
+}
 
+int main(int argc, char** argv)
+{
+    // the numbers come first and any words after them
+    int numberArgs = 1;
+    while (numberArgs < argc && (std::isdigit(argv[numberArgs][0]) || argv[numberArgs][0] == '-')) numberArgs ++;
+    auto hasWord = [argc, argv, numberArgs](const std::string& word){
+      for (int i = numberArgs; i < argc; ++i) if (word == argv[i]) return true;
+      return false;
+    };
+    // what comes after prefix in the word that starts with it
+    auto wordValue = [argc, argv, numberArgs](const std::string& prefix){
+      for (int i = numberArgs; i < argc; ++i)
+      {
+        std::string word{argv[i]};
+        if (word.rfind(prefix, 0) == 0) return word.substr(prefix.size());
+      }
+      return std::string{};
+    };
+    // optional timing resolution, e.g. ./oto-sequencer-pi 960
+    unsigned int ppqn = 4;
+    if (numberArgs > 1) ppqn = std::stoi(argv[1]);
+    // optional display frame rate cap, e.g. ./oto-sequencer-pi 960 60
+    double maxFps = 30;
+    if (numberArgs > 2) maxFps = std::stod(argv[2]);
+    // optional real time clock thread priority and cpu to pin it to, e.g. ./oto-sequencer-pi 960 60 80 3
+    ClockRealTimeSettings realTime{};
+    if (numberArgs > 3) realTime.priority = std::stoi(argv[3]);
+    if (numberArgs > 4) realTime.cpu = std::stoi(argv[4]);
+    if (realTime.priority > 0)
+    {
+      realTime.lockMemory = true;
+      realTime.prefaultStackBytes = 256 * 1024;
+    }
+    // optional spin mode for tighter timing at the cost of cpu, e.g. ./oto-sequencer-pi 960 60 80 3 spin
+    bool spinClock = hasWord("spin");
+    // optional single threaded mode: the clock ticks and the keys are handled 
+    // from one epoll loop, e.g. ./oto-sequencer-pi 960 60 80 3 reactor
+    bool useReactor = hasWord("reactor");
+    // optional raw midi device or serial port to send to instead of an RtMidi port,
+    // and batching of each tick's messages into one write with running status
+    // so chords do not flam, e.g. ./oto-sequencer-pi 960 midi=/dev/snd/midiC1D0 batch
+    std::string rawMidiDevice = wordValue("midi=");
+    bool batchMidi = hasWord("batch");
+    // kill -USR1 dumps the timing histograms to stderr. Before any threads start
+    SignalReader dumpSignal{SIGUSR1};
+    KeyReader keyReader;
     // access to the wio
     std::string wioSerial = Display::getSerialDevice();
+    // kept open from here on as opening the port can reset the wio
+    WioSerialLink* wioLink = nullptr;
+    if (wioSerial != "") wioLink = new WioSerialLink{wioSerial};
     
     // access to the rgb lcd
     GrovePi::LCD lcd{};
@@ -100,98 +156,169 @@ int main()
     MidiUtils midiUtils;
     //midiUtils.interactiveInitMidi();
     //midiUtils.allNotesOff();
-    setupMidiViaLCD(midiUtils, keyReader, lcd);
+    if (rawMidiDevice != "" && !midiUtils.openRawDevice(rawMidiDevice))
+    {
+        std::cout << "Could not open " << rawMidiDevice << ", using RtMidi" << std::endl;
+        rawMidiDevice = "";
+    }
+    if (rawMidiDevice == "") setupMidiViaLCD(midiUtils, keyReader, lcd);
+    else midiUtils.resetAllChannels();
+    midiUtils.setBatchMode(batchMidi);
     Sequencer seqr{16, 16};
+    seqr.setPPQN(ppqn);
+    ppqn = seqr.getPPQN();
     SequencerEditor seqEditor{&seqr};
+    // edits from the key loop are applied by the clock thread
+    seqr.setEditQueueEnabled(true);
     SimpleClock clock{};
+    clock.setRealTime(realTime);
+    clock.setSpinMode(spinClock);
     // this will map joystick x,y to 16 sequences
     //rapidLib::regression network = NeuralNetwork::getMelodyStepsRegressor();
 
-    seqr.setAllCallbacks(
-        [&midiUtils, &clock](std::vector<double>* data){
-          if (data->size() >= 3)
-          {
-            double channel = data->at(Step::channelInd);
-            double offTick = clock.getCurrentTick() + data->at(Step::lengthInd);
-            // make the length quantised by steps
-            double noteVolocity = data->at(Step::velInd);
-            double noteOne = data->at(Step::note1Ind);
-            midiUtils.playSingleNote(channel, noteOne, noteVolocity, offTick);            
-          }
+    seqr.setEventCallback(
+        [&midiUtils, &clock](const StepEvent& event){
+          long offTick = clock.getCurrentTick() + event.length;
+          midiUtils.playSingleNote(event.channel, event.note, event.velocity, offTick);            
         }
     );
 
-    clock.setCallback([&seqr, &seqEditor, &midiUtils, &clock, &wioSerial](){
+    // only the render thread uses these
+    SequencerSnapshot renderSnapshot;
+    TerminalDiffRenderer console{};
+    RenderThread renderer{[&seqr, &seqEditor, wioLink, &renderSnapshot, &console](){
+        seqr.readSnapshot(renderSnapshot);
+        // the key thread moves the editor, so draw from a copy of its cursor
+        std::string output = SequencerViewer::toTextDisplay(9, 13, renderSnapshot, seqEditor.getCursor());
+        if (wioLink != nullptr) wioLink->sendFrame(output);
+        else console.render(output);
+      }, maxFps};
+
+    uint64_t drawnVersion = 0;
+    clock.setCallback([&seqr, &midiUtils, &clock, &renderer, drawnVersion]() mutable {
       midiUtils.sendQueuedMessages(clock.getCurrentTick());
       seqr.tick();
-  
-      if (wioSerial != "")
-      {
-        std::string output = SequencerViewer::toTextDisplay(9, 13, &seqr, &seqEditor);
-        Display::redrawToWio(wioSerial, output);    
-      }
-      else 
-      {
-        std::string output = SequencerViewer::toTextDisplay(9, 13, &seqr, &seqEditor);
-        Display::redrawToConsole(output);
-      }
+      // sends this tick's messages if batching is on
+      midiUtils.flushBatch();
+      // drawing happens on the render thread, just say when there is something new
+      uint64_t version = seqr.getSnapshotVersion();
+      if (version == drawnVersion) return;
+      drawnVersion = version;
+      renderer.requestRedraw();
     });
 
-    clock.start(125);
-    char input {1};
-    
-    while (input != 16) // q for quit
+    EventReactor reactor{};
+    // the key handling draws the lcd from this so it never reads the sequencer mid tick
+    SequencerSnapshot uiSnapshot;
+    auto redrawUI = [&](){
+      seqr.readSnapshot(uiSnapshot);
+      if (useLCD) redrawGroveLCD(uiSnapshot, seqEditor, lcd);
+      renderer.requestRedraw();
+    };
+    auto handleKey = [&](int input){
+      switch(input)
+      {
+          case 15: // tab 
+              seqEditor.cycleEditMode();
+              updateLCDColour(seqEditor, lcd);
+              return;
+          case 57: // space
+              seqEditor.cycleAtCursor();
+              return;
+          case 28: // return
+              seqEditor.enterAtCursor();
+              updateLCDColour(seqEditor, lcd);
+              return;
+          case 103: // up
+              seqEditor.moveCursorUp();
+              return;
+          case 105: // left
+              seqEditor.moveCursorLeft();
+              return;
+          case 106: // right
+              seqEditor.moveCursorRight();
+              return;
+          case 108: // down
+              seqEditor.moveCursorDown();
+              return;     
+      }// end switch on key
+      // now check all the piano keys
+      int key_note = MidiUtils::keyToNote(input);
+      if (key_note >= 0) seqEditor.enterNoteData(key_note);
+    };
+
+    if (useReactor)
     {
-        if (useLCD) redrawGroveLCD(seqr, seqEditor, lcd);
-        if (wioSerial != "")
-        {
-            std::string output = SequencerViewer::toTextDisplay(9, 13, &seqr, &seqEditor);
-            Display::redrawToWio(wioSerial, output);    
-        }
-        else 
+      bool watchingKeys = reactor.addReader(keyReader.getFd(), [&](int fd){
+        int input = keyReader.readKeyUp();
+        if (input < 0) return;
+        if (input == 16) // q for quit
         {
-            std::string output = SequencerViewer::toTextDisplay(9, 13, &seqr, &seqEditor);
-            Display::redrawToConsole(output);
+          reactor.stop();
+          return;
         }
+        handleKey(input);
+        redrawUI();
+      });
+      if (!watchingKeys)
+      {
+        std::cout << "Could not watch the keyboard with the reactor, using the clock thread" << std::endl;
+        useReactor = false;
+      }
+    }
+    // in reactor mode the clock is ticked by the reactor's timer on this thread
+    if (useReactor)
+    {
+      clock.startDriven(SimpleClock::bpmToIntervalNs(120, ppqn));
+      reactor.startTimer(clock.getIntervalNs(), [&clock, &reactor](int64_t deadlineNs){
+        reactor.setTimerIntervalNs(clock.driveTick(deadlineNs));
+      });
+    }
+    else clock.startBPM(120, ppqn);
+
+    ClockRealTimeStatus realTimeStatus{};
+    redrawUI();
+    if (useReactor)
+    {
+      // there is no clock thread, this one does the ticks
+      realTimeStatus = SimpleClock::applyRealTime(realTime);
+      reactor.addReader(dumpSignal.getFd(), [&](int fd){
+        if (dumpSignal.read()) printTimingHistograms(clock, midiUtils, std::cerr);
+      });
+      reactor.run();
+    }
+    else 
+    {
+      std::atomic<bool> quitting{false};
+      std::thread dumpThread{[&](){
+        while (dumpSignal.read() && !quitting) printTimingHistograms(clock, midiUtils, std::cerr);
+      }};
+      char input = keyReader.getChar();
+      while (input != 16) // q for quit
+      {
+        handleKey(input);
+        redrawUI();
         input = keyReader.getChar();
-        switch(input)
-        {
-            case 15: // tab 
-                seqEditor.cycleEditMode();
-                updateLCDColour(seqEditor, lcd);
-                continue;
-            case 57: // space
-                seqEditor.cycleAtCursor();
-                continue;
-            case 28: // return
-                seqEditor.enterAtCursor();
-                updateLCDColour(seqEditor, lcd);
-                continue;
-            case 103: // up
-                seqEditor.moveCursorUp();
-                continue;
-            case 105: // left
-                seqEditor.moveCursorLeft();
-                continue;
-            case 106: // right
-                seqEditor.moveCursorRight();
-                continue;
-            case 108: // down
-                seqEditor.moveCursorDown();
-                continue;     
-        }// end switch on key
-        // now check all the piano keys
-        bool key_note_match{false};
-        for (const std::pair<int, double>& key_note : key_to_note)
-        {
-            if (input == key_note.first) 
-            { 
-                key_note_match = true;
-                seqEditor.enterNoteData(key_note.second);
-                break;// break the for loop
-            }
-        }
-    }// end while loop
+      }// end while loop
+      realTimeStatus = clock.getRealTimeStatus();
+      // wakes the dump thread so it can see it is time to go
+      quitting = true;
+      kill(getpid(), SIGUSR1);
+      dumpThread.join();
+    }
+    clock.stop();
+    if (useReactor) reactor.stopTimer();
+    renderer.stop();
+    std::cout << "render frames: " << renderer.getFrameCount() 
+              << " average ms: " << renderer.getAverageFrameNs() / 1000000.0 
+              << " max ms: " << renderer.getMaxFrameNs() / 1000000.0 << std::endl;
+    std::cout << realTimeStatus.toString() << std::endl;
+    std::cout << clock.getTimingReport() << std::endl;
+    printTimingHistograms(clock, midiUtils, std::cout);
+    if (useReactor) std::cout << "reactor wakeups: " << reactor.getWakeupCount() 
+                              << " ticks: " << reactor.getTickCount() 
+                              << " missed: " << reactor.getMissedTicks() << std::endl;
+    delete wioLink;
     midiUtils.allNotesOff();
   return 0;
 }
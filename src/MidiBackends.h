@@ -0,0 +1,411 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include "SimpleClock.h"
+#include "SpscRing.h"
+#include "LatencyHistogram.h"
+
+/**
+ * Somewhere MidiUtils can send raw midi bytes to.
+ * The RtMidi backend that talks to real ports lives in MidiUtils.h,
+ * the ones here need no midi hardware so they can be used for
+ * testing and benchmarking the output path.
+ * sendMessage is called from the clock thread.
+*/
+class MidiOutputBackend
+{
+  public:
+    virtual ~MidiOutputBackend(){}
+    /** send one complete midi message */
+    virtual void sendMessage(const unsigned char* bytes, std::size_t size) = 0;
+    /** send a stream of channel messages that may use running status.
+     * Backends that can only take whole messages get them one at a time,
+     * backends that write bytes to a port should override this and write them in one go.
+     * System exclusive messages are not handled.
+    */
+    virtual void sendBytes(const unsigned char* bytes, std::size_t size)
+    {
+      unsigned char message[3];
+      unsigned char status = 0;
+      std::size_t i = 0;
+      while (i < size)
+      {
+        if (bytes[i] >= 0xF8) // real time messages are one byte and do not change the running status
+        {
+          sendMessage(&bytes[i], 1);
+          ++i;
+          continue;
+        }
+        if (bytes[i] & 0x80) status = bytes[i++];
+        if (status == 0) // data with no status to run on
+        {
+          ++i;
+          continue;
+        }
+        // program change and channel pressure have one data byte
+        std::size_t dataLen = (status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0 ? 1 : 2;
+        if (i + dataLen > size) break;
+        message[0] = status;
+        for (std::size_t d = 0; d < dataLen; ++d) message[d + 1] = bytes[i + d];
+        sendMessage(message, dataLen + 1);
+        i += dataLen;
+      }
+    }
+    /** send all notes off on all 16 channels. 
+     * Unlike sendMessage, this can be called from a thread other than the clock thread
+    */
+    virtual void sendAllNotesOff()
+    {
+      unsigned char message[3];
+      for (int chan = 0; chan < 16; ++chan)
+      {
+        message[0] = 176 + chan;
+        message[1] = 0x7b; //123
+        message[2] = 0; 
+        sendMessage(message, 3);
+      }
+    }
+};
+
+/** throws messages away, counting them */
+class NullMidiBackend : public MidiOutputBackend
+{
+  public:
+    NullMidiBackend() : messageCount{0}, byteCount{0} {}
+    void sendMessage(const unsigned char* bytes, std::size_t size) override
+    {
+      messageCount ++;
+      byteCount += size;
+    }
+    long getMessageCount() const { return messageCount; }
+    long getByteCount() const { return byteCount; }
+    void resetCounts()
+    {
+      messageCount = 0;
+      byteCount = 0;
+    }
+  private:
+    std::atomic<long> messageCount;
+    std::atomic<long> byteCount;
+};
+
+/** writes messages to a binary capture file. Each message is stored as
+ * an int64 monotonic send time in nanoseconds (host byte order),
+ * one byte giving the message size, then the message bytes
+*/
+class FileMidiBackend : public MidiOutputBackend
+{
+  public:
+    FileMidiBackend(const std::string& filename)
+    {
+      file.open(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+      if (!file.is_open())
+      {
+        std::cout << "FileMidiBackend::FileMidiBackend could not open " << filename << std::endl;
+      }
+    }
+    void sendMessage(const unsigned char* bytes, std::size_t size) override
+    {
+      if (!file.is_open()) return;
+      int64_t nowNs = SimpleClock::getNowNs();
+      unsigned char len = size > 255 ? 255 : size;
+      file.write(reinterpret_cast<const char*>(&nowNs), sizeof(nowNs));
+      file.write(reinterpret_cast<const char*>(&len), 1);
+      file.write(reinterpret_cast<const char*>(bytes), len);
+    }
+    bool isOpen() const { return file.is_open(); }
+    /** push buffered messages out to the file */
+    void flush() { file.flush(); }
+  private:
+    std::ofstream file;
+};
+
+/** a message as seen by the loopback backend */
+struct LoopbackMidiMessage{
+  int64_t sendNs;
+  unsigned char size;
+  unsigned char bytes[3];
+};
+
+/** keeps every message in memory along with the monotonic time it was sent,
+ * so tests can check what went out and when. Messages longer than 3 bytes
+ * keep their first 3 bytes. Read the messages when nothing is sending.
+*/
+class LoopbackMidiBackend : public MidiOutputBackend
+{
+  public:
+    /** capacity messages are allocated up front so recording does not allocate */
+    LoopbackMidiBackend(std::size_t capacity = 4096)
+    {
+      messages.reserve(capacity);
+    }
+    void sendMessage(const unsigned char* bytes, std::size_t size) override
+    {
+      LoopbackMidiMessage msg{SimpleClock::getNowNs(), (unsigned char) size, {0, 0, 0}};
+      for (std::size_t i = 0; i < size && i < 3; ++i) msg.bytes[i] = bytes[i];
+      messages.push_back(msg);
+    }
+    const std::vector<LoopbackMidiMessage>& getMessages() const
+    {
+      return messages;
+    }
+    void clear()
+    {
+      messages.clear();
+    }
+  private:
+    std::vector<LoopbackMidiMessage> messages;
+};
+
+/** writes bytes straight to a raw midi device or serial port,
+ * e.g. /dev/snd/midiC1D0. sendBytes goes out in a single write
+*/
+class RawMidiBackend : public MidiOutputBackend
+{
+  public:
+    RawMidiBackend(const std::string& device) : writeCount{0}
+    {
+      fd = open(device.c_str(), O_WRONLY | O_NOCTTY);
+      if (fd < 0)
+      {
+        std::cout << "RawMidiBackend::RawMidiBackend could not open " << device << std::endl;
+      }
+    }
+    ~RawMidiBackend()
+    {
+      if (fd >= 0) close(fd);
+    }
+    void sendMessage(const unsigned char* bytes, std::size_t size) override
+    {
+      writeBytes(bytes, size);
+    }
+    void sendBytes(const unsigned char* bytes, std::size_t size) override
+    {
+      writeBytes(bytes, size);
+    }
+    bool isOpen() const { return fd >= 0; }
+    /** how many write calls have been made*/
+    long getWriteCount() const { return writeCount; }
+  private:
+    void writeBytes(const unsigned char* bytes, std::size_t size)
+    {
+      if (fd < 0) return;
+      writeCount ++;
+      while (size > 0)
+      {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0)
+        {
+          if (errno == EINTR) continue;
+          return;
+        }
+        bytes += written;
+        size -= written;
+      }
+    }
+    int fd;
+    std::atomic<long> writeCount;
+};
+
+/** a message, or a piece of a batch of bytes, waiting in the ThreadedMidiBackend's ring*/
+struct TimestampedShortMessage{
+  int64_t queuedNs;
+  unsigned char size;
+  /** wholeMessage, or a batchPiece with more to come, or the lastBatchPiece*/
+  unsigned char batchPart;
+  unsigned char bytes[14];
+};
+
+/**
+ * Moves device I/O off the clock thread. sendMessage puts the message
+ * in a wait free single producer/ single consumer ring and returns;
+ * an output thread takes messages off the ring and passes them to the
+ * target backend, so a slow port write cannot delay the next tick.
+ * sendMessage must only be called from one thread (the clock thread).
+ * If the ring is full the message is dropped and counted as an overrun.
+ * Messages longer than 3 bytes are dropped and counted as overruns too.
+ * sendBytes passes a batch through the ring in pieces and the output thread
+ * hands it to the target in one go, so running status and a raw port's
+ * single write survive the hop.
+*/
+class ThreadedMidiBackend : public MidiOutputBackend
+{
+  public:
+    /** target must outlive this backend*/
+    ThreadedMidiBackend(MidiOutputBackend* target, std::size_t capacity = 1024) : 
+      target{target}, ring{capacity}, running{true}, allNotesOffRequested{false}, 
+      outputWaiting{0}, overruns{0}, sentCount{0}, maxDepth{0}, 
+      lastQueueDelayNs{0}, maxQueueDelayNs{0}, batchBuffer(maxBatchBytes), batchLength{0}
+    {
+      outputThread = std::thread(&ThreadedMidiBackend::runOutput, this);
+    }
+    ~ThreadedMidiBackend()
+    {
+      {
+        std::lock_guard<std::mutex> lock{waitMutex};
+        running = false;
+      }
+      wakeOutput.notify_one();
+      outputThread.join();
+    }
+    void sendMessage(const unsigned char* bytes, std::size_t size) override
+    {
+      if (size > 3)
+      {
+        overruns ++;
+        return;
+      }
+      TimestampedShortMessage msg{SimpleClock::getNowNs(), (unsigned char) size, wholeMessage, {}};
+      for (std::size_t i = 0; i < size; ++i) msg.bytes[i] = bytes[i];
+      if (!ring.push(msg))
+      {
+        overruns ++;
+        return;
+      }
+      queued();
+    }
+    /** queue a batch of bytes, e.g. MidiUtils' running status batches, for the output
+     * thread to pass to the target's sendBytes in one call. 
+     * A batch is queued whole or not at all: if the ring has no room for it,
+     * or it is over maxBatchBytes, it is dropped and counted as one overrun
+    */
+    void sendBytes(const unsigned char* bytes, std::size_t size) override
+    {
+      if (size == 0) return;
+      std::size_t pieces = (size + pieceBytes - 1) / pieceBytes;
+      // size is never under the true count on this side, so the room is never over counted
+      if (size > maxBatchBytes || pieces > ring.capacity() - ring.size())
+      {
+        overruns ++;
+        return;
+      }
+      int64_t nowNs = SimpleClock::getNowNs();
+      for (std::size_t piece = 0; piece < pieces; ++piece)
+      {
+        std::size_t offset = piece * pieceBytes;
+        TimestampedShortMessage msg{nowNs, 0, piece + 1 == pieces ? lastBatchPiece : batchPiece, {}};
+        msg.size = (unsigned char) std::min(pieceBytes, size - offset);
+        std::memcpy(msg.bytes, bytes + offset, msg.size);
+        ring.push(msg);
+      }
+      queued();
+    }
+    /** biggest batch sendBytes takes*/
+    constexpr static std::size_t maxBatchBytes{4096};
+    /** the output thread sends the all notes offs after whatever is already in the ring*/
+    void sendAllNotesOff() override
+    {
+      {
+        std::lock_guard<std::mutex> lock{waitMutex};
+        allNotesOffRequested = true;
+      }
+      wakeOutput.notify_one();
+    }
+    /** messages waiting in the ring right now*/
+    std::size_t getQueueDepth() const { return ring.size(); }
+    /** most messages there have been in the ring at once*/
+    std::size_t getMaxQueueDepth() const { return maxDepth; }
+    /** messages dropped because the ring was full*/
+    long getOverruns() const { return overruns; }
+    /** messages, and whole batches, the output thread has passed to the target*/
+    long getSentCount() const { return sentCount; }
+    /** ns between the most recent message being queued and it being passed to the target */
+    int64_t getLastQueueDelayNs() const { return lastQueueDelayNs; }
+    int64_t getMaxQueueDelayNs() const { return maxQueueDelayNs; }
+    /** how long each message took the target to send, i.e. the port write*/
+    const LatencyHistogram& getSendHistogram() const { return sendHistogram; }
+    /** ns from each message being queued to it having been sent*/
+    const LatencyHistogram& getQueueDelayHistogram() const { return queueDelayHistogram; }
+    
+  private:
+    constexpr static unsigned char wholeMessage{0};
+    constexpr static unsigned char batchPiece{1};
+    constexpr static unsigned char lastBatchPiece{2};
+    constexpr static std::size_t pieceBytes{sizeof(TimestampedShortMessage::bytes)};
+    /** keep the depth stat and wake the output thread for what was just pushed*/
+    void queued()
+    {
+      std::size_t depth = ring.size();
+      if (depth > maxDepth) maxDepth = depth;
+      // a read-modify-write, as is the output thread's when it goes to wait, so
+      // one comes after the other: either the output thread sees this message 
+      // before it waits or this sees it waiting and wakes it. The lock and 
+      // the syscall are only paid when it is asleep
+      if (outputWaiting.fetch_or(0, std::memory_order_acq_rel) != 0)
+      {
+        std::lock_guard<std::mutex> lock{waitMutex};
+        wakeOutput.notify_one();
+      }
+    }
+    void runOutput()
+    {
+      TimestampedShortMessage msg;
+      while (true)
+      {
+        while (ring.pop(msg))
+        {
+          if (msg.batchPart != wholeMessage)
+          {
+            // sendBytes made sure the whole batch fits
+            std::memcpy(&batchBuffer[batchLength], msg.bytes, msg.size);
+            batchLength += msg.size;
+            if (msg.batchPart == batchPiece) continue;
+          }
+          int64_t delayNs = SimpleClock::getNowNs() - msg.queuedNs;
+          lastQueueDelayNs = delayNs;
+          if (delayNs > maxQueueDelayNs) maxQueueDelayNs = delayNs;
+          int64_t sendStartNs = SimpleClock::getNowNs();
+          if (msg.batchPart == wholeMessage) target->sendMessage(msg.bytes, msg.size);
+          else 
+          {
+            target->sendBytes(batchBuffer.data(), batchLength);
+            batchLength = 0;
+          }
+          int64_t doneNs = SimpleClock::getNowNs();
+          sendHistogram.record(doneNs - sendStartNs);
+          queueDelayHistogram.record(doneNs - msg.queuedNs);
+          sentCount ++;
+        }
+        if (allNotesOffRequested.exchange(false)) target->sendAllNotesOff();
+        // only stop once everything queued has gone out
+        if (!running) break;
+        std::unique_lock<std::mutex> lock{waitMutex};
+        // see sendMessage for why this is an exchange
+        outputWaiting.exchange(1, std::memory_order_acq_rel);
+        wakeOutput.wait(lock, [this]{ 
+          return !ring.empty() || allNotesOffRequested || !running; 
+        });
+        outputWaiting.store(0, std::memory_order_relaxed);
+      }
+    }
+    MidiOutputBackend* target;
+    SpscRing<TimestampedShortMessage> ring;
+    std::thread outputThread;
+    std::mutex waitMutex;
+    std::condition_variable wakeOutput;
+    std::atomic<bool> running;
+    std::atomic<bool> allNotesOffRequested;
+    std::atomic<unsigned int> outputWaiting;
+    std::atomic<long> overruns;
+    std::atomic<long> sentCount;
+    std::atomic<std::size_t> maxDepth;
+    std::atomic<int64_t> lastQueueDelayNs;
+    std::atomic<int64_t> maxQueueDelayNs;
+    LatencyHistogram sendHistogram;
+    LatencyHistogram queueDelayHistogram;
+    /** the batch being put back together, output thread only*/
+    std::vector<unsigned char> batchBuffer;
+    std::size_t batchLength;
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <vector>
+
+/** a channel message that fits in 3 bytes, e.g. note on/ off */
+struct ShortMidiMessage{
+    unsigned char bytes[3];
+};
+
+/**
+ * Holds midi messages tagged with the tick they are due on.
+ * Messages go into a timing wheel: one slot per tick, wrapping
+ * around every wheelSize ticks, with the messages themselves
+ * stored in a node pool allocated up front.
+ * Adding and draining a tick are O(1) and do not allocate.
+ * Messages due further ahead than the wheel covers, or that
+ * arrive when the pool is full, wait in an overflow bucket
+ * until they come into range.
+ * drainMessages should be called once per tick with
+ * increasing ticks; it is not thread safe.
+*/
+class MidiQueue
+{
+    public:
+        /** wheelSize is rounded up to a power of 2.
+         * capacity is how many messages can be queued in the wheel
+        */
+        MidiQueue(unsigned int wheelSize = 4096, unsigned int capacity = 2048)
+        {
+            unsigned int size = 1;
+            while (size < wheelSize) size <<= 1;
+            wheelMask = size - 1;
+            slotHeads.resize(size);
+            slotTails.resize(size);
+            nodes.resize(capacity);
+            overflow.reserve(capacity / 4);
+            overflowScratch.reserve(capacity / 4);
+            clearAllMessages();
+        }
+        /** q a message at the specified time point. 
+         * The tag is handed back with the message by drainTaggedMessages
+        */
+        void addMessage(long timestamp, const ShortMidiMessage& msg, unsigned int tag = 0)
+        {
+            // the slot for lastDrained has already been emptied
+            // so anything due by then goes out on the next drain
+            long slotTick = timestamp > lastDrained ? timestamp : lastDrained + 1;
+            if (slotTick - lastDrained > (long) wheelMask || freeHead == noNode)
+            {
+                overflow.push_back(TimestampedMessage{timestamp, msg, tag});
+                if (overflow.size() == 1 || timestamp < overflowEarliest) overflowEarliest = timestamp;
+                return;
+            }
+            int node = freeHead;
+            freeHead = nodes[node].next;
+            nodes[node].msg = msg;
+            nodes[node].tag = tag;
+            nodes[node].next = noNode;
+            // append so messages come out in the order they went in
+            unsigned int slot = slotTick & wheelMask;
+            if (slotTails[slot] == noNode) slotHeads[slot] = node;
+            else nodes[slotTails[slot]].next = node;
+            slotTails[slot] = node;
+            ++queuedCount;
+        }
+        /** q a 3 byte message at the specified time point*/
+        void addMessage(long timestamp, unsigned char status, unsigned char data1, unsigned char data2, unsigned int tag = 0)
+        {
+            addMessage(timestamp, ShortMidiMessage{{status, data1, data2}}, tag);
+        }
+        /** pass each message due at or before the sent tick to send(const ShortMidiMessage&)
+         * and remove it from the q
+        */
+        template<typename SendFunc>
+        void drainMessages(long timestamp, SendFunc&& send)
+        {
+            drainTaggedMessages(timestamp, [&send](const ShortMidiMessage& msg, unsigned int tag){
+                send(msg);
+            });
+        }
+        /** as drainMessages but calls send(const ShortMidiMessage&, unsigned int tag)*/
+        template<typename SendFunc>
+        void drainTaggedMessages(long timestamp, SendFunc&& send)
+        {
+            lastDrained = timestamp;
+            if (!overflow.empty() && overflowEarliest - timestamp <= (long) wheelMask)
+            {
+                drainOverflow(timestamp, send);
+            }
+            unsigned int slot = timestamp & wheelMask;
+            int node = slotHeads[slot];
+            slotHeads[slot] = noNode;
+            slotTails[slot] = noNode;
+            while (node != noNode)
+            {
+                int next = nodes[node].next;
+                send(nodes[node].msg, nodes[node].tag);
+                nodes[node].next = freeHead;
+                freeHead = node;
+                --queuedCount;
+                node = next;
+            }
+        }
+        /** removes all the messages form the q*/
+        void clearAllMessages()
+        {
+            for (unsigned int i = 0; i < slotHeads.size(); ++i)
+            {
+                slotHeads[i] = noNode;
+                slotTails[i] = noNode;
+            }
+            // chain all the nodes into the free list
+            for (unsigned int i = 0; i < nodes.size(); ++i)
+            {
+                nodes[i].next = i + 1 < nodes.size() ? i + 1 : noNode;
+            }
+            freeHead = nodes.empty() ? noNode : 0;
+            overflow.clear();
+            queuedCount = 0;
+        }
+        /** how many messages are waiting, including the overflow bucket*/
+        unsigned int size() const
+        {
+            return queuedCount + overflow.size();
+        }
+        /** how many messages are waiting in the overflow bucket*/
+        unsigned int overflowSize() const
+        {
+            return overflow.size();
+        }
+
+    private:
+        /** a slot only ever holds messages for one tick, 
+         * so nodes do not need their timestamp*/
+        struct Node{
+            ShortMidiMessage msg;
+            unsigned int tag;
+            int next;
+        };
+        struct TimestampedMessage{
+            long timestamp;
+            ShortMidiMessage msg;
+            unsigned int tag;
+        };
+        const static int noNode{-1};
+
+        /** move overflow messages that are now in range into the wheel,
+         * sending the ones that are due straight away.
+         * Only runs when the earliest overflow message comes into range
+        */
+        template<typename SendFunc>
+        void drainOverflow(long timestamp, SendFunc& send)
+        {
+            // swap with a spare vector so neither loses its capacity
+            overflow.swap(overflowScratch);
+            for (const TimestampedMessage& item : overflowScratch)
+            {
+                if (item.timestamp <= timestamp) send(item.msg, item.tag);
+                else addMessage(item.timestamp, item.msg, item.tag);
+            }
+            overflowScratch.clear();
+        }
+
+        std::vector<int> slotHeads;
+        std::vector<int> slotTails;
+        std::vector<Node> nodes;
+        std::vector<TimestampedMessage> overflow;
+        std::vector<TimestampedMessage> overflowScratch;
+        long overflowEarliest{0};
+        unsigned int wheelMask;
+        int freeHead{noNode};
+        long lastDrained{0};
+        unsigned int queuedCount{0};
+};
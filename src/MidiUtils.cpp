@@ -1,85 +1,77 @@
 #include "MidiUtils.h"
 
-MidiQueue::MidiQueue()
-{
+//////////////////////
+// start of RtMidiBackend
+//////////////////////
 
-}
-void MidiQueue::addMessage(const long timestamp, const MidiMessage& msg)
+RtMidiBackend::RtMidiBackend() : midiout{nullptr}, outMessage(3)
 {
-   // iterate over the list and insert the event 
-    // at a point where the ts ==  or < 
-    bool done = false;
-    for ( TimeStampedMessages& item : messageList)
-    {
-        if (item.timestamp == timestamp)
-        {
-            item.messages.push_back(msg);// now we pass by value
-            done = true;
-            break;
-        } 
-    }
-    if (!done)
-    {
-       // std::cout << "EventQueue::addEvent no timestapm match for " << timestamp << std::endl;        
-        TimeStampedMessages item {timestamp, MidiMessageVector{msg}};
-        messageList.push_back(item);
+    try {
+        midiout = new RtMidiOut();
     }
+    catch ( RtMidiError &error ) {
+        std::cout << "MidiStepDataReceiver::initMidi problem creating RTNidiOut. Error message: " << error.getMessage() << std::endl; 
+    }  
 }
-MidiMessageVector MidiQueue::getAndClearMessages(long timestamp)
+
+RtMidiBackend::~RtMidiBackend()
 {
-    MidiMessageVector retMessages{};
-    std::list<TimeStampedMessages>::iterator it = messageList.begin();
-    while(it!=messageList.end())
-    //for (it=messageList.begin(); it!=messageList.end(); ++it)
-    {            
-        //TimestampedCallbacks item = *it;
-        if (it->timestamp == timestamp)
-        //if (it->timestamp == timestamp) 
-        {
-            // trigger all the callbacks 
-            for (MidiMessage& msg : it->messages)
-            {
-                retMessages.push_back(msg);            
-            }
-            // erase it
-            it = messageList.erase(it);
-           // break;
-        }
-        else ++it;
-    }
-    return retMessages;
+    delete midiout;
 }
 
-void MidiQueue::clearAllMessages()
+void RtMidiBackend::sendMessage(const unsigned char* bytes, std::size_t size)
 {
-    messageList.clear();
+    if (!midiout) return;
+    outMessage.assign(bytes, bytes + size);
+    midiout->sendMessage( &outMessage );
 }
 
-//////////////////////
-// end of MidiQueue
-//////////////////////
+RtMidiOut* RtMidiBackend::getRtMidiOut()
+{
+    return midiout;
+}
 
 //////////////////////
 // start of MidiUtils
 //////////////////////
 
-MidiUtils::MidiUtils() : panicMode{false}
+MidiUtils::MidiUtils() : panicMode{false}, 
+    allNotesOffRequested{false}, staleNoteOffs{0},
+    batchMode{false}, batchOffCount{0}, batchOnCount{0}, batchBytesSaved{0}
+{
+    RtMidiBackend* rtMidi = new RtMidiBackend();
+    ownedBackend = rtMidi;
+    // keep port writes off the clock thread
+    outputStage = new ThreadedMidiBackend(ownedBackend);
+    backend = outputStage;
+    midiout = rtMidi->getRtMidiOut();
+}
+
+MidiUtils::MidiUtils(MidiOutputBackend* backend) : midiout{nullptr}, panicMode{false}, backend{backend}, ownedBackend{nullptr}, outputStage{nullptr}, 
+    allNotesOffRequested{false}, staleNoteOffs{0},
+    batchMode{false}, batchOffCount{0}, batchOnCount{0}, batchBytesSaved{0}
 {
-    try {
-        midiout = new RtMidiOut();
-    }
-    catch ( RtMidiError &error ) {
-        std::cout << "MidiStepDataReceiver::initMidi problem creating RTNidiOut. Error message: " << error.getMessage() << std::endl; 
-    }  
 }
 
 MidiUtils::~MidiUtils()
 {
-    delete midiout;
+    // stops the output thread before the port goes away
+    delete outputStage;
+    delete ownedBackend;
+}
+
+ThreadedMidiBackend* MidiUtils::getOutputStage()
+{
+    return outputStage;
 }
 
 void MidiUtils::interactiveInitMidi()
 {
+    if (!midiout)
+    {
+        std::cout << "MidiUtils::interactiveInitMidi not using an RtMidi port" << std::endl;
+        return;
+    }
 
     std::string portName;
     unsigned int i = 0, nPorts = midiout->getPortCount();
@@ -111,6 +103,7 @@ void MidiUtils::interactiveInitMidi()
 std::vector<std::string> MidiUtils::getOutputDeviceList()    
 {
     std::vector<std::string> deviceList;
+    if (!midiout) return deviceList;
 
     std::string portName;
     unsigned int i = 0, nPorts = midiout->getPortCount();
@@ -122,27 +115,67 @@ std::vector<std::string> MidiUtils::getOutputDeviceList()
 
 void MidiUtils::selectOutputDevice(int deviceId)
 {
+    if (!midiout) return;
     midiout->openPort( deviceId );
 }
 
+bool MidiUtils::openRawDevice(const std::string& device)
+{
+    if (!outputStage) return false;
+    RawMidiBackend* raw = new RawMidiBackend(device);
+    if (!raw->isOpen())
+    {
+        delete raw;
+        return false;
+    }
+    // stops the output thread before the old port goes away
+    delete outputStage;
+    delete ownedBackend;
+    midiout = nullptr;
+    ownedBackend = raw;
+    outputStage = new ThreadedMidiBackend(ownedBackend);
+    backend = outputStage;
+    return true;
+}
+
 void MidiUtils::allNotesOff()  
 {
     panicMode = true; // don't allow any new messages to go
     // clear the queue: 
     midiQ.clearAllMessages();
+    // drop any note ons waiting to go, keep the note offs
+    batchOnCount = 0;
     //std::cout << "MidiUtils:: All notes off " << std::endl;
-    // send 16 all notes off messages
-    std::vector<unsigned char> message = {0, 0, 0}; // 0x7b = 123, 0
-    for (int chan = 0; chan < 16; ++chan)
-    {
-        message[0] = 176 + chan;
-        message[1] = 0x7b; //123
-        message[2] = 0; 
-        midiout->sendMessage( &message );
-    }
+    // only the notes that are sounding need a note off
+    activeNotes.forEachActive([this](int channel, int note){
+        sendOrBatch(ShortMidiMessage{{(unsigned char) (128 + channel), (unsigned char) note, 0}});
+    });
+    activeNotes.clear();
+    // the clock is usually stopped for a panic, so nothing else would send the batch
+    flushBatch();
     panicMode = false;
 }
 
+void MidiUtils::requestAllNotesOff()
+{
+    allNotesOffRequested = true;
+}
+
+void MidiUtils::resetAllChannels()
+{
+    backend->sendAllNotesOff();
+}
+
+int MidiUtils::getActiveNoteCount() const
+{
+    return activeNotes.getActiveCount();
+}
+
+long MidiUtils::getStaleNoteOffCount() const
+{
+    return staleNoteOffs;
+}
+
 
 void MidiUtils::playSingleNote(int channel, int note, int velocity, long offTick) 
 {
@@ -150,32 +183,112 @@ void MidiUtils::playSingleNote(int channel, int note, int velocity, long offTick
     if (panicMode) return;
 
     //std::cout << "MidiStepDataReceiver:: playSingleNote "<< std::endl;
-    std::vector<unsigned char> message = {0, 0, 0};
-
+    unsigned char message[3];
     message[0] = 144 + channel; // 128 + channel
     message[1] = note; // note value
     message[2] = velocity; // velocity value
     // std::cout << "playSingleNote " << message[1] << "off "<< offTick << std::endl;
 
-    midiout->sendMessage( &message );
-    queueNoteOff(channel, note, offTick);
+    sendOrBatch(ShortMidiMessage{{message[0], message[1], message[2]}});
+    // a retrigger moves the note on to a new generation, 
+    // which makes the note off queued for the earlier trigger stale
+    uint16_t generation = activeNotes.noteOn(channel, note);
+    queueNoteOff(channel, note, offTick, generation);
 }
 
 void MidiUtils::sendQueuedMessages(long tick)  
 {
-    int msgind = 0;
-    for (MidiMessage& msg : midiQ.getAndClearMessages(tick))
+    if (allNotesOffRequested.exchange(false)) allNotesOff();
+    midiQ.drainTaggedMessages(tick, [this](const ShortMidiMessage& msg, unsigned int generation){
+        if ((msg.bytes[0] & 0xF0) == 0x80 && 
+            !activeNotes.noteOff(msg.bytes[0] & 0x0F, msg.bytes[1], generation))
+        {
+            staleNoteOffs ++;
+            return;
+        }
+        sendOrBatch(msg);
+    });
+}
+
+void MidiUtils::sendOrBatch(const ShortMidiMessage& msg)
+{
+    if (batchMode) addToBatch(msg);
+    else backend->sendMessage(msg.bytes, 3);
+}
+
+void MidiUtils::setBatchMode(bool batch)
+{
+    if (!batch) flushBatch();
+    batchMode = batch;
+}
+
+bool MidiUtils::getBatchMode() const
+{
+    return batchMode;
+}
+
+void MidiUtils::addToBatch(const ShortMidiMessage& msg)
+{
+    if (batchOffCount == maxBatchMessages || batchOnCount == maxBatchMessages) flushBatch();
+    // note on with velocity 0 is a note off too
+    bool noteOff = (msg.bytes[0] & 0xF0) == 0x80 || ((msg.bytes[0] & 0xF0) == 0x90 && msg.bytes[2] == 0);
+    if (noteOff) batchOffs[batchOffCount++] = msg;
+    else batchOns[batchOnCount++] = msg;
+}
+
+/** stable sort on the status byte so messages that share 
+ * a status are next to each other. Batches are small so insertion sort*/
+static void sortByStatus(ShortMidiMessage* msgs, int count)
+{
+    for (int i = 1; i < count; ++i)
+    {
+        ShortMidiMessage msg = msgs[i];
+        int j = i - 1;
+        while (j >= 0 && msgs[j].bytes[0] > msg.bytes[0])
+        {
+            msgs[j + 1] = msgs[j];
+            --j;
+        }
+        msgs[j + 1] = msg;
+    }
+}
+
+void MidiUtils::flushBatch()
+{
+    if (batchOffCount + batchOnCount == 0) return;
+    sortByStatus(batchOffs, batchOffCount);
+    sortByStatus(batchOns, batchOnCount);
+    std::size_t len = 0;
+    unsigned char status = 0;
+    ShortMidiMessage* lists[2] = {batchOffs, batchOns};
+    int counts[2] = {batchOffCount, batchOnCount};
+    for (int l = 0; l < 2; ++l)
     {
-    midiout->sendMessage(&msg);
-    msgind ++;
+        for (int i = 0; i < counts[l]; ++i)
+        {
+            const ShortMidiMessage& msg = lists[l][i];
+            // running status: leave out the status byte if it is the same as the last one
+            if (msg.bytes[0] != status)
+            {
+                status = msg.bytes[0];
+                batchBytes[len++] = status;
+            }
+            else batchBytesSaved ++;
+            batchBytes[len++] = msg.bytes[1];
+            batchBytes[len++] = msg.bytes[2];
+        }
     }
+    batchOffCount = 0;
+    batchOnCount = 0;
+    backend->sendBytes(batchBytes, len);
+}
+
+long MidiUtils::getBatchBytesSaved() const
+{
+    return batchBytesSaved;
 }
 
-void MidiUtils::queueNoteOff(int channel, int note, long offTick)    
+void MidiUtils::queueNoteOff(int channel, int note, long offTick, uint16_t generation)    
 {
-    std::vector<unsigned char> message = {0, 0, 0};
-    message[0] = 128 + channel;
-    message[1] = note;
-    message[2] = 0;
-    midiQ.addMessage(offTick, message);
+    midiQ.addMessage(offTick, 128 + channel, note, 0, generation);
 }
\ No newline at end of file
@@ -2,33 +2,42 @@
 
 #include <map>
 #include <list>
+#include <array>
 #include "/usr/include/rtmidi/RtMidi.h"
 #include <thread>         // std::this_thread::sleep_for
 #include <chrono>         // std::chrono::seconds
+#include "MidiQueue.h"
+#include "MidiBackends.h"
+#include "ActiveNotes.h"
  
 
 typedef std::vector<unsigned char> MidiMessage;
-typedef std::vector<MidiMessage> MidiMessageVector;
 
-struct TimeStampedMessages{
-    long timestamp;
-    MidiMessageVector messages;
-};
-/** 
- * Maintains a linked list of midi messages tagged with timestamps
-*/
-class MidiQueue
+/** a table indexed by char giving each key's position in keys, or -1,
+ * built at compile time for MidiUtils' lookups
+ */
+template<std::size_t N>
+constexpr std::array<signed char, 256> makeCharIndexTable(const std::array<char, N>& keys)
+{
+  std::array<signed char, 256> table{};
+  for (std::size_t i = 0; i < table.size(); ++i) table[i] = -1;
+  for (std::size_t i = 0; i < N; ++i) table[(unsigned char) keys[i]] = (signed char) i;
+  return table;
+}
+
+/** sends to a real midi port via RtMidi */
+class RtMidiBackend : public MidiOutputBackend
 {
-    public:
-        MidiQueue();
-        /** q a message at the specified time point*/
-        void addMessage(const long timestamp, const MidiMessage& msg);
-        /** get all q's messages for the specified time point and remove them from the linked likst */
-        MidiMessageVector getAndClearMessages(long timestamp);
-        /** removes all the messages form the q*/
-        void clearAllMessages();
-    private:    
-        std::list<TimeStampedMessages> messageList;
+  public:
+    RtMidiBackend();
+    ~RtMidiBackend();
+    void sendMessage(const unsigned char* bytes, std::size_t size) override;
+    /** the RtMidi port, nullptr if RtMidi could not be set up*/
+    RtMidiOut* getRtMidiOut();
+  private:
+    RtMidiOut *midiout;
+    /** reused for every send so sending does not allocate */
+    MidiMessage outMessage;
 };
 
 /**
@@ -37,122 +46,109 @@ class MidiQueue
 class MidiUtils 
 {
   public:
+    /** sends to midi ports via RtMidi, from a separate output thread */
     MidiUtils();
+    /** sends to the sent backend, which must outlive this MidiUtils */
+    MidiUtils(MidiOutputBackend* backend);
     ~MidiUtils();
-  /** stores the midi out port */
+  /** stores the midi out port, nullptr when not using RtMidi */
   RtMidiOut *midiout;
 
 
+/** one character note names for midi notes modded on 12,
+ * noteNames[0] == 'c' as c is note 0/12/24 etc.
+ */
+  static constexpr std::array<char, 12> noteNames{'c', 'C', 'd', 'D', 'e', 'f', 'F', 'g', 'G', 'a', 'A', 'b'};
+/** one character drum names for midi notes modded on 12, e.g. 0->B for bassdrum */
+  static constexpr std::array<char, 12> drumNames{'B', 's', 'S', 'r', 'H', 'h', 't', 'T', 'c', 'R', 'C', 'p'};
+/** the general midi drum note for each note of the scale starting at drumScaleStart,
+ * remapped to get the most useful drums. drumNames[i] names drumScaleNotes[i]
+ */
+  static constexpr int drumScaleStart{48};
+  static constexpr std::array<int, 12> drumScaleNotes{36, 38, 40, 37, 42, 46, 50, 45, 39, 51, 57, 75};
+/** the computer keyboard keys that play the scale starting at keyboardStart, 
+ * like a piano: z is c, s is c#, x is d and so on
+ */
+  static constexpr int keyboardStart{48};
+  static constexpr std::array<char, 12> keyboardKeys{'z', 's', 'x', 'd', 'c', 'v', 'g', 'b', 'h', 'n', 'j', 'm'};
+/** position of each char in drumNames and keyboardKeys, -1 if it is not there */
+  static constexpr std::array<signed char, 256> drumNameIndex{makeCharIndexTable(drumNames)};
+  static constexpr std::array<signed char, 256> keyboardKeyIndex{makeCharIndexTable(keyboardKeys)};
+
+  /** note name for any midi note, including negative ones*/
+  static constexpr char getNoteName(int note)
+  {
+    return noteNames[((note % 12) + 12) % 12];
+  }
+  /** drum name for any midi note, including negative ones*/
+  static constexpr char getDrumName(int note)
+  {
+    return drumNames[((note % 12) + 12) % 12];
+  }
+  /** general midi drum note for a note in the drum scale, 0 if it is outside the scale */
+  static constexpr int scaleToDrumNote(int note)
+  {
+    return note >= drumScaleStart && note < drumScaleStart + 12 ? drumScaleNotes[note - drumScaleStart] : 0;
+  }
+  /** general midi note for a drum name, e.g. B(bass drum) -> 36, 0 if it is not a drum name */
+  static constexpr int drumNameToNote(char name)
+  {
+    return drumNameIndex[(unsigned char) name] < 0 ? 0 : drumScaleNotes[drumNameIndex[(unsigned char) name]];
+  }
+  /** the note a computer keyboard key plays, -1 if the key is not a note */
+  static constexpr int keyToNote(char key, int transpose = 0)
+  {
+    return keyboardKeyIndex[(unsigned char) key] < 0 ? -1 : keyboardStart + transpose + keyboardKeyIndex[(unsigned char) key];
+  }
+
 /** maps from integer values, i.e. midi notes modded on 12 
      * to note names, getIntToDrumMap()[0] == 'c' as c is note 0/12/24 etc.
+     * Prefer noteNames or getNoteName, which do not build a map
     */
     static std::map<int,char> getIntToNoteMap()
     {
-    std::map<int, char> intToNote = 
-      {
-        {0, 'c'}, 
-        {1, 'C'},
-        {2, 'd'},
-        {3, 'D'},
-        {4, 'e'},
-        {5, 'f'},
-        {6, 'F'},
-        {7, 'g'},
-        {8, 'G'},
-        {9, 'a'},
-        {10, 'A'},
-        {11, 'b'}    
-      };
+      std::map<int, char> intToNote;
+      for (int i = 0; i < 12; ++i) intToNote[i] = noteNames[i];
       return intToNote;
     }
     
     /** maps from integer values, i.e. midi notes modded on 12 or 24 to drum 
      * names, e.g. 0->B for bassdrum. Can be used to display one character drum 
-     * names 
+     * names. Prefer drumNames or getDrumName, which do not build a map
     */
     static std::map<int,char> getIntToDrumMap()
     {
-    std::map<int, char> intToDrum = 
-      {
-        {0, 'B'}, 
-        {1, 's'},
-        {2, 'S'},
-        {3, 'r'},
-        {4, 'H'},
-        {5, 'h'},
-        {6, 't'},
-        {7, 'T'},
-        {8, 'c'},
-        {9, 'R'},
-        {10, 'C'},
-        {11, 'p'}    
-      };
+      std::map<int, char> intToDrum;
+      for (int i = 0; i < 12; ++i) intToDrum[i] = drumNames[i];
       return intToDrum;
     }
     /**
      * returns a mapping from a scale starting at note 48 ... 59
-     * mapped to midi notes for drums remapped to get the most useful drums 
+     * mapped to midi notes for drums remapped to get the most useful drums.
+     * Prefer scaleToDrumNote, which does not build a map
      */
     static std::map<int,int> getScaleMidiToDrumMidi()
     {
-      std::map<int,int> scaleToDrum = 
-      {
-        {48, 36}, 
-        {49, 38},
-        {50, 40},
-        {51, 37},
-        {52, 42},
-        {53, 46},
-        {54, 50},
-        {55, 45},
-        {56, 39},
-        {57, 51},
-        {58, 57},
-        {59, 75}    
-      };
+      std::map<int,int> scaleToDrum;
+      for (int i = 0; i < 12; ++i) scaleToDrum[drumScaleStart + i] = drumScaleNotes[i];
       return scaleToDrum;
     }
 
     /** maps from drum names (e.g. B, s) to general midi notes 
-     * e.g. B(bass drum) -> 36. 
+     * e.g. B(bass drum) -> 36. Prefer drumNameToNote, which does not build a map
     */
     static std::map<char,int> getDrumToMidiNoteMap()
     {
-     std::map<char,int> drumToInt = 
-      {
-        {'B', 36}, 
-        {'s', 38},
-        {'S', 40},
-        {'r', 37},
-        {'H', 42},
-        {'h', 46},
-        {'t', 50},
-        {'T', 45},
-        {'c', 39},
-        {'R', 51},
-        {'C', 57},
-        {'p', 75}    
-      };
+      std::map<char,int> drumToInt;
+      for (int i = 0; i < 12; ++i) drumToInt[drumNames[i]] = drumScaleNotes[i];
       return drumToInt;
     }
 
+    /** maps from computer keyboard keys to midi notes. Prefer keyToNote, which does not build a map*/
     static std::map<char, double> getKeyboardToMidiNotes(int transpose = 0)
     {
-      std::map<char, double> key_to_note =
-      {
-        { 'z', 48+transpose},
-        { 's', 49+transpose},
-        { 'x', 50+transpose},
-        { 'd', 51+transpose},
-        { 'c', 52+transpose},
-        { 'v', 53+transpose},
-        { 'g', 54+transpose},
-        { 'b', 55+transpose},
-        { 'h', 56+transpose},
-        { 'n', 57+transpose},
-        { 'j', 58+transpose},
-        { 'm', 59+transpose}
-      };
+      std::map<char, double> key_to_note;
+      for (int i = 0; i < 12; ++i) key_to_note[keyboardKeys[i]] = keyboardStart + i + transpose;
       return key_to_note;
     }
     // /** from midi note as stored in the seq to a drum name
@@ -176,8 +172,29 @@ class MidiUtils
    * Should be in the range 0->(number of ports-1) inclusive
   */
   void selectOutputDevice(int deviceId);
-  /** send note off messages on all channels to all notes */
+  /** send to a raw midi device or serial port, e.g. /dev/snd/midiC1D0, instead of an RtMidi port,
+   * still from the output thread. With batch mode on each batch goes out in one write.
+   * Only for the default constructor and before anything is sent.
+   * Returns false, leaving things as they were, if the device cannot be opened
+  */
+  bool openRawDevice(const std::string& device);
+  /** send note offs for the notes that are sounding and clear the queued note offs.
+   * Call it from the clock thread or when the clock is stopped
+  */
   void allNotesOff();
+  /** ask the clock thread to do allNotesOff at the start of the next sendQueuedMessages.
+   * Use this from other threads while the clock is running
+  */
+  void requestAllNotesOff();
+  /** send all notes off (CC 123) on all 16 channels, e.g. to 
+   * silence notes left over from a previous run. Safe from any thread
+  */
+  void resetAllChannels();
+  /** how many notes are sounding right now */
+  int getActiveNoteCount() const;
+  /** how many queued note offs were dropped because their note was retriggered 
+   * after they were queued*/
+  long getStaleNoteOffCount() const;
   
   /** play a note */
   void playSingleNote(int channel, int note, int velocity, long offTick);
@@ -185,11 +202,47 @@ class MidiUtils
    * generally this means note offs.
   */
   void sendQueuedMessages(long tick);
+  /** the output thread stage made by the default constructor, 
+   * for its queue depth and overrun counters. nullptr if a backend was sent in
+  */
+  ThreadedMidiBackend* getOutputStage();
+  /** in batch mode playSingleNote and sendQueuedMessages collect messages 
+   * instead of sending them and flushBatch sends them all in one go:
+   * note offs before note ons, compressed with running status.
+   * Call flushBatch at the end of each tick
+  */
+  void setBatchMode(bool batch);
+  bool getBatchMode() const;
+  /** send everything collected since the last flush. Does nothing when not in batch mode */
+  void flushBatch();
+  /** total bytes running status has saved since construction */
+  long getBatchBytesSaved() const;
 
   private:
     MidiQueue midiQ;
     bool panicMode;
-    void queueNoteOff(int channel, int note, long offTick);
+    MidiOutputBackend* backend;
+    /** the backends made by the default constructor, deleted with this */
+    MidiOutputBackend* ownedBackend;
+    ThreadedMidiBackend* outputStage;
+    void queueNoteOff(int channel, int note, long offTick, uint16_t generation);
+    /** send a message now or put it in the batch*/
+    void sendOrBatch(const ShortMidiMessage& msg);
+    ActiveNoteTable activeNotes;
+    std::atomic<bool> allNotesOffRequested;
+    long staleNoteOffs;
+    /** add a message to the batch, flushing first if it is full*/
+    void addToBatch(const ShortMidiMessage& msg);
+    /** most messages collected before the batch is flushed early*/
+    const static int maxBatchMessages{256};
+    bool batchMode;
+    // note offs and note ons are kept apart so the offs can go first
+    ShortMidiMessage batchOffs[maxBatchMessages];
+    ShortMidiMessage batchOns[maxBatchMessages];
+    int batchOffCount;
+    int batchOnCount;
+    unsigned char batchBytes[maxBatchMessages * 2 * 3];
+    long batchBytesSaved;
 };
 
 
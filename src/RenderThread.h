@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "SimpleClock.h"
+
+/**
+ * Runs a render function on its own thread so slow terminal or
+ * serial writes never hold up the clock thread.
+ * requestRedraw only sets a flag, so any number of requests
+ * between two frames make one frame, and frames are never drawn
+ * more often than the max frame rate.
+ * The time each frame takes to render is kept so it can be reported.
+*/
+class RenderThread
+{
+  public:
+    /** render is called on the render thread and must outlive it (see stop)*/
+    RenderThread(std::function<void()> render, double maxFps = 30) :
+      render{render}, running{true}, redrawRequested{false}, renderWaiting{false},
+      frameCount{0}, coalescedCount{0}, lastFrameNs{0}, maxFrameNs{0}, totalFrameNs{0}
+    {
+      setMaxFps(maxFps);
+      renderThread = std::thread(&RenderThread::runRender, this);
+    }
+    ~RenderThread()
+    {
+      stop();
+    }
+    /** stop the render thread, waiting for a frame in progress to finish*/
+    void stop()
+    {
+      running = false;
+      wakeRender.notify_one();
+      if (renderThread.joinable()) renderThread.join();
+    }
+    /** ask for a frame to be drawn. Safe to call from any thread,
+     * including the clock thread, as it never waits for the render
+    */
+    void requestRedraw()
+    {
+      if (redrawRequested.exchange(true))
+      {
+        // a frame is already waiting to be drawn
+        coalescedCount ++;
+        return;
+      }
+      // notify only costs a syscall when the render thread is asleep
+      if (renderWaiting) wakeRender.notify_one();
+    }
+    /** frames will be at least 1/maxFps seconds apart*/
+    void setMaxFps(double maxFps)
+    {
+      if (maxFps <= 0) maxFps = 1;
+      frameIntervalNs = (int64_t) (1000000000.0 / maxFps);
+    }
+    double getMaxFps() const
+    {
+      return 1000000000.0 / frameIntervalNs;
+    }
+    /** how many frames have been drawn*/
+    long getFrameCount() const { return frameCount; }
+    /** requests that were folded into a frame that was already pending*/
+    long getCoalescedCount() const { return coalescedCount; }
+    /** ns the most recent frame took to render*/
+    int64_t getLastFrameNs() const { return lastFrameNs; }
+    int64_t getMaxFrameNs() const { return maxFrameNs; }
+    int64_t getAverageFrameNs() const
+    {
+      long frames = frameCount;
+      return frames == 0 ? 0 : totalFrameNs / frames;
+    }
+
+  private:
+    void runRender()
+    {
+      int64_t lastFrameStartNs = SimpleClock::getNowNs() - frameIntervalNs;
+      while (running)
+      {
+        {
+          std::unique_lock<std::mutex> lock{waitMutex};
+          renderWaiting = true;
+          // the timeout covers a request made between the flag check
+          // and the wait, since requestRedraw never takes the lock
+          if (!redrawRequested && running)
+            wakeRender.wait_for(lock, std::chrono::nanoseconds(frameIntervalNs));
+          renderWaiting = false;
+        }
+        if (!running) break;
+        if (!redrawRequested) continue;
+        // hold the frame back until the frame interval has passed,
+        // requests that come in meanwhile go into this frame
+        SimpleClock::sleepUntilNs(lastFrameStartNs + frameIntervalNs);
+        if (!running) break;
+        redrawRequested = false;
+        lastFrameStartNs = SimpleClock::getNowNs();
+        render();
+        int64_t frameNs = SimpleClock::getNowNs() - lastFrameStartNs;
+        lastFrameNs = frameNs;
+        if (frameNs > maxFrameNs) maxFrameNs = frameNs;
+        totalFrameNs += frameNs;
+        frameCount ++;
+      }
+    }
+    std::function<void()> render;
+    std::thread renderThread;
+    std::mutex waitMutex;
+    std::condition_variable wakeRender;
+    std::atomic<bool> running;
+    std::atomic<bool> redrawRequested;
+    std::atomic<bool> renderWaiting;
+    std::atomic<int64_t> frameIntervalNs;
+    std::atomic<long> frameCount;
+    std::atomic<long> coalescedCount;
+    std::atomic<int64_t> lastFrameNs;
+    std::atomic<int64_t> maxFrameNs;
+    std::atomic<int64_t> totalFrameNs;
+};
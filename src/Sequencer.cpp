@@ -4,7 +4,11 @@
 #include <functional>
 #include <cmath> // fmod
 #include "Sequencer.h"
+#include "TickPool.h"
 #include <assert.h>     /* assert */
+#include <algorithm> // std::fill
+#include <thread>
+#include <chrono>
 
 Step::Step() : active{true}
 {
@@ -67,50 +71,80 @@ Sequence::Sequence(Sequencer* sequencer,
 : sequencer{sequencer}, currentStep{0}, currentLength{seqLength}, 
   midiChannel{midiChannel}, type{SequenceType::midiNote}, 
   transpose{0}, lengthAdjustment{0}, ticksPerStep{4}, originalTicksPerStep{4}, ticksElapsed{0}, 
-  midiScaleToDrum{MidiUtils::getScaleMidiToDrumMidi()}
-{
+  tickScale{1}, delayedStep{0}, delayedStepTicks{0}, holdEvents{false}
+{
+  triggerData.resize(Step::dataSize);
+  // room for a delayed step and a step on the same tick, and then some
+  heldEvents.reserve(4);
+  stepChannels.resize(seqLength, 0);
+  stepLengths.resize(seqLength, 0);
+  stepVelocities.resize(seqLength, 0);
+  stepNotes.resize(seqLength, 0);
+  stepActive.resize(seqLength, 1);
+  stepOffsets.resize(seqLength, 0);
   for (auto i=0;i<seqLength;i++)
   {
-    Step s;
-    s.setCallback([i](std::vector<double>* data){
+    stepCallbacks.push_back([i](std::vector<double>* data){
       if (data->size() > 0){
         std::cout << "Sequence::Sequence default step callback " << i << " triggered " << std::endl;
       }
     });
-    steps.push_back(s);
   }
 }
 
+unsigned int Sequence::getTicksUntilDue() const
+{
+  // the things tick checks for, soonest first
+  unsigned int due = neverDue;
+  if (delayedStepTicks > 0) due = delayedStepTicks;
+  int ticksPerStepScaled = ticksPerStep * tickScale;
+  int offset = getClampedStepOffset(currentStep, ticksPerStepScaled);
+  if (offset < 0 && ticksElapsed < ticksPerStepScaled + offset && 
+      (unsigned int) (ticksPerStepScaled + offset - ticksElapsed) < due)
+  {
+    due = ticksPerStepScaled + offset - ticksElapsed;
+  }
+  if (ticksElapsed < ticksPerStepScaled && (unsigned int) (ticksPerStepScaled - ticksElapsed) < due)
+  {
+    due = ticksPerStepScaled - ticksElapsed;
+  }
+  return due;
+}
+
+void Sequence::skipIdleTicks(unsigned int ticks)
+{
+  ticksElapsed += ticks;
+  if (delayedStepTicks > 0) delayedStepTicks -= ticks;
+}
+
 /** go to the next step */
 void Sequence::tick()
 {
   ++ticksElapsed;
-
-  if (ticksElapsed == ticksPerStep)
+  // a step with a positive offset from the previous grid point
+  if (delayedStepTicks > 0) 
+  {
+    --delayedStepTicks;
+    if (delayedStepTicks == 0) triggerStep(delayedStep);
+  }
+  int ticksPerStepScaled = ticksPerStep * tickScale;
+  int offset = getClampedStepOffset(currentStep, ticksPerStepScaled);
+  // a step with a negative offset triggers before the grid point
+  if (offset < 0 && ticksElapsed == ticksPerStepScaled + offset)
+  {
+    triggerStep(currentStep);
+  }
+  if (ticksElapsed == ticksPerStepScaled)
     {
       ticksElapsed = 0;
-      switch (type){
-        case SequenceType::midiNote:
-          triggerMidiNoteType();
-          break;
-        case SequenceType::drumMidi:
-          triggerMidiDrumType();
-          break;
-        case SequenceType::transposer:
-          triggerTransposeType();
-          break;
-        case SequenceType::lengthChanger:
-          triggerLengthType();
-          break;
-        case SequenceType::tickChanger:
-          triggerTickType();
-          break;
-        default:
-          std::cout << "Sequnce::tick warning unkown seq type" << std::endl;
-          break;
-    }
+      if (offset == 0) triggerStep(currentStep);
+      if (offset > 0) 
+      {
+        delayedStep = currentStep;
+        delayedStepTicks = offset;
+      }
     currentStep = (++currentStep) % (currentLength + lengthAdjustment);
-    assert(currentStep >= 0 && currentStep < steps.size());
+    assert(currentStep >= 0 && currentStep < stepActive.size());
     if (currentStep == 0)
     {
       // reset transpose at the start of each sequence
@@ -127,39 +161,106 @@ void Sequence::deactivateProcessors()
     ticksElapsed = 0;
 }
 
-void Sequence::triggerMidiNoteType()
+void Sequence::triggerStep(unsigned int step)
+{
+  switch (type){
+    case SequenceType::midiNote:
+      triggerMidiNoteType(step);
+      break;
+    case SequenceType::drumMidi:
+      triggerMidiDrumType(step);
+      break;
+    case SequenceType::transposer:
+      triggerTransposeType(step);
+      break;
+    case SequenceType::lengthChanger:
+      triggerLengthType(step);
+      break;
+    case SequenceType::tickChanger:
+      triggerTickType(step);
+      break;
+    default:
+      std::cout << "Sequnce::tick warning unkown seq type" << std::endl;
+      break;
+  }
+}
+
+int Sequence::getClampedStepOffset(unsigned int step, int ticksPerStepScaled) const
 {
-  // make a local copy
-  Step s = steps[currentStep];
-  // apply changes to local copy if needed      
+  int offset = stepOffsets[step];
+  if (offset <= -ticksPerStepScaled) offset = 1 - ticksPerStepScaled;
+  if (offset >= ticksPerStepScaled) offset = ticksPerStepScaled - 1;
+  return offset;
+}
+
+bool Sequence::makeStepEvent(unsigned int step, StepEvent& event)
+{
+  if (!stepActive[step]) return false;
+  event.channel = stepChannels[step];
+  event.note = stepNotes[step];
+  event.velocity = stepVelocities[step];
+  // lengths are in ticks at 4 PPQN
+  event.length = stepLengths[step] * tickScale;
+  return true;
+}
+
+void Sequence::sendStepEvent(unsigned int step, const StepEvent& event)
+{
+  if (event.note == 0) return; // 0 means no note
+  if (holdEvents)
+  {
+    heldEvents.push_back(std::make_pair(step, event));
+    return;
+  }
+  deliverStepEvent(step, event);
+}
+
+void Sequence::deliverStepEvent(unsigned int step, const StepEvent& event)
+{
+  if (eventCallback)
+  {
+    eventCallback(event);
+    return;
+  }
+  // step callbacks take a vector so fill in one that 
+  // already has the space
+  triggerData[Step::channelInd] = event.channel;
+  triggerData[Step::lengthInd] = event.length;
+  triggerData[Step::velInd] = event.velocity;
+  triggerData[Step::note1Ind] = event.note;
+  if (stepCallbacks[step]) stepCallbacks[step](&triggerData);
+}
+
+void Sequence::triggerMidiNoteType(unsigned int step)
+{
+  StepEvent event;
+  if (!makeStepEvent(step, event)) return;
+  // apply changes to the event if needed      
   if(transpose > 0) 
   {
-    std::vector<double>* data = s.getDataDirect();//  s.getData();
-    if (data->at(Step::note1Ind) > 0 ) // only transpose non-zero steps
+    if (event.note > 0 ) // only transpose non-zero steps
     {
-      data->at(Step::note1Ind) = fmod(data->at(Step::note1Ind) + transpose, 127);
+      event.note = fmod(event.note + transpose, 127);
     }
   }
-  // trigger the local, adjusted copy of the step
-  s.trigger();
+  sendStepEvent(step, event);
 }
 
-void Sequence::triggerMidiDrumType()
+void Sequence::triggerMidiDrumType(unsigned int step)
 {
-  // make a local copy
-  Step s = steps[currentStep];
-  // transpose the midi note into the drum domain
-  std::vector<double>* data = s.getDataDirect();//  s.getData();
-  data->at(Step::note1Ind) = midiScaleToDrum[(int) data->at(Step::note1Ind)];
-  // apply changes to local copy if needed      
+  StepEvent event;
+  if (!makeStepEvent(step, event)) return;
+  // transpose the midi note into the drum domain, notes outside the drum scale become 0
+  event.note = MidiUtils::scaleToDrumNote(event.note);
+  // apply changes to the event if needed      
   if(transpose > 0) 
   {
-    if (data->at(Step::note1Ind) > 0 ) // only transpose non-zero steps
+    if (event.note > 0 ) // only transpose non-zero steps
     {
-      data->at(Step::note1Ind) = fmod(data->at(Step::note1Ind) + transpose, 127);
+      event.note = fmod(event.note + transpose, 127);
     }
   }
-  s.trigger();
+  sendStepEvent(step, event);
 }
 
 
@@ -167,38 +268,44 @@ void Sequence::triggerMidiDrumType()
  * Called when the sequence ticks and it is a transpose type
  * Causes this sequence to apply a transpose to another sequence
 */
-void Sequence::triggerTransposeType()
+void Sequence::triggerTransposeType(unsigned int step)
 {
-  if (steps[currentStep].isActive() )
+  if (stepActive[step])
   {
-    std::vector<double> data = steps[currentStep].getData();
-    if (data[Step::note1Ind] != 0) // only do anything if they set a non-zero value
+    if (stepNotes[step] != 0) // only do anything if they set a non-zero value
     {
-      sequencer->getSequence(data[Step::channelInd])->setTranspose(data[Step::note1Ind]);
+      signed char amount = stepNotes[step];
+      sequencer->changeSequence(stepChannels[step], [amount](Sequence& target){
+        target.setTranspose(amount);
+      });
     }
   }
 } 
 
-void Sequence::triggerLengthType()
+void Sequence::triggerLengthType(unsigned int step)
 {
-  if (steps[currentStep].isActive())
+ if (stepActive[step])
   {
-    std::vector<double> data = steps[currentStep].getData();  
-    if (data[Step::note1Ind] != 0) // only do anything if they set a non-zero value
+    if (stepNotes[step] != 0) // only do anything if they set a non-zero value
     { 
-      sequencer->getSequence(data[Step::channelInd])->setLengthAdjustment(data[Step::note1Ind]);
+      signed char amount = stepNotes[step];
+      sequencer->changeSequence(stepChannels[step], [amount](Sequence& target){
+        target.setLengthAdjustment(amount);
+      });
     }
   } 
 }
 
-void Sequence::triggerTickType()
+void Sequence::triggerTickType(unsigned int step)
 {
-  if (steps[currentStep].isActive() )
+  if (stepActive[step])
   {
-    std::vector<double>* data = steps[currentStep].getDataDirect();
-    if (data->at(Step::note1Ind) != 0) // only do anything if they set a non-zero value
+    if (stepNotes[step] != 0) // only do anything if they set a non-zero value
     {
-      sequencer->getSequence(data->at(Step::channelInd))->setTicksPerStep(data->at(Step::note1Ind));
+      signed char amount = stepNotes[step];
+      sequencer->changeSequence(stepChannels[step], [amount](Sequence& target){
+        target.setTicksPerStep(amount);
+      });
     }
   }
 } 
@@ -209,7 +316,7 @@ void Sequence::setLengthAdjustment(int lenAdjust)
   // do not allow 0 len
   if (currentLength + lenAdjust < 1) return;
   // do not allow len to go over available steps len
-  if (! (currentLength + lenAdjust < this->steps.size())) return;
+  if (! (currentLength + lenAdjust < this->stepActive.size())) return;
   lengthAdjustment = lenAdjust;
   setLength(currentLength + lenAdjust);
 }
@@ -232,27 +339,63 @@ int Sequence::getTicksPerStep() const
   return this->originalTicksPerStep;
 }
 
+void Sequence::setTickScale(int tickScale)
+{
+  if (tickScale < 1) return;
+  this->tickScale = tickScale;
+  this->ticksElapsed = 0;
+  this->delayedStepTicks = 0;
+}
+
+void Sequence::setStepOffset(unsigned int step, int ticks)
+{
+  stepOffsets[step] = Sequence::clampStepValue(ticks, -32768, 32767);
+}
+
+int Sequence::getStepOffset(unsigned int step) const
+{
+  return stepOffsets[step];
+}
+
 unsigned int Sequence::getCurrentStep() const
 {
   return currentStep; 
 } 
 bool Sequence::assertStep(unsigned int step) const
 {
-  if (step >= steps.size() || step < 0) return false;
+  if (step >= stepActive.size() || step < 0) return false;
   return true; 
 }
 std::vector<double> Sequence::getStepData(int step) const
 {
-  return steps[step].getData();
+  std::vector<double> data(Step::dataSize);
+  for (int i=0; i < Step::dataSize; ++i) data[i] = getStepValue(step, i);
+  return data;
 }
-std::vector<double>* Sequence::getStepDataDirect(int step)
+StepDataView Sequence::getStepDataDirect(int step)
 {
-  return steps[step].getDataDirect();
+  return StepDataView{this, (unsigned int) step};
+}
+
+double Sequence::getStepValue(unsigned int step, unsigned int dataInd) const
+{
+  switch (dataInd)
+  {
+    case Step::channelInd:
+      return stepChannels[step];
+    case Step::lengthInd:
+      return stepLengths[step];
+    case Step::velInd:
+      return stepVelocities[step];
+    case Step::note1Ind:
+      return stepNotes[step];
+  }
+  return 0;
 }
 
 std::vector<double> Sequence::getCurrentStepData() const
 {
-  return steps[currentStep].getData();
+  return getStepData(currentStep);
 }
 unsigned int Sequence::getLength() const
 {
@@ -263,18 +406,19 @@ void Sequence::setLength(int length)
 {
 
   if (length < 1) return;
-  if (length > steps.size()) // bad need more steps
+  if (length > stepActive.size()) // bad need more steps
   {
-    int toAdd = length - steps.size();
+    int toAdd = length - stepActive.size();
     for (int i=0; i < toAdd; ++i)
     {
-      Step s;
-      s.setCallback(
-        steps[0].getCallback()
-      );
+      stepCallbacks.push_back(stepCallbacks[0]);
       // set the channel
-      s.getDataDirect()[Step::channelInd] = steps[0].getDataDirect()[Step::channelInd];
-      steps.push_back(s);
+      stepChannels.push_back(stepChannels[0]);
+      stepLengths.push_back(0);
+      stepVelocities.push_back(0);
+      stepNotes.push_back(0);
+      stepActive.push_back(1);
+      stepOffsets.push_back(0);
     }
   }
   currentLength = length;
@@ -282,18 +426,67 @@ void Sequence::setLength(int length)
 
 void Sequence::setStepData(unsigned int step, std::vector<double> data)
 {
-  steps[step].setData(data);
+  // values missing from the end of data are set to 0
+  for (int i=0; i < Step::dataSize; ++i)
+  {
+    if (i < data.size()) updateStepData(step, i, data[i]);
+    else updateStepData(step, i, 0);
+  }
 }
 /** update a single data value in a given step*/
 void Sequence::updateStepData(unsigned int step, unsigned int dataInd, double value)
 {
-  steps[step].updateData(dataInd, value);
+  switch (dataInd)
+  {
+    case Step::channelInd:
+      stepChannels[step] = Sequence::clampStepValue(value, 0, 65535);
+      // a modulator's channel is the sequence it changes
+      if (isModulator()) sequencer->markModulationChanged();
+      break;
+    case Step::lengthInd:
+      stepLengths[step] = Sequence::clampStepValue(value, 0, 65535);
+      break;
+    case Step::velInd:
+      stepVelocities[step] = Sequence::clampStepValue(value, 0, 127);
+      break;
+    case Step::note1Ind:
+      stepNotes[step] = Sequence::clampStepValue(value, -128, 127);
+      // modulator steps with a 0 note do nothing
+      if (isModulator()) sequencer->markModulationChanged();
+      break;
+  }
+}
+
+int Sequence::clampStepValue(double value, int min, int max)
+{
+  if (value < min) return min;
+  if (value > max) return max;
+  return (int) value;
 }
 
 void Sequence::setStepCallback(unsigned int step, 
                   std::function<void (std::vector<double>*)> callback)
 {
-  steps[step].setCallback(callback);
+  stepCallbacks[step] = callback;
+}
+
+void Sequence::setEventCallback(StepEventCallback callback)
+{
+  eventCallback = callback;
+}
+
+void Sequence::setHoldEvents(bool hold)
+{
+  holdEvents = hold;
+}
+
+void Sequence::sendHeldEvents()
+{
+  for (const std::pair<unsigned int, StepEvent>& held : heldEvents)
+  {
+    deliverStepEvent(held.first, held.second);
+  }
+  heldEvents.clear();
 }
 std::string Sequence::stepToString(int step) const
 {
@@ -312,21 +505,29 @@ unsigned int Sequence::howManySteps() const
 
 void Sequence::toggleActive(unsigned int step)
 {
-  steps[step].toggleActive();
+  stepActive[step] = !stepActive[step];
 }
 bool Sequence::isStepActive(unsigned int step) const
 {
-  return steps[step].isActive();
+  return stepActive[step];
 }
 void Sequence::setType(SequenceType type)
 {
   this->type = type;
+  sequencer->markModulationChanged();
 }
 SequenceType Sequence::getType() const
 {
   return this->type;
 }
 
+bool Sequence::isModulator() const
+{
+  return type == SequenceType::transposer || 
+         type == SequenceType::lengthChanger || 
+         type == SequenceType::tickChanger;
+}
+
 void Sequence::setTranspose(double transpose)
 {
   this->transpose = transpose;
@@ -334,27 +535,95 @@ void Sequence::setTranspose(double transpose)
 
 void Sequence::reset()
 {
-  for (Step& step : steps)
-  {
-    // activate the step
-    if (!step.isActive()) step.toggleActive();
-    // reset the data
-    int dSize = step.getDataDirect()->size();
-    for (auto i = 0; i < dSize; i++)
-    {
-      step.updateData(i, 0.0);
-    }
-  }
+  // activate the steps
+  std::fill(stepActive.begin(), stepActive.end(), 1);
+  // reset the data
+  std::fill(stepChannels.begin(), stepChannels.end(), 0);
+  std::fill(stepLengths.begin(), stepLengths.end(), 0);
+  std::fill(stepVelocities.begin(), stepVelocities.end(), 0);
+  std::fill(stepNotes.begin(), stepNotes.end(), 0);
+  std::fill(stepOffsets.begin(), stepOffsets.end(), 0);
+  if (isModulator()) sequencer->markModulationChanged();
+}
+
+/////////////////////// StepDataView
+
+StepDataView::Value::Value(Sequence* sequence, Sequencer* sequencer, unsigned int sequenceIndex, unsigned int step, unsigned int dataInd)
+: sequence{sequence}, sequencer{sequencer}, sequenceIndex{sequenceIndex}, step{step}, dataInd{dataInd}
+{
+}
+
+StepDataView::Value::operator double() const
+{
+  return sequence->getStepValue(step, dataInd);
+}
+
+StepDataView::Value& StepDataView::Value::operator=(double value)
+{
+  if (sequencer != nullptr) sequencer->updateStepData(sequenceIndex, step, dataInd, value);
+  else sequence->updateStepData(step, dataInd, value);
+  return *this;
+}
+
+StepDataView::StepDataView(Sequence* sequence, unsigned int step) 
+: sequence{sequence}, sequencer{nullptr}, sequenceIndex{0}, step{step}
+{
+}
+
+StepDataView::StepDataView(Sequencer* sequencer, unsigned int sequence, unsigned int step) 
+: sequence{sequencer->getSequence(sequence)}, sequencer{sequencer}, sequenceIndex{sequence}, step{step}
+{
+}
+
+StepDataView::Value StepDataView::at(unsigned int dataInd)
+{
+  return Value{sequence, sequencer, sequenceIndex, step, dataInd};
+}
+
+StepDataView::Value StepDataView::operator[](unsigned int dataInd)
+{
+  return Value{sequence, sequencer, sequenceIndex, step, dataInd};
+}
+
+unsigned int StepDataView::size() const
+{
+  return Step::dataSize;
+}
+
+StepDataView* StepDataView::operator->()
+{
+  return this;
 }
 
 /////////////////////// Sequencer 
 
-Sequencer::Sequencer(unsigned int seqCount, unsigned int seqLength) 
+Sequencer::Sequencer(unsigned int seqCount, unsigned int seqLength) : ppqn{4}, editQueue{1024}, editQueueEnabled{false}, droppedEdits{0}, 
+  snapshots(2), currentSnapshot{0}, snapshotVersion{0}, editedSinceSnapshot{false}, 
+  scheduledTicking{false}, insideTick{false}, tickingSequence{0}, tickCount{0}, lastTickWork{0}, 
+  modulationGraphDirty{true}, modulationCycle{false}, tickPool{nullptr}
 {
   for (auto i=0;i<seqCount;++i)
   {
     sequences.push_back(Sequence{this, seqLength});
   }
+  syncedTicks.resize(seqCount, 0);
+  dueTicks.resize(seqCount, UINT64_MAX);
+  // room for a stale entry per sequence before it is rebuilt
+  schedule.reserve(seqCount * 2 + 16);
+  tickOrder.reserve(seqCount);
+  tickRank.resize(seqCount, 0);
+  modulationGroups.resize(seqCount, 0);
+  onModulationCycle.resize(seqCount, 0);
+  modulationTargets.resize(seqCount);
+  modulationInDegree.resize(seqCount, 0);
+  readyToOrder.reserve(seqCount);
+  modulationVisited.resize(seqCount, 0);
+  tickGroupStarts.reserve(seqCount + 1);
+  tickGroupMembers.resize(seqCount, 0);
+  updateTickOrder();
+  snapshotWrites[0] = 0;
+  snapshotWrites[1] = 0;
+  publishSnapshot();
 }
 
 Sequencer::~Sequencer()
@@ -390,10 +659,589 @@ unsigned int Sequencer::getSequenceTicksPerStep(unsigned int sequence) const
 /** move the sequencer along by one tick */
 void Sequencer::tick()
 {
-  for (Sequence& seq : sequences)
+  if (tickPool != nullptr && !scheduledTicking)
   {
-      seq.tick();
+    holdEvents(true);
+    tickSequences(tickPool);
+    holdEvents(false);
+    sendHeldEvents();
   }
+  else tickSequences(nullptr);
+}
+
+void Sequencer::tickAll(const std::vector<Sequencer*>& sequencers, TickPool& pool)
+{
+  for (Sequencer* seqr : sequencers) seqr->holdEvents(true);
+  pool.run(sequencers.size(), [&sequencers](unsigned int i){
+    sequencers[i]->tickSequences(nullptr);
+  });
+  for (Sequencer* seqr : sequencers) 
+  {
+    seqr->holdEvents(false);
+    seqr->sendHeldEvents();
+  }
+}
+
+void Sequencer::tickSequences(TickPool* pool)
+{
+  applyQueuedEdits();
+  if (modulationGraphDirty) updateTickOrder();
+  ++tickCount;
+  insideTick = true;
+  if (scheduledTicking) 
+  {
+    tickScheduled();
+  }
+  else if (pool != nullptr && tickGroupStarts.size() > 2)
+  {
+    // groups never change each other's sequences so they can tick at once
+    pool->run(tickGroupStarts.size() - 1, [this](unsigned int g){
+      for (unsigned int i = tickGroupStarts[g]; i < tickGroupStarts[g + 1]; ++i)
+      {
+        sequences[tickGroupMembers[i]].tick();
+      }
+    });
+    lastTickWork = sequences.size();
+  }
+  else 
+  {
+    // modulators before the sequences they change
+    for (unsigned int s : tickOrder)
+    {
+        sequences[s].tick();
+    }
+    lastTickWork = sequences.size();
+  }
+  insideTick = false;
+  // scheduled ticking flags its own changes rather than checking every sequence
+  if (editedSinceSnapshot || (!scheduledTicking && snapshotOutOfDate())) publishSnapshot();
+}
+
+void Sequencer::tickScheduled()
+{
+  lastTickWork = 0;
+  std::greater<std::pair<uint64_t, unsigned int>> later;
+  // ties come out in tick order, the same order as unscheduled ticking
+  while (!schedule.empty() && schedule.front().first <= tickCount)
+  {
+    std::pop_heap(schedule.begin(), schedule.end(), later);
+    std::pair<uint64_t, unsigned int> due = schedule.back();
+    schedule.pop_back();
+    unsigned int s = tickOrder[due.second];
+    // stale entries: rescheduled since, or already ticked this tick
+    if (due.first != dueTicks[s] || syncedTicks[s] >= tickCount) continue;
+    tickingSequence = s;
+    Sequence& seq = sequences[s];
+    if (syncedTicks[s] + 1 < tickCount) seq.skipIdleTicks(tickCount - 1 - syncedTicks[s]);
+    // counted as synced before the tick so a sequence changing itself does not skip
+    syncedTicks[s] = tickCount;
+    unsigned int stepBefore = seq.getCurrentStep();
+    seq.tick();
+    if (seq.getCurrentStep() != stepBefore) editedSinceSnapshot = true;
+    scheduleSequence(s);
+    ++lastTickWork;
+  }
+}
+
+void Sequencer::syncSequence(unsigned int sequence)
+{
+  if (!scheduledTicking) return;
+  uint64_t settled = tickCount;
+  // during a tick, sequences after the one ticking have not had this tick yet, 
+  // as with unscheduled ticking where they tick in order
+  if (insideTick && tickRank[sequence] > tickRank[tickingSequence]) settled = tickCount - 1;
+  if (syncedTicks[sequence] >= settled) return;
+  sequences[sequence].skipIdleTicks(settled - syncedTicks[sequence]);
+  syncedTicks[sequence] = settled;
+}
+
+void Sequencer::scheduleSequence(unsigned int sequence)
+{
+  if (!scheduledTicking) return;
+  unsigned int ticks = sequences[sequence].getTicksUntilDue();
+  if (ticks == Sequence::neverDue)
+  {
+    dueTicks[sequence] = UINT64_MAX;
+    return;
+  }
+  dueTicks[sequence] = syncedTicks[sequence] + ticks;
+  // clear out stale entries rather than grow
+  if (schedule.size() == schedule.capacity()) rebuildSchedule();
+  schedule.push_back(std::make_pair(dueTicks[sequence], tickRank[sequence]));
+  std::push_heap(schedule.begin(), schedule.end(), std::greater<std::pair<uint64_t, unsigned int>>());
+}
+
+void Sequencer::rebuildSchedule()
+{
+  schedule.clear();
+  for (unsigned int s = 0; s < sequences.size(); ++s)
+  {
+    if (dueTicks[s] != UINT64_MAX) schedule.push_back(std::make_pair(dueTicks[s], tickRank[s]));
+  }
+  std::make_heap(schedule.begin(), schedule.end(), std::greater<std::pair<uint64_t, unsigned int>>());
+}
+
+void Sequencer::setScheduledTicking(bool scheduled)
+{
+  if (scheduled == scheduledTicking) return;
+  if (scheduled)
+  {
+    // every sequence is up to date after unscheduled ticking
+    scheduledTicking = true;
+    for (unsigned int s = 0; s < sequences.size(); ++s)
+    {
+      syncedTicks[s] = tickCount;
+      unsigned int ticks = sequences[s].getTicksUntilDue();
+      dueTicks[s] = ticks == Sequence::neverDue ? UINT64_MAX : tickCount + ticks;
+    }
+    rebuildSchedule();
+  }
+  else 
+  {
+    for (unsigned int s = 0; s < sequences.size(); ++s) syncSequence(s);
+    scheduledTicking = false;
+    schedule.clear();
+  }
+}
+
+bool Sequencer::isScheduledTicking() const
+{
+  return scheduledTicking;
+}
+
+uint64_t Sequencer::getTickCount() const
+{
+  return tickCount;
+}
+
+unsigned int Sequencer::getLastTickWorkCount() const
+{
+  return lastTickWork;
+}
+
+const std::vector<unsigned int>& Sequencer::getTickOrder()
+{
+  if (modulationGraphDirty) updateTickOrder();
+  return tickOrder;
+}
+
+bool Sequencer::hasModulationCycle()
+{
+  if (modulationGraphDirty) updateTickOrder();
+  return modulationCycle;
+}
+
+bool Sequencer::isOnModulationCycle(unsigned int sequence)
+{
+  if (!assertSequence(sequence)) return false;
+  if (modulationGraphDirty) updateTickOrder();
+  return onModulationCycle[sequence] != 0;
+}
+
+unsigned int Sequencer::getModulationGroup(unsigned int sequence)
+{
+  if (!assertSequence(sequence)) return 0;
+  if (modulationGraphDirty) updateTickOrder();
+  return modulationGroups[sequence];
+}
+
+unsigned int Sequencer::getModulationGroupCount()
+{
+  if (modulationGraphDirty) updateTickOrder();
+  return tickGroupStarts.size() - 1;
+}
+
+void Sequencer::setTickPool(TickPool* pool)
+{
+  tickPool = pool;
+}
+
+TickPool* Sequencer::getTickPool() const
+{
+  return tickPool;
+}
+
+void Sequencer::holdEvents(bool hold)
+{
+  for (Sequence& seq : sequences) seq.setHoldEvents(hold);
+}
+
+void Sequencer::sendHeldEvents()
+{
+  // the order they would have been sent in ticking on one thread
+  for (unsigned int s : tickOrder) sequences[s].sendHeldEvents();
+}
+
+void Sequencer::markModulationChanged()
+{
+  modulationGraphDirty = true;
+}
+
+void Sequencer::updateTickOrder()
+{
+  modulationGraphDirty = false;
+  modulationCycle = false;
+  unsigned int count = sequences.size();
+  for (unsigned int s = 0; s < count; ++s)
+  {
+    modulationTargets[s].clear();
+    modulationInDegree[s] = 0;
+    modulationGroups[s] = s;
+    onModulationCycle[s] = 0;
+  }
+  // union find over the edges, the root of a group is always its lowest sequence
+  auto findGroup = [this](unsigned int s){
+    while (modulationGroups[s] != s) s = modulationGroups[s];
+    return s;
+  };
+  // an edge from each modulator to every sequence its steps change
+  for (unsigned int s = 0; s < count; ++s)
+  {
+    const Sequence& seq = sequences[s];
+    if (!seq.isModulator()) continue;
+    std::vector<unsigned int>& targets = modulationTargets[s];
+    for (unsigned int step = 0; step < seq.howManySteps(); ++step)
+    {
+      if (seq.getStepValue(step, Step::note1Ind) == 0) continue;
+      unsigned int target = seq.getStepValue(step, Step::channelInd);
+      // changing itself or a sequence that is not there puts nothing in order
+      if (target == s || target >= count) continue;
+      if (std::find(targets.begin(), targets.end(), target) != targets.end()) continue;
+      targets.push_back(target);
+      ++modulationInDegree[target];
+      unsigned int a = findGroup(s);
+      unsigned int b = findGroup(target);
+      if (a < b) modulationGroups[b] = a;
+      else modulationGroups[a] = b;
+    }
+  }
+  for (unsigned int s = 0; s < count; ++s) modulationGroups[s] = findGroup(s);
+  // Kahn's sort, taking the lowest ready sequence each time so 
+  // sequences that do not depend on each other keep index order
+  std::greater<unsigned int> higher;
+  tickOrder.clear();
+  readyToOrder.clear();
+  for (unsigned int s = 0; s < count; ++s)
+  {
+    if (modulationInDegree[s] == 0) readyToOrder.push_back(s);
+  }
+  std::make_heap(readyToOrder.begin(), readyToOrder.end(), higher);
+  while (tickOrder.size() < count)
+  {
+    if (readyToOrder.empty())
+    {
+      // everything left is on a loop or after one:
+      // break a loop at the lowest sequence left that is on one
+      modulationCycle = true;
+      unsigned int s = 0;
+      while (modulationInDegree[s] == 0 || !modulationReaches(s, s)) ++s;
+      modulationInDegree[s] = 0;
+      readyToOrder.clear();
+      readyToOrder.push_back(s);
+    }
+    std::pop_heap(readyToOrder.begin(), readyToOrder.end(), higher);
+    unsigned int s = readyToOrder.back();
+    readyToOrder.pop_back();
+    tickRank[s] = tickOrder.size();
+    tickOrder.push_back(s);
+    for (unsigned int target : modulationTargets[s])
+    {
+      // sequences already placed by breaking a loop are 0 too
+      if (modulationInDegree[target] == 0) continue;
+      if (--modulationInDegree[target] == 0)
+      {
+        readyToOrder.push_back(target);
+        std::push_heap(readyToOrder.begin(), readyToOrder.end(), higher);
+      }
+    }
+  }
+  if (modulationCycle)
+  {
+    for (unsigned int s = 0; s < count; ++s) onModulationCycle[s] = modulationReaches(s, s);
+  }
+  // bucket the tick order by group, keeping tick order within each group. 
+  // The in degrees are all 0 again after sorting, so they hold the 
+  // group sizes and then where the next member of each group goes
+  for (unsigned int s = 0; s < count; ++s) ++modulationInDegree[modulationGroups[s]];
+  tickGroupStarts.clear();
+  unsigned int start = 0;
+  for (unsigned int g = 0; g < count; ++g)
+  {
+    unsigned int size = modulationInDegree[g];
+    if (size == 0) continue;
+    tickGroupStarts.push_back(start);
+    modulationInDegree[g] = start;
+    start += size;
+  }
+  tickGroupStarts.push_back(count);
+  for (unsigned int s : tickOrder) tickGroupMembers[modulationInDegree[modulationGroups[s]]++] = s;
+  // the schedule breaks ties by rank
+  if (scheduledTicking) rebuildSchedule();
+}
+
+bool Sequencer::modulationReaches(unsigned int from, unsigned int to)
+{
+  // depth first, using readyToOrder as the stack
+  std::fill(modulationVisited.begin(), modulationVisited.end(), 0);
+  readyToOrder.clear();
+  readyToOrder.push_back(from);
+  while (!readyToOrder.empty())
+  {
+    unsigned int s = readyToOrder.back();
+    readyToOrder.pop_back();
+    for (unsigned int target : modulationTargets[s])
+    {
+      if (target == to) return true;
+      if (modulationVisited[target]) continue;
+      modulationVisited[target] = 1;
+      readyToOrder.push_back(target);
+    }
+  }
+  return false;
+}
+
+void Sequencer::setEditQueueEnabled(bool enabled)
+{
+  editQueueEnabled = enabled;
+  if (!enabled) 
+  {
+    applyQueuedEdits();
+    if (editedSinceSnapshot) publishSnapshot();
+  }
+}
+
+bool Sequencer::isEditQueueEnabled() const
+{
+  return editQueueEnabled;
+}
+
+void Sequencer::applyQueuedEdits()
+{
+  SequencerCommand command;
+  while (editQueue.pop(command))
+  {
+    applyEdit(command);
+  }
+}
+
+long Sequencer::getDroppedEditCount() const
+{
+  return droppedEdits;
+}
+
+unsigned int Sequencer::getQueuedEditCount() const
+{
+  return editQueue.size();
+}
+
+bool Sequencer::queueEdit(const SequencerCommand& command)
+{
+  if (!editQueueEnabled) return false;
+  // the ticking thread empties the queue every tick, so wait a while for room
+  // rather than lose a user's edit, but do not hang the UI if nothing is ticking
+  for (int waited = 0; !editQueue.push(command); ++waited)
+  {
+    if (waited == maxEditWaitMs) 
+    {
+      droppedEdits ++;
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+void Sequencer::submitEdit(const SequencerCommand& command)
+{
+  if (queueEdit(command)) return;
+  applyEdit(command);
+  // nothing is ticking, so readers would not see the edit until the next tick
+  publishSnapshot();
+}
+
+void Sequencer::readSnapshot(SequencerSnapshot& snapshot) const
+{
+  while (true)
+  {
+    int current = currentSnapshot.load(std::memory_order_acquire);
+    unsigned int before = snapshotWrites[current].load(std::memory_order_acquire);
+    if (before % 2 == 0)
+    {
+      snapshot = snapshots[current];
+      std::atomic_thread_fence(std::memory_order_acquire);
+      // unchanged count means the publisher did not write this buffer while we copied it
+      if (snapshotWrites[current].load(std::memory_order_relaxed) == before) return;
+    }
+  }
+}
+
+uint64_t Sequencer::getSnapshotVersion() const
+{
+  return snapshotVersion;
+}
+
+void Sequencer::makeSnapshot(SequencerSnapshot& snapshot) const
+{
+  snapshot.version = snapshotVersion;
+  snapshot.sequenceCount = std::min((unsigned int) sequences.size(), (unsigned int) SequencerSnapshot::maxSequences);
+  for (unsigned int s = 0; s < snapshot.sequenceCount; ++s)
+  {
+    const Sequence& seq = sequences[s];
+    SequenceSnapshot& seqSnap = snapshot.sequences[s];
+    seqSnap.type = seq.getType();
+    seqSnap.length = std::min(seq.howManySteps(), (unsigned int) SequenceSnapshot::maxSteps);
+    seqSnap.currentStep = seq.getCurrentStep();
+    seqSnap.ticksPerStep = seq.getTicksPerStep();
+    for (unsigned int step = 0; step < seqSnap.length; ++step)
+    {
+      StepSnapshot& stepSnap = seqSnap.steps[step];
+      stepSnap.note = seq.getStepValue(step, Step::note1Ind);
+      stepSnap.velocity = seq.getStepValue(step, Step::velInd);
+      stepSnap.length = seq.getStepValue(step, Step::lengthInd);
+      stepSnap.channel = seq.getStepValue(step, Step::channelInd);
+      stepSnap.active = seq.isStepActive(step);
+    }
+  }
+}
+
+bool Sequencer::snapshotOutOfDate() const
+{
+  // only the publishing thread writes the snapshots so it can read the current one
+  const SequencerSnapshot& published = snapshots[currentSnapshot.load(std::memory_order_relaxed)];
+  for (unsigned int s = 0; s < published.sequenceCount; ++s)
+  {
+    const Sequence& seq = sequences[s];
+    const SequenceSnapshot& seqSnap = published.sequences[s];
+    if (seqSnap.currentStep != seq.getCurrentStep() || 
+        seqSnap.length != std::min(seq.howManySteps(), (unsigned int) SequenceSnapshot::maxSteps) || 
+        seqSnap.ticksPerStep != seq.getTicksPerStep()) return true;
+  }
+  return false;
+}
+
+void Sequencer::publishSnapshot()
+{
+  int next = 1 - currentSnapshot.load(std::memory_order_relaxed);
+  // odd count while writing
+  snapshotWrites[next].fetch_add(1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  makeSnapshot(snapshots[next]);
+  snapshots[next].version = snapshotVersion + 1;
+  snapshotWrites[next].fetch_add(1, std::memory_order_release);
+  currentSnapshot.store(next, std::memory_order_release);
+  snapshotVersion.store(snapshots[next].version, std::memory_order_release);
+  editedSinceSnapshot = false;
+}
+
+void Sequencer::applyEdit(const SequencerCommand& command)
+{
+  // check here rather than when queued as the length might have changed since
+  if (!assertSequence(command.sequence)) return;
+  editedSinceSnapshot = true;
+  // keeps the schedule right if scheduled ticking is on
+  changeSequence(command.sequence, [&command](Sequence& seq){
+    switch (command.type)
+    {
+      case SequencerCommandType::setSequenceType:
+        seq.setType((SequenceType) command.intValue);
+        return;
+      case SequencerCommandType::setSequenceLength:
+        seq.setLength(command.intValue);
+        return;
+      case SequencerCommandType::shrinkSequence:
+        seq.setLength(seq.getLength() - 1);
+        return;
+      case SequencerCommandType::extendSequence:
+        seq.setLength(seq.getLength() + 1);
+        return;
+      case SequencerCommandType::setTicksPerStep:
+        seq.setTicksPerStep(command.intValue);
+        return;
+      case SequencerCommandType::resetSequence:
+        seq.reset();
+        return;
+      case SequencerCommandType::changeTicksPerStep:
+      {
+        int ticksPerStep = seq.getTicksPerStep() + command.intValue;
+        if (ticksPerStep > maxEditTicksPerStep) ticksPerStep = 1;
+        if (ticksPerStep < 1) ticksPerStep = 1;
+        seq.setTicksPerStep(ticksPerStep);
+        return;
+      }
+      case SequencerCommandType::cycleSequenceType:
+        seq.setType(nextSequenceType(seq.getType()));
+        return;
+      case SequencerCommandType::setSequenceChannel:
+        for (unsigned int step = 0; step < seq.howManySteps(); ++step) seq.updateStepData(step, Step::channelInd, command.intValue);
+        return;
+      case SequencerCommandType::shiftSequenceChannel:
+      {
+        int channel = ((int) seq.getStepValue(0, Step::channelInd) + command.intValue) % 16;
+        if (channel < 0) channel += 16;
+        for (unsigned int step = 0; step < seq.howManySteps(); ++step) seq.updateStepData(step, Step::channelInd, channel);
+        return;
+      }
+      case SequencerCommandType::toggleSequenceActive:
+        for (unsigned int step = 0; step < seq.getLength(); ++step) seq.toggleActive(step);
+        return;
+      default:
+        break;
+    }
+    // the rest are step edits
+    if (!seq.assertStep(command.step)) return;
+    switch (command.type)
+    {
+      case SequencerCommandType::setStepData:
+        for (int i=0; i < Step::dataSize; ++i) seq.updateStepData(command.step, i, command.values[i]);
+        return;
+      case SequencerCommandType::updateStepData:
+        seq.updateStepData(command.step, command.dataInd, command.values[0]);
+        return;
+      case SequencerCommandType::setStepOffset:
+        seq.setStepOffset(command.step, command.intValue);
+        return;
+      case SequencerCommandType::toggleActive:
+        seq.toggleActive(command.step);
+        return;
+      case SequencerCommandType::addToStepData:
+      {
+        double value = seq.getStepValue(command.step, command.dataInd) + command.values[0];
+        if (value < command.values[1]) value = command.values[1];
+        if (value > command.values[2]) value = command.values[2];
+        seq.updateStepData(command.step, command.dataInd, value);
+        return;
+      }
+      case SequencerCommandType::enterStepNote:
+        if (seq.getStepValue(command.step, Step::velInd) == 0) seq.updateStepData(command.step, Step::velInd, 64);
+        if (seq.getStepValue(command.step, Step::lengthInd) == 0) seq.updateStepData(command.step, Step::lengthInd, 1);
+        seq.updateStepData(command.step, Step::note1Ind, command.values[0]);
+        return;
+      default:
+        return;
+    }
+  });
+}
+
+void Sequencer::setPPQN(unsigned int ppqn)
+{
+  if (ppqn < 4 || ppqn % 4 != 0) return;
+  this->ppqn = ppqn;
+  for (unsigned int s = 0; s < sequences.size(); ++s)
+  {
+    changeSequence(s, [ppqn](Sequence& seq){
+      seq.setTickScale(ppqn / 4);
+    });
+  }
+}
+
+unsigned int Sequencer::getPPQN() const
+{
+  return ppqn;
+}
+
+unsigned int Sequencer::getTicksPerSixteenth() const
+{
+  return ppqn / 4;
 }
 
 Sequence* Sequencer::getSequence(unsigned int sequence)
@@ -403,21 +1251,63 @@ Sequence* Sequencer::getSequence(unsigned int sequence)
 
 void Sequencer::setSequenceType(unsigned int sequence, SequenceType type)
 {
-  sequences[sequence].setType(type);
+  SequencerCommand command{SequencerCommandType::setSequenceType, sequence};
+  command.intValue = (int) type;
+  submitEdit(command);
+}
+
+void Sequencer::setSequenceTicksPerStep(unsigned int sequence, unsigned int ticksPerStep)
+{
+  SequencerCommand command{SequencerCommandType::setTicksPerStep, sequence};
+  command.intValue = ticksPerStep;
+  submitEdit(command);
+}
+
+void Sequencer::changeSequenceTicksPerStep(unsigned int sequence, int amount)
+{
+  SequencerCommand command{SequencerCommandType::changeTicksPerStep, sequence};
+  command.intValue = amount;
+  submitEdit(command);
+}
+
+SequenceType Sequencer::nextSequenceType(SequenceType type)
+{
+  switch (type){
+    case SequenceType::midiNote:
+      return SequenceType::drumMidi;
+    case SequenceType::drumMidi:
+      return SequenceType::transposer;
+    case SequenceType::transposer:
+      return SequenceType::lengthChanger;
+    case SequenceType::lengthChanger:
+      return SequenceType::tickChanger;
+    default:
+      return SequenceType::midiNote;
+  }
+}
+
+void Sequencer::cycleSequenceType(unsigned int sequence)
+{
+  SequencerCommand command{SequencerCommandType::cycleSequenceType, sequence};
+  submitEdit(command);
 }
 
 void Sequencer::setSequenceLength(unsigned int sequence, unsigned int length)
 {
-  sequences[sequence].setLength(length);
+  SequencerCommand command{SequencerCommandType::setSequenceLength, sequence};
+  command.intValue = length;
+  submitEdit(command);
 }
 
 void Sequencer::shrinkSequence(unsigned int sequence)
 {
-  sequences[sequence].setLength(sequences[sequence].getLength()-1);
+  SequencerCommand command{SequencerCommandType::shrinkSequence, sequence};
+  submitEdit(command);
 }
 void Sequencer::extendSequence(unsigned int sequence)
 {
-  sequences[sequence].setLength(sequences[sequence].getLength()+1);
+  SequencerCommand command{SequencerCommandType::extendSequence, sequence};
+  submitEdit(command);
 }
 
 
@@ -438,6 +1328,14 @@ void Sequencer::setSequenceCallback(unsigned int sequence, std::function<void (s
   }
 }
 
+void Sequencer::setEventCallback(StepEventCallback callback)
+{
+  for (Sequence& seq : sequences)
+  {
+    seq.setEventCallback(callback);
+  }
+}
+
 /** set a lambda to call when a particular step in a particular sequence happens */
 void Sequencer::setStepCallback(unsigned int sequence, unsigned int step, std::function<void (std::vector<double>*)> callback)
 {
@@ -447,15 +1345,21 @@ void Sequencer::setStepCallback(unsigned int sequence, unsigned int step, std::f
 /** update the data stored at a step in the sequencer */
 void Sequencer::setStepData(unsigned int sequence, unsigned int step, std::vector<double> data)
 {
-  if (!assertSeqAndStep(sequence, step)) return;
-  sequences[sequence].setStepData(step, data);
+  if (!assertSequence(sequence)) return;
+  // values missing from the end of data are set to 0
+  SequencerCommand command{SequencerCommandType::setStepData, sequence, step};
+  for (int i=0; i < Step::dataSize; ++i) command.values[i] = i < data.size() ? data[i] : 0;
+  submitEdit(command);
 }
 /** update a single value in the  data 
  * stored at a step in the sequencer */
 void Sequencer::updateStepData(unsigned int sequence, unsigned int step, unsigned int dataInd, double value)
 {
-  if (!assertSeqAndStep(sequence, step)) return;
-  sequences[sequence].updateStepData(step, dataInd, value);
+  // applyEdit checks the step, as the length might change before it is applied
+  if (!assertSequence(sequence)) return;
+  SequencerCommand command{SequencerCommandType::updateStepData, sequence, step, dataInd};
+  command.values[0] = value;
+  submitEdit(command);
 }
 
 /** retrieve the data for the current step */
@@ -472,17 +1376,72 @@ std::vector<double> Sequencer::getStepData(int sequence, int step) const
   return sequences[sequence].getStepData(step);
 }
 /** retrieve the data for a specific step */
-std::vector<double>* Sequencer::getStepDataDirect(int sequence, int step)
+StepDataView Sequencer::getStepDataDirect(int sequence, int step)
 {
   // TODO should throw an exception if they ask for an invalid step or sequence
   //if (!assertSeqAndStep(sequence, step)) return std::vector<double>{};
-  return sequences[sequence].getStepDataDirect(step);
+  return StepDataView{this, (unsigned int) sequence, (unsigned int) step};
+}
+
+void Sequencer::addToStepData(unsigned int sequence, unsigned int step, unsigned int dataInd, double amount, double min, double max)
+{
+  if (!assertSequence(sequence)) return;
+  SequencerCommand command{SequencerCommandType::addToStepData, sequence, step, dataInd};
+  command.values[0] = amount;
+  command.values[1] = min;
+  command.values[2] = max;
+  submitEdit(command);
+}
+
+void Sequencer::enterStepNote(unsigned int sequence, unsigned int step, double note)
+{
+  if (!assertSequence(sequence)) return;
+  SequencerCommand command{SequencerCommandType::enterStepNote, sequence, step};
+  command.values[0] = note;
+  submitEdit(command);
+}
+
+void Sequencer::setSequenceChannel(unsigned int sequence, unsigned int channel)
+{
+  if (!assertSequence(sequence)) return;
+  SequencerCommand command{SequencerCommandType::setSequenceChannel, sequence};
+  command.intValue = channel;
+  submitEdit(command);
+}
+
+void Sequencer::shiftSequenceChannel(unsigned int sequence, int amount)
+{
+  if (!assertSequence(sequence)) return;
+  SequencerCommand command{SequencerCommandType::shiftSequenceChannel, sequence};
+  command.intValue = amount;
+  submitEdit(command);
+}
+
+void Sequencer::setStepOffset(unsigned int sequence, unsigned int step, int ticks)
+{
+  if (!assertSequence(sequence)) return;
+  SequencerCommand command{SequencerCommandType::setStepOffset, sequence, step};
+  command.intValue = ticks;
+  submitEdit(command);
+}
+
+int Sequencer::getStepOffset(unsigned int sequence, unsigned int step) const
+{
+  if (!assertSeqAndStep(sequence, step)) return 0;
+  return sequences[sequence].getStepOffset(step);
 }
 
 void Sequencer::toggleActive(int sequence, int step)
 {
-  if (!assertSeqAndStep(sequence, step)) return;
-  sequences[sequence].toggleActive(step);
+  if (!assertSequence(sequence)) return;
+  SequencerCommand command{SequencerCommandType::toggleActive, (unsigned int) sequence, (unsigned int) step};
+  submitEdit(command);
+}
+void Sequencer::toggleSequenceActive(unsigned int sequence)
+{
+  if (!assertSequence(sequence)) return;
+  SequencerCommand command{SequencerCommandType::toggleSequenceActive, sequence};
+  submitEdit(command);
 }
 bool Sequencer::isStepActive(int sequence, int step) const
 {
@@ -513,7 +1472,8 @@ return s;
 void Sequencer::resetSequence(int sequence)
 {
   if (!assertSequence(sequence)) return;
-  sequences[sequence].reset();
+  SequencerCommand command{SequencerCommandType::resetSequence, (unsigned int) sequence};
+  submitEdit(command);
 }
 
 
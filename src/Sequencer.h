@@ -10,6 +10,9 @@
 #include <iostream>
 #include <string>
 #include <functional>
+#include <atomic>
+#include <cstdint>
+#include "SpscRing.h"
 #include <map>
 #include "MidiUtils.h"
 
@@ -17,7 +20,8 @@
  * so data[0] specifies length, 
  * data[1] specifies velocity 
  * and data[2] is the first note
- * 
+ * Sequence does not store Steps, it keeps each field in its own array, 
+ * but uses the same indexes to get at the fields
 */
 class Step{
   
@@ -27,6 +31,8 @@ class Step{
     const static int lengthInd{1};
     const static int velInd{2};
     const static int note1Ind{3};
+    /** how many data values a step has*/
+    const static int dataSize{4};
   
     Step();
     /** returns a copy of the data stored in this step*/
@@ -56,6 +62,21 @@ class Step{
 
 /** need this so can have a Sequencer data member in Sequence*/
 class Sequencer;
+class StepDataView;
+class TickPool;
+
+/** a triggered note step after transpose and drum mapping have been applied.
+ * Small enough to build on the stack on every trigger
+ */
+struct StepEvent{
+  int channel;
+  int note;
+  int velocity;
+  /** note length in sequencer ticks*/
+  long length;
+};
+
+typedef std::function<void(const StepEvent&)> StepEventCallback;
 
 /** use to define the type of a sequence. 
  * midiNote sends midi notes out
@@ -75,8 +96,10 @@ class Sequence{
     bool assertStep(unsigned int step) const;
     /** retrieve a copy of the step data for the sent step */
     std::vector<double> getStepData(int step) const;
-    /** get the momory address of the step data for the requested step*/
-    std::vector<double>* getStepDataDirect(int step);
+    /** get a view of the step data for the requested step for direct access*/
+    StepDataView getStepDataDirect(int step);
+    /** read one data value from a step, dataInd is one of the Step::*Ind values*/
+    double getStepValue(unsigned int step, unsigned int dataInd) const;
     /** set the data for the sent step */
     void setStepData(unsigned int step, std::vector<double> data);
     /** retrieve a copy of the step data for the current step */
@@ -98,6 +121,15 @@ class Sequence{
     void setTicksPerStepAdjustment(int ticksPerStep);
     /** return my permanent ticks per step (not the adjusted one)*/
     int getTicksPerStep() const;
+    /** how many sequencer ticks make one of the 1-16 ticks used by
+     * setTicksPerStep and step lengths. Set by Sequencer::setPPQN
+     */
+    void setTickScale(int tickScale);
+    /** set the micro-timing offset for a step in sequencer ticks.
+     * Offsets are kept within one step either side of the grid
+    */
+    void setStepOffset(unsigned int step, int ticks);
+    int getStepOffset(unsigned int step) const;
     /** apply a transpose to the sequence, which is reset when the sequence
      * hits step 0 again
      */
@@ -116,6 +148,17 @@ class Sequence{
     /** set the callback for the sent step */
     void setStepCallback(unsigned int step, 
                   std::function<void (std::vector<double>*)> callback);
+    /** send note steps to this callback instead of the step callbacks.
+     * This path does not allocate, the step callbacks are kept for older code 
+     */
+    void setEventCallback(StepEventCallback callback);
+    /** keep the events from triggered steps instead of sending them, until 
+     * sendHeldEvents. Lets sequences tick on other threads with the events 
+     * still going out in order 
+    */
+    void setHoldEvents(bool hold);
+    /** send the events held since setHoldEvents(true), in the order they were made*/
+    void sendHeldEvents();
     std::string stepToString(int step) const;
     /** activate/ deactive the sent step */
     void toggleActive(unsigned int step);
@@ -124,6 +167,10 @@ class Sequence{
     /** set the sequence type */
     void setType(SequenceType type);
     SequenceType getType() const;
+    /** true for the types that change other sequences: transposer, lengthChanger and tickChanger.
+     * A modulator's steps with a non-zero note change the sequence named by their channel
+    */
+    bool isModulator() const;
   /** add a transpose processor to this sequence. 
      * Normally, a transposer type sequence will call this on a midiNote type seqience
      * to apply a transpose to it 
@@ -131,34 +178,62 @@ class Sequence{
 //    void setStepProcessorTranspose(StepDataTranspose transpose);
     /** deactivate all data processors, e.g. transposers, length adjusters */
     void deactivateProcessors();
+    /** returned by getTicksUntilDue when nothing will happen as things stand*/
+    const static unsigned int neverDue{0xFFFFFFFF};
+    /** how many calls to tick until one triggers a step or moves the playhead, at least 1.
+     * The ticks before that only count 
+     */
+    unsigned int getTicksUntilDue() const;
+    /** the same as calling tick that many times, for ticks getTicksUntilDue says are idle */
+    void skipIdleTicks(unsigned int ticks);
     /** clear the data from this sequence. Does not clear step event functions*/
     void reset();
 
   private:
+    /** trigger the sent step according to the sequence type*/
+    void triggerStep(unsigned int step);
+    /** the sent step's offset, clamped to less than a step either way*/
+    int getClampedStepOffset(unsigned int step, int ticksPerStepScaled) const;
+    /** fill in the event for a note step, false if the step should not play*/
+    bool makeStepEvent(unsigned int step, StepEvent& event);
+    /** pass the event to the event callback or the step's callback, or hold it*/
+    void sendStepEvent(unsigned int step, const StepEvent& event);
+    /** pass the event to the event callback or the step's callback*/
+    void deliverStepEvent(unsigned int step, const StepEvent& event);
+    /** convert a double step value to an int in the range of its array's type*/
+    static int clampStepValue(double value, int min, int max);
     /** function called when the sequence ticks and it is SequenceType::midiNote
      * 
     */
-    void triggerMidiNoteType(); 
+    void triggerMidiNoteType(unsigned int step); 
     /** functoin called when the sequence ticks and it is SequenceType::midiDrum*/
-    void triggerMidiDrumType(); 
+    void triggerMidiDrumType(unsigned int step); 
     /** 
      * Called when the sequence ticks and it is a transpose type SequenceType::transposer
     */
-    void triggerTransposeType();
+    void triggerTransposeType(unsigned int step);
     /**
      * Called when the sequence ticks and it is SequenceType::lengthChanger
      */
-    void triggerLengthType();
+    void triggerLengthType(unsigned int step);
     /**
      * Called when the sequence ticks and it is SequenceType::tickChanger
      */
-    void triggerTickType();
+    void triggerTickType(unsigned int step);
     /** provides access to the sequencer so this sequence can change things*/
     Sequencer* sequencer;
     unsigned int currentLength;
     unsigned int currentStep;
     unsigned short midiChannel;
-    std::vector<Step> steps;
+    // step storage, one array per field, indexed by step.
+    // The tick path only reads these and they stay compact 
+    std::vector<unsigned short> stepChannels;
+    std::vector<unsigned short> stepLengths;
+    std::vector<unsigned char> stepVelocities;
+    std::vector<signed char> stepNotes;
+    std::vector<unsigned char> stepActive;
+    std::vector<short> stepOffsets;
+    std::vector<std::function<void(std::vector<double>*)>> stepCallbacks;
     SequenceType type;
     // temporary sequencer adjustment parameters that get reset at step 0
     double transpose; 
@@ -169,9 +244,108 @@ class Sequence{
      */
     int originalTicksPerStep;
     int ticksElapsed;
-    /** maps from linear midi scale to general midi drum notes*/
-    std::map<int,int> midiScaleToDrum;
+    /** sequencer ticks per tick of ticksPerStep*/
+    int tickScale;
+    /** a step with a positive offset waiting to be triggered*/
+    unsigned int delayedStep;
+    /** ticks until delayedStep triggers, 0 if nothing is waiting*/
+    int delayedStepTicks;
+    StepEventCallback eventCallback;
+    /** preallocated data passed to the step callbacks when a step triggers*/
+    std::vector<double> triggerData;
+    bool holdEvents;
+    /** (step, event) pairs waiting for sendHeldEvents*/
+    std::vector<std::pair<unsigned int, StepEvent>> heldEvents;
+
+};
+
+/** lightweight view of one step's data inside a Sequence's arrays.
+ * view->at(Step::note1Ind) reads and writes like the step data vector used to.
+ * A view from Sequencer::getStepDataDirect writes through Sequencer::updateStepData,
+ * so its writes are queued when the edit queue is enabled
+ */
+class StepDataView{
+  public:
+    /** assignable reference to one value in the step */
+    class Value{
+      public:
+        Value(Sequence* sequence, Sequencer* sequencer, unsigned int sequenceIndex, unsigned int step, unsigned int dataInd);
+        operator double() const;
+        Value& operator=(double value);
+      private:
+        Sequence* sequence;
+        Sequencer* sequencer;
+        unsigned int sequenceIndex;
+        unsigned int step;
+        unsigned int dataInd;
+    };
+    StepDataView(Sequence* sequence, unsigned int step);
+    /** writes go through sequencer->updateStepData */
+    StepDataView(Sequencer* sequencer, unsigned int sequence, unsigned int step);
+    Value at(unsigned int dataInd);
+    Value operator[](unsigned int dataInd);
+    unsigned int size() const;
+    /** so view->at() works where a vector pointer was returned before*/
+    StepDataView* operator->();
+  private:
+    Sequence* sequence;
+    /** nullptr for a view that writes straight to the Sequence*/
+    Sequencer* sequencer;
+    unsigned int sequenceIndex;
+    unsigned int step;
+};
+
+/** one step in a SequencerSnapshot */
+struct StepSnapshot{
+  signed char note;
+  unsigned char velocity;
+  unsigned short length;
+  unsigned short channel;
+  bool active;
+};
+
+/** the state of one sequence in a SequencerSnapshot */
+struct SequenceSnapshot{
+  const static unsigned int maxSteps{128};
+  SequenceType type;
+  /** steps in play, including any length adjustment */
+  unsigned int length;
+  unsigned int currentStep;
+  unsigned int ticksPerStep;
+  StepSnapshot steps[maxSteps];
+};
+
+/** a copy of the pattern and playhead state that can be read 
+ * without touching the live sequencer. Sized for up to maxSequences sequences 
+ * and maxSteps steps per sequence; anything past that is left out
+ */
+struct SequencerSnapshot{
+  const static unsigned int maxSequences{16};
+  const static unsigned int maxSteps{SequenceSnapshot::maxSteps};
+  /** goes up by one every time a new snapshot is published */
+  uint64_t version;
+  unsigned int sequenceCount;
+  SequenceSnapshot sequences[maxSequences];
+};
+
+/** the kinds of edit that can be queued for the clock thread */
+enum class SequencerCommandType {setSequenceType, setSequenceLength, shrinkSequence, extendSequence, 
+                                 setTicksPerStep, setStepData, updateStepData, setStepOffset, 
+                                 toggleActive, resetSequence, 
+                                 addToStepData, enterStepNote, setSequenceChannel, shiftSequenceChannel,
+                                 changeTicksPerStep, cycleSequenceType, toggleSequenceActive};
 
+/** an edit waiting to be applied by Sequencer::tick.
+ * Fixed size so queueing one does not allocate
+ */
+struct SequencerCommand{
+  SequencerCommandType type;
+  unsigned int sequence;
+  unsigned int step;
+  unsigned int dataInd;
+  /** sequence type, length, ticks per step, offset, channel or amount, depending on the type*/
+  int intValue;
+  double values[Step::dataSize];
 };
 
 /** represents a sequencer which is used to store a grid of data and to step through it */
@@ -187,11 +361,125 @@ class Sequencer  {
       SequenceType getSequenceType(unsigned int sequence) const;
       unsigned int getSequenceTicksPerStep(unsigned int sequence) const;
 
-      /** move the sequencer along by one tick */
+      /** move the sequencer along by one tick, first applying any queued edits */
       void tick();
+      /** when enabled, tick only ticks the sequences that have something to do,
+       * taking them from a min-heap of due ticks, so the cost of a tick
+       * follows the number of steps firing rather than the number of sequences.
+       * Sequences that are skipped catch up when they are next due or changed.
+       * In this mode change sequences through the Sequencer (or changeSequence),
+       * not through the Sequence pointers from getSequence
+       */
+      void setScheduledTicking(bool scheduled);
+      bool isScheduledTicking() const;
+      /** how many times tick has been called*/
+      uint64_t getTickCount() const;
+      /** how many sequences the last tick woke up*/
+      unsigned int getLastTickWorkCount() const;
+      /** the order tick ticks the sequences in. Modulators come before the 
+       * sequences they change, so a change lands on the same tick wherever 
+       * the modulator is in the list. Otherwise sequences keep index order.
+       * This and the other modulation functions are only safe on the thread that ticks
+      */
+      const std::vector<unsigned int>& getTickOrder();
+      /** true if modulators change each other in a loop. The loop is broken at its 
+       * lowest sequence, so changes coming round the loop land a tick late
+      */
+      bool hasModulationCycle();
+      bool isOnModulationCycle(unsigned int sequence);
+      /** sequences in different groups never change each other, so groups 
+       * could tick in parallel. The id is the group's lowest sequence
+      */
+      unsigned int getModulationGroup(unsigned int sequence);
+      /** how many modulation groups there are*/
+      unsigned int getModulationGroupCount();
+      /** sequences call this when their type or step targets change, 
+       * so the tick order is worked out again before the next tick
+      */
+      void markModulationChanged();
+      /** tick the modulation groups on the sent pool's threads. Events are held 
+       * back and sent once every group has ticked, in the same order as 
+       * ticking on one thread, so callbacks are still called on the thread
+       * calling tick. Scheduled ticking ignores the pool. 
+       * nullptr, the default, ticks on the calling thread.
+       * The pool must outlive its use here
+      */
+      void setTickPool(TickPool* pool);
+      TickPool* getTickPool() const;
+      /** tick several sequencers at once on the pool, then send their events 
+       * in the order ticking them one after another would. 
+       * Their own tick pools are not used
+      */
+      static void tickAll(const std::vector<Sequencer*>& sequencers, TickPool& pool);
+      /** call change(Sequence&) on the sent sequence, keeping the tick schedule right.
+       * Modulator sequences change their targets through this
+      */
+      template<typename Func>
+      void changeSequence(unsigned int sequence, Func&& change)
+      {
+        if (sequence >= sequences.size()) return;
+        syncSequence(sequence);
+        change(sequences[sequence]);
+        scheduleSequence(sequence);
+        // the change might be one the snapshot shows, e.g. ticks per step
+        if (scheduledTicking) editedSinceSnapshot = true;
+      }
+      /** when enabled, the edit functions (setStepData, toggleActive, extendSequence etc.)
+       * put the edit on a lock free queue instead of changing the sequences, 
+       * and tick applies them before it moves on. This lets one UI thread edit while 
+       * another thread calls tick, without locks.
+       * Reads from the UI thread should only use readSnapshot, which sees an edit after 
+       * the next tick, as the live state is the ticking thread's. Edits that depend on 
+       * the current state (addToStepData, shiftSequenceChannel etc.) are worked out 
+       * when they are applied, so several between two ticks all count.
+       * If the queue is full an edit waits up to maxEditWaitMs for the ticking thread 
+       * to make room, then it is dropped and counted (getDroppedEditCount).
+       * Disabling applies anything still queued, so only disable it 
+       * when tick is not being called, e.g. when the clock is stopped.
+       */
+      void setEditQueueEnabled(bool enabled);
+      bool isEditQueueEnabled() const;
+      /** apply queued edits now. Call from the thread that calls tick */
+      void applyQueuedEdits();
+      /** how many edits were dropped because the queue was full */
+      long getDroppedEditCount() const;
+      /** edits waiting for the next tick, roughly if tick is running*/
+      unsigned int getQueuedEditCount() const;
+      /** longest an edit waits for room in a full edit queue*/
+      constexpr static int maxEditWaitMs{1000};
+      /** copy the most recently published snapshot into the sent one.
+       * Lock free and safe from any number of threads.
+       * tick publishes a new snapshot when the pattern or a playhead changes and
+       * direct edits (edit queue disabled) publish straight away, so a reader
+       * can compare getSnapshotVersion with the version it last drew and skip the copy
+      */
+      void readSnapshot(SequencerSnapshot& snapshot) const;
+      /** version of the most recently published snapshot */
+      uint64_t getSnapshotVersion() const;
+      /** fill the sent snapshot from the live state, 
+       * only safe on the thread that ticks and edits the sequencer
+      */
+      void makeSnapshot(SequencerSnapshot& snapshot) const;
+      /** set the timing resolution in ticks per quarter note, e.g. 96 or 960.
+       * The default of 4 is one tick per sixteenth note, so
+       * ticks per step and note lengths keep their meaning at any resolution 
+       * and only the tick rate goes up. Must be a multiple of 4.
+       */
+      void setPPQN(unsigned int ppqn);
+      unsigned int getPPQN() const;
+      /** how many sequencer ticks there are per sixteenth note at the current PPQN*/
+      unsigned int getTicksPerSixteenth() const;
       /** return a pointer to the sequence with sent id*/
       Sequence* getSequence(unsigned int sequence);
       void setSequenceType(unsigned int sequence, SequenceType type);
+      /** set how many ticks at 4 PPQN there are per step in the sent sequence */
+      void setSequenceTicksPerStep(unsigned int sequence, unsigned int ticksPerStep);
+      /** change ticks per step by amount, going round to 1 past maxEditTicksPerStep and never below 1*/
+      void changeSequenceTicksPerStep(unsigned int sequence, int amount);
+      constexpr static int maxEditTicksPerStep{8};
+      /** move the sequence on to the next type: midiNote, drumMidi, transposer, lengthChanger, tickChanger then round again*/
+      void cycleSequenceType(unsigned int sequence);
+      static SequenceType nextSequenceType(SequenceType type);
        /** set the length of the sequence 
        * If it is higher than the current max length, new steps will be created
        * using callbacks that are copies of the one at the last, previously existant
@@ -206,6 +494,10 @@ class Sequencer  {
       void setAllCallbacks(std::function<void (std::vector<double>*)> callback);
       /** set a callback lambda for all steps in a sequence*/
       void setSequenceCallback(unsigned int sequence, std::function<void (std::vector<double>*)> callback);
+      /** set a lambda to receive note events from all sequences. 
+       * Replaces the step callbacks and does not allocate when steps trigger
+       */
+      void setEventCallback(StepEventCallback callback);
       /** set a lambda to call when a particular step in a particular sequence happens */
       void setStepCallback(unsigned int sequence, unsigned int step, std::function<void (std::vector<double>*)> callback);
       /** update the data stored at a step in the sequencer */
@@ -213,14 +505,29 @@ class Sequencer  {
       /** update a single value in the  data 
        * stored at a step in the sequencer */
       void updateStepData(unsigned int sequence, unsigned int step, unsigned int dataInd, double value);
+      /** add amount to one value of a step, keeping it between min and max */
+      void addToStepData(unsigned int sequence, unsigned int step, unsigned int dataInd, double amount, double min, double max);
+      /** set a step's note, giving it a velocity of 64 and a length of 1 if they are 0 */
+      void enterStepNote(unsigned int sequence, unsigned int step, double note);
+      /** set the channel on every step of the sequence*/
+      void setSequenceChannel(unsigned int sequence, unsigned int channel);
+      /** move every step of the sequence to step 0's channel plus amount, going round the 16 channels*/
+      void shiftSequenceChannel(unsigned int sequence, int amount);
       /** retrieve the data for the current step */
       std::vector<double> getCurrentStepData(int sequence) const;
   
       /** retrieve the data for a specific step */
       std::vector<double> getStepData(int sequence, int step) const;
-      /** get the memory address of the data for this step for direct viewing/ editing*/
-      std::vector<double>* getStepDataDirect(int sequence, int step);
+      /** get a view of the data for this step for direct viewing/ editing.
+       * Writes go through updateStepData, reads are of the live state
+       */
+      StepDataView getStepDataDirect(int sequence, int step);
+      /** set the micro-timing offset for a step in sequencer ticks */
+      void setStepOffset(unsigned int sequence, unsigned int step, int ticks);
+      int getStepOffset(unsigned int sequence, unsigned int step) const;
       void toggleActive(int sequence, int step);
+      /** toggle every step in play in the sequence*/
+      void toggleSequenceActive(unsigned int sequence);
       bool isStepActive(int sequence, int step) const;
       void addStepListener();
       /** wipe the data from the sent sequence*/
@@ -229,12 +536,88 @@ class Sequencer  {
       std::string toString();
 
     private:
+      /** everything tick does apart from holding events, ticking groups on pool if not nullptr*/
+      void tickSequences(TickPool* pool);
+      /** make every sequence hold its events or stop holding them*/
+      void holdEvents(bool hold);
+      /** send every sequence's held events, in tick order*/
+      void sendHeldEvents();
       bool assertSeqAndStep(unsigned int sequence, unsigned int step) const;
         
       bool assertSequence(unsigned int sequence) const;
+      /** queue the edit if the edit queue is enabled.
+       * Returns false if it was not queued and should be applied straight away
+      */
+      bool queueEdit(const SequencerCommand& command);
+      /** queue the edit or, if the queue is disabled, apply it and publish a snapshot */
+      void submitEdit(const SequencerCommand& command);
+      /** make the change described by the command */
+      void applyEdit(const SequencerCommand& command);
+      /** true if a playhead or something else the snapshot shows has moved on since it was published */
+      bool snapshotOutOfDate() const;
+      /** write a snapshot into the buffer readers are not using and make it the current one */
+      void publishSnapshot();
+      /** tick the sequences that are due this tick */
+      void tickScheduled();
+      /** bring a sequence skipped by scheduled ticking up to date*/
+      void syncSequence(unsigned int sequence);
+      /** work out when the sequence is next due and put it in the schedule*/
+      void scheduleSequence(unsigned int sequence);
+      /** fill the schedule from dueTicks*/
+      void rebuildSchedule();
+      /** rebuild the modulation graph and sort it into tickOrder if it has changed*/
+      void updateTickOrder();
+      /** is there a chain of modulators from one sequence to the other*/
+      bool modulationReaches(unsigned int from, unsigned int to);
       
       /// class data members  
       std::vector<Sequence> sequences;;
+      unsigned int ppqn;
+      SpscRing<SequencerCommand> editQueue;
+      std::atomic<bool> editQueueEnabled;
+      std::atomic<long> droppedEdits;
+      // two snapshot buffers: publishing writes the one that is not current.
+      // snapshotWrites[i] is odd while buffer i is being written so readers 
+      // can tell they copied a torn snapshot and retry (a seqlock)
+      std::vector<SequencerSnapshot> snapshots;
+      std::atomic<unsigned int> snapshotWrites[2];
+      std::atomic<int> currentSnapshot;
+      std::atomic<uint64_t> snapshotVersion;
+      /** set when an edit has been applied since the last publish*/
+      bool editedSinceSnapshot;
+      bool scheduledTicking;
+      /** true while tick is ticking sequences*/
+      bool insideTick;
+      /** the sequence scheduled ticking is ticking*/
+      unsigned int tickingSequence;
+      uint64_t tickCount;
+      unsigned int lastTickWork;
+      // scheduled ticking: syncedTicks[i] is the last tick sequence i's state is 
+      // up to date with, dueTicks[i] the next tick it has something to do
+      std::vector<uint64_t> syncedTicks;
+      std::vector<uint64_t> dueTicks;
+      /** min-heap of (due tick, rank in tickOrder). Entries that no longer match dueTicks are skipped*/
+      std::vector<std::pair<uint64_t, unsigned int>> schedule;
+      /** set when a sequence type or modulation target has changed*/
+      bool modulationGraphDirty;
+      bool modulationCycle;
+      // tickOrder lists the sequences in the order they tick, tickRank[i] is
+      // where sequence i is in it
+      std::vector<unsigned int> tickOrder;
+      std::vector<unsigned int> tickRank;
+      std::vector<unsigned int> modulationGroups;
+      std::vector<unsigned char> onModulationCycle;
+      // the graph: modulationTargets[i] are the sequences modulator i changes.
+      // Kept with the other working space so rebuilding reuses the memory
+      std::vector<std::vector<unsigned int>> modulationTargets;
+      std::vector<unsigned int> modulationInDegree;
+      std::vector<unsigned int> readyToOrder;
+      std::vector<unsigned char> modulationVisited;
+      // the modulation groups with their sequences in tick order: group g is
+      // tickGroupMembers from tickGroupStarts[g] up to tickGroupStarts[g + 1]
+      std::vector<unsigned int> tickGroupStarts;
+      std::vector<unsigned int> tickGroupMembers;
+      TickPool* tickPool;
 };
 
 
@@ -2,11 +2,12 @@
 #include "SequencerUtils.h"
 #include <cmath> // fmod
 #include <assert.h>
+#include <limits>
 
 
 SequencerEditor::SequencerEditor(Sequencer* sequencer) : sequencer{sequencer}, currentSequence{0}, currentStep{0}, currentStepIndex{0}, editMode{SequencerEditorMode::selectingSeqAndStep}, editSubMode{SequencerEditorSubMode::editCol1}, stepIncrement{0.5f}
 {
-
+  publishCursor();
 }
 
 void SequencerEditor::setSequencer(Sequencer* sequencer)
@@ -28,6 +29,7 @@ void SequencerEditor::resetCursor()
   editMode = SequencerEditorMode::selectingSeqAndStep; 
   editSubMode = SequencerEditorSubMode::editCol1;
   stepIncrement = 0.5f;
+  publishCursor();
 }
 
 SequencerEditorMode SequencerEditor::getEditMode() const
@@ -41,6 +43,7 @@ SequencerEditorSubMode SequencerEditor::getEditSubMode() const
 void SequencerEditor::setEditMode(SequencerEditorMode mode)
 {
     this->editMode = mode;
+    publishCursor();
 }
 /** cycle through the edit modes in the sequence:
  * settingSeqLength (start mode)
@@ -53,18 +56,19 @@ void SequencerEditor::cycleEditMode()
     {
     case SequencerEditorMode::settingSeqLength:
         editMode = SequencerEditorMode::selectingSeqAndStep;
-        return;
+        break;
     case SequencerEditorMode::selectingSeqAndStep:
         editMode = SequencerEditorMode::settingSeqLength;
         currentStep = 0;
-        return;
+        break;
     case SequencerEditorMode::editingStep: // go to next data item
         this->editSubMode = SequencerEditor::cycleSubModeRight(this->editSubMode);
-        return;  
+        break;  
     case SequencerEditorMode::configuringSequence: 
         this->editSubMode = SequencerEditor::cycleSubModeRight(this->editSubMode);
-        return;
+        break;
     }
+    publishCursor();
 }
 /** 
  * depending on the mode, whoops bad coupling again! 
@@ -81,10 +85,7 @@ switch(editMode)
     case SequencerEditorMode::selectingSeqAndStep:
         // toggle the step on or off
         // toggle all steps in current sequence to off
-        for (auto i=0;i<sequencer->getSequence(currentSequence)->getLength(); ++i)
-        {
-        sequencer->toggleActive(currentSequence, i);
-        }
+        sequencer->toggleSequenceActive(currentSequence);
         return;
     case SequencerEditorMode::editingStep:
         //std::vector<double> data = {0, 0, 0};
@@ -133,6 +134,7 @@ switch(editMode)
     editMode = SequencerEditorMode::selectingSeqAndStep;
     break;  
 }
+publishCursor();
 }
 
 /**
@@ -146,41 +148,39 @@ if (note < 0 || note > 127) return;
     if (editMode == SequencerEditorMode::editingStep ||
         editMode == SequencerEditorMode::selectingSeqAndStep)
     {     
-    std::vector<double> data = sequencer->getStepData(currentSequence, currentStep);
-    // set a default vel and len if needed.
-    if (data[Step::velInd] == 0) data[Step::velInd] = 64;
-    if (data[Step::lengthInd] == 0) data[Step::lengthInd] = 1; // two ticks
-    switch (sequencer->getSequenceType(currentSequence))
+    const SequenceSnapshot* seqSnap = readCurrentSequence();
+    if (seqSnap == nullptr) return;
+    double stepNote = note;
+    switch (seqSnap->type)
     {
         case SequenceType::midiNote: // midi note - 0-127
         {
-        data[Step::note1Ind] = note; 
         break;
         }
         case SequenceType::drumMidi: // midi note - 0-127
         {
-        data[Step::note1Ind] = note; 
         break;
         }
         
         case SequenceType::transposer: // transposition - 0-12
         {
-        data[Step::note1Ind] = fmod(note, 12);
+        stepNote = fmod(note, 12);
         break;    
         }
         case SequenceType::lengthChanger:// length adjust - 0-12
         {
-        data[Step::note1Ind] = fmod(note, 12);
+        stepNote = fmod(note, 12);
         break;    
         }
         case SequenceType::tickChanger:// length adjust - 0-12
         {
-        data[Step::note1Ind] = fmod(note, 12);
+        stepNote = fmod(note, 12);
         break;    
         }
         
     }        
-    writeStepData(data);
+    // also sets a default vel and len if needed.
+    sequencer->enterStepNote(currentSequence, currentStep, stepNote);
     }
     // after note update in this mode, 
     // move to the next note
@@ -194,10 +194,7 @@ if (note < 0 || note > 127) return;
     // set channel on all notes for this sequence
     int channelI = (unsigned int) note;
     channelI = channelI % 16; // 16 channels
-    for (int step=0; step < sequencer->howManySteps(currentSequence); ++step)
-    {
-        sequencer->updateStepData(currentSequence, step, Step::channelInd, channelI);
-    }
+    sequencer->setSequenceChannel(currentSequence, channelI);
     }
 }
 
@@ -214,21 +211,19 @@ void SequencerEditor::moveCursorUp()
     {
         currentSequence -= 1;
         if (currentSequence < 0) currentSequence = 0;
-        if (currentStep >= sequencer->howManySteps(currentSequence)) currentStep = sequencer->howManySteps(currentSequence) - 1;
+        keepStepInSequence();
         break;
     }
     case SequencerEditorMode::selectingSeqAndStep:
     {
         currentSequence -= 1;
         if (currentSequence < 0) currentSequence = 0;
-        if (currentStep >= sequencer->howManySteps(currentSequence)) currentStep = sequencer->howManySteps(currentSequence) - 1;
+        keepStepInSequence();
         break;
     }
     case SequencerEditorMode::editingStep:
     {
-        std::vector<double> data = sequencer->getStepData(currentSequence, currentStep);
-        incrementStepData(data, sequencer->getSequenceType(currentSequence));
-        writeStepData(data);
+        changeStepData(true);
         break;  
     }
     case SequencerEditorMode::configuringSequence:
@@ -239,6 +234,7 @@ void SequencerEditor::moveCursorUp()
         break;
     }
     }
+    publishCursor();
 }
 
 void SequencerEditor::moveCursorDown()
@@ -249,21 +245,19 @@ void SequencerEditor::moveCursorDown()
     {
         currentSequence += 1;
         if (currentSequence >= sequencer->howManySequences()) currentSequence = sequencer->howManySequences() - 1;
-        if (currentStep >= sequencer->howManySteps(currentSequence)) currentStep = sequencer->howManySteps(currentSequence) - 1;
+        keepStepInSequence();
         break;
     }
     case SequencerEditorMode::selectingSeqAndStep:
     {
         currentSequence += 1;
         if (currentSequence >= sequencer->howManySequences()) currentSequence = sequencer->howManySequences() - 1;
-        if (currentStep >= sequencer->howManySteps(currentSequence)) currentStep = sequencer->howManySteps(currentSequence) - 1;
+        keepStepInSequence();
         break;
     }
     case SequencerEditorMode::editingStep:
     {
-        std::vector<double> data = sequencer->getStepData(currentSequence, currentStep);
-        decrementStepData(data, sequencer->getSequenceType(currentSequence));
-        writeStepData(data);
+        changeStepData(false);
         break;  
     }
     case SequencerEditorMode::configuringSequence:
@@ -272,6 +266,7 @@ void SequencerEditor::moveCursorDown()
         break;
     }
     }
+    publishCursor();
 }
 
 void SequencerEditor::moveCursorLeft()
@@ -300,10 +295,11 @@ void SequencerEditor::moveCursorLeft()
     }
     case SequencerEditorMode::configuringSequence:
     {
-        SequencerEditor::nextSequenceType(sequencer, currentSequence);
+        sequencer->cycleSequenceType(currentSequence);
         break;
     }
     }
+    publishCursor();
 }
 
 void SequencerEditor::moveCursorRight()
@@ -318,22 +314,23 @@ void SequencerEditor::moveCursorRight()
     case SequencerEditorMode::selectingSeqAndStep:
         {
         currentStep += 1;
-        if (currentStep >= sequencer->howManySteps(currentSequence)) currentStep = sequencer->howManySteps(currentSequence) - 1;
+        keepStepInSequence();
         break;
         }
     case SequencerEditorMode::editingStep:
     {
         currentStep += 1;
-        if (currentStep >= sequencer->howManySteps(currentSequence)) currentStep = sequencer->howManySteps(currentSequence) - 1; 
+        keepStepInSequence();
         break;  
     }
     case SequencerEditorMode::configuringSequence:
     {
     // right changes the type
-        SequencerEditor::nextSequenceType(sequencer, currentSequence);
+        sequencer->cycleSequenceType(currentSequence);
         break;
     }
     }
+    publishCursor();
 }
 
 SequencerEditorSubMode SequencerEditor::cycleSubModeLeft(SequencerEditorSubMode subMode)
@@ -373,69 +370,12 @@ SequencerEditorSubMode SequencerEditor::cycleSubModeRight(SequencerEditorSubMode
 */
 void SequencerEditor::decrementStepData(std::vector<double>& data, SequenceType seqType)
 {
-  double decrement{0};
-  double targetIndex{Step::note1Ind};
-  double min{0};
-
-  // figure out the increment
-  switch(seqType)
-  {
-    case SequenceType::midiNote: // octave adjust
-    {
-      decrement = 12;
-      break;
-    }
-    case SequenceType::drumMidi: 
-    {
-      decrement = 1;
-      break;
-    }
-    
-    case SequenceType::transposer: // up 1
-    {
-      decrement = 1;
-      min = -24;
-      break;
-    }
-    case SequenceType::lengthChanger: // up 1
-    {
-      decrement = 1;
-      min = -8;
-      break;
-    }
-    case SequenceType::tickChanger: // up 1
-    {
-      decrement = 1;
-      break;
-    }
-    
-  }
-  // figure out the target of editing, as they are cycling 
-  // through the items of data
-  switch(editSubMode)
-  {
-    case SequencerEditorSubMode::editCol1:
-    {
-      targetIndex = Step::note1Ind;
-      break;
-    }
-    case SequencerEditorSubMode::editCol2:
-    {
-      targetIndex = Step::lengthInd;
-      decrement = 1;// 1 for length
-      break;
-    }
-    case SequencerEditorSubMode::editCol3:
-    {
-      targetIndex = Step::velInd;
-      decrement = 10;// 10 for vel
-      break;
-    }
-  }
-  double now = data[targetIndex];
+  unsigned int targetIndex;
+  double decrement;
+  double min;
+  getStepDataChange(seqType, false, targetIndex, decrement, min);
   data[targetIndex] -= decrement;
   if (data[targetIndex] < min) data[targetIndex] = min;
-
 }
 
 
@@ -444,41 +384,50 @@ void SequencerEditor::decrementStepData(std::vector<double>& data, SequenceType
 */
 void SequencerEditor::incrementStepData(std::vector<double>& data, SequenceType seqType)
 {
-  double increment{0};
-  double targetIndex{Step::note1Ind};
-  double max{127};
+  unsigned int targetIndex;
+  double increment;
+  double max;
+  getStepDataChange(seqType, true, targetIndex, increment, max);
+  data[targetIndex] += increment;
+  if (data[targetIndex] > max) data[targetIndex] = max;
+}
+
+void SequencerEditor::getStepDataChange(SequenceType seqType, bool up, unsigned int& dataInd, double& amount, double& limit) const
+{
+  amount = 0;
+  dataInd = Step::note1Ind;
+  limit = up ? 127 : 0;
 
   // figure out the increment
   switch(seqType)
   {
     case SequenceType::midiNote: // octave adjust
     {
-      increment = 12;
+      amount = 12;
       break;
     }
-    case SequenceType::drumMidi: // octave adjust
+    case SequenceType::drumMidi: 
     {
-      increment = 1;
+      amount = 1;
       break;
     }
     case SequenceType::transposer: // up 1
     {
-      increment = 1;
-      max = 24;
+      amount = 1;
+      limit = up ? 24 : -24;
       break;
     }
     case SequenceType::lengthChanger: // up 1
     {
-      increment = 1;
-      max = 8;
+      amount = 1;
+      limit = up ? 8 : -8;
       break;
     }
     case SequenceType::tickChanger: // up 1
     {
-      increment = 1;
+      amount = 1;
       break;
     }
-  
   }
   // figure out the target of editing, as they are cycling 
   // through the items of data
@@ -486,27 +435,52 @@ void SequencerEditor::incrementStepData(std::vector<double>& data, SequenceType
   {
     case SequencerEditorSubMode::editCol1:
     {
-      targetIndex = Step::note1Ind;
+      dataInd = Step::note1Ind;
       break;
     }
     case SequencerEditorSubMode::editCol2:
     {
-      targetIndex = Step::lengthInd;
-      increment = 1;// reset the increment if it is editing the length
+      dataInd = Step::lengthInd;
+      amount = 1;// 1 for length
       break;
     }
     case SequencerEditorSubMode::editCol3:
     {
-      targetIndex = Step::velInd;
-      increment = 10; // vel goes up 10 at a time
+      dataInd = Step::velInd;
+      amount = 10;// vel goes 10 at a time
       break;
     }
   }
-  double now = data[targetIndex];
-  data[targetIndex] += increment;
-  if (data[targetIndex] > max) data[targetIndex] = max;
+}
 
+void SequencerEditor::changeStepData(bool up)
+{
+  const SequenceSnapshot* seqSnap = readCurrentSequence();
+  if (seqSnap == nullptr) return;
+  unsigned int dataInd;
+  double amount;
+  double limit;
+  getStepDataChange(seqSnap->type, up, dataInd, amount, limit);
+  // the sequencer adds it when it applies the edit, so quick presses all count
+  if (up) sequencer->addToStepData(currentSequence, currentStep, dataInd, amount, std::numeric_limits<double>::lowest(), limit);
+  else sequencer->addToStepData(currentSequence, currentStep, dataInd, -amount, limit, std::numeric_limits<double>::max());
 }
+
+const SequenceSnapshot* SequencerEditor::readCurrentSequence()
+{
+  sequencer->readSnapshot(snapshot);
+  if (currentSequence < 0 || currentSequence >= snapshot.sequenceCount) return nullptr;
+  return &snapshot.sequences[currentSequence];
+}
+
+void SequencerEditor::keepStepInSequence()
+{
+  const SequenceSnapshot* seqSnap = readCurrentSequence();
+  int length = seqSnap == nullptr ? 0 : seqSnap->length;
+  if (currentStep >= length) currentStep = length - 1;
+  if (currentStep < 0) currentStep = 0;
+}
+
 /** increase the value of the seq param relating to the 
  * current subMode
 */
@@ -518,7 +492,7 @@ void SequencerEditor::incrementSeqConfigParam()
       incrementChannel(); 
       break;
     case SequencerEditorSubMode::editCol2: // type
-      SequencerEditor::nextSequenceType(sequencer, currentSequence);
+      sequencer->cycleSequenceType(currentSequence);
       break;
     case SequencerEditorSubMode::editCol3: // ticks per step
       incrementTicksPerStep();
@@ -546,66 +520,28 @@ void SequencerEditor::decrementSeqConfigParam()
 
 void SequencerEditor::incrementChannel()
 {
-    std::vector<double> data2 = sequencer->getStepData(currentSequence, 0);
-    int channel = data2[Step::channelInd];
-    channel = (channel + 1) % 16;
-    for (int step=0; step < sequencer->howManySteps(currentSequence); ++step)
-    {
-      sequencer->updateStepData(currentSequence, step, Step::channelInd, channel);
-    }
+    sequencer->shiftSequenceChannel(currentSequence, 1);
 }
 void SequencerEditor::decrementChannel()
 {
     // set the channel based on step 0
-    std::vector<double> data2 = sequencer->getStepData(currentSequence, 0);
-    unsigned int channel = data2[Step::channelInd];
-    channel = (channel - 1) % 16;
-    if (channel > 16) channel = 16;
-    if (channel < 0) channel = 0;    
-    for (int step=0; step < sequencer->howManySteps(currentSequence); ++step)
-    {
-      sequencer->updateStepData(currentSequence, step, Step::channelInd, channel);
-    }
+    sequencer->shiftSequenceChannel(currentSequence, -1);
 }
 
 void SequencerEditor::incrementTicksPerStep()
 {
-  int tps = sequencer->getSequence(currentSequence)->getTicksPerStep();
-  tps ++;
-  if (tps > 8) tps = 1; 
-  sequencer->getSequence(currentSequence)->setTicksPerStep(tps) ;
+  // goes round to 1 past 8
+  sequencer->changeSequenceTicksPerStep(currentSequence, 1);
 }
 void SequencerEditor::decrementTicksPerStep()
 {
-  int tps = sequencer->getSequence(currentSequence)->getTicksPerStep();
-  tps --;
-  if (tps == 0) tps = 1; 
-  sequencer->getSequence(currentSequence)->setTicksPerStep(tps) ;
-  
+  sequencer->changeSequenceTicksPerStep(currentSequence, -1);
 }
 
 
 void SequencerEditor::nextSequenceType(Sequencer* seqr, unsigned int sequence)
  {
-   SequenceType type = seqr->getSequenceType(sequence);
-   switch (type){
-     case SequenceType::midiNote:
-      seqr->setSequenceType(sequence, SequenceType::drumMidi);
-      break;
-     case SequenceType::drumMidi:
-      seqr->setSequenceType(sequence, SequenceType::transposer);
-      break;
-     case SequenceType::transposer:
-      seqr->setSequenceType(sequence, SequenceType::lengthChanger);
-      break;
-     case SequenceType::lengthChanger:
-      seqr->setSequenceType(sequence, SequenceType::tickChanger);   
-      break;
-     case SequenceType::tickChanger:
-      seqr->setSequenceType(sequence, SequenceType::midiNote);   
-      break;
-      
-   } 
+   seqr->cycleSequenceType(sequence);
  }
 
 
@@ -618,6 +554,28 @@ int SequencerEditor::getCurrentStep() const
 {
 return currentStep;
 }
+
+EditorCursor SequencerEditor::getCursor() const
+{
+  uint64_t packed = publishedCursor.load(std::memory_order_acquire);
+  EditorCursor cursor;
+  cursor.sequence = (uint16_t) packed;
+  cursor.step = (uint16_t) (packed >> 16);
+  cursor.mode = (SequencerEditorMode) ((packed >> 32) & 0xff);
+  cursor.subMode = (SequencerEditorSubMode) ((packed >> 40) & 0xff);
+  return cursor;
+}
+
+void SequencerEditor::publishCursor()
+{
+  // one word so a reader never sees half of a move
+  uint64_t packed = (uint64_t) (uint16_t) currentSequence 
+                  | (uint64_t) (uint16_t) currentStep << 16
+                  | (uint64_t) editMode << 32
+                  | (uint64_t) editSubMode << 40;
+  publishedCursor.store(packed, std::memory_order_release);
+}
+
 /** which data point in a step are we editing */
 int SequencerEditor::getCurrentStepIndex() const
 {
@@ -627,11 +585,13 @@ return currentStepIndex;
 void SequencerEditor::setCurrentSequence(int seq)
 {
 currentSequence = seq;
+publishCursor();
 }
 /** move the cursor to a specific step*/
 void SequencerEditor::setCurrentStep(int step)
 {
 currentStep = step;
+publishCursor();
 }
 /** write the sent data to the current step and sequence */
 void SequencerEditor::writeStepData(std::vector<double> data)
@@ -641,19 +601,23 @@ sequencer->setStepData(currentSequence, currentStep, data);
 /** write the sent data to the sequence at 'currentSequence' - 1D data version for simple one value per step -style sequences*/
 void SequencerEditor::writeSequenceData(std::vector<double> data)
 {
+const SequenceSnapshot* seqSnap = readCurrentSequence();
+if (seqSnap == nullptr) return;
 std::vector<double> stepData = {0};
-for (int i=0; i<sequencer->howManySteps(currentSequence); ++i)
+for (int i=0; i<seqSnap->length; ++i)
 {
     stepData[0] = data[i % data.size()]; // wrap it around :) 
-    sequencer->setStepData(currentSequence, currentSequence, stepData);
+    sequencer->setStepData(currentSequence, i, stepData);
 }
 }
 /** write the sent data to a sequence - 1D data version */
 void SequencerEditor::writeSequenceData(std::vector<std::vector<double>> data)
 {
-for (int i=0; i<sequencer->howManySteps(currentSequence); ++i)
+const SequenceSnapshot* seqSnap = readCurrentSequence();
+if (seqSnap == nullptr) return;
+for (int i=0; i<seqSnap->length; ++i)
 {
-    sequencer->setStepData(currentSequence, currentSequence, data[i % data.size()]); // wrap around
+    sequencer->setStepData(currentSequence, i, data[i % data.size()]); // wrap around
 }
 }
 
@@ -669,24 +633,43 @@ SequencerViewer::SequencerViewer(){}
 std::string SequencerViewer::toTextDisplay(const int rows, const int cols,  Sequencer* sequencer, const SequencerEditor* editor)
 {  
     //assert(sequencer == editor->getSequencer()); 
+    SequencerSnapshot snapshot;
+    sequencer->makeSnapshot(snapshot);
+    return toTextDisplay(rows, cols, snapshot, editor->getCursor());
+}
 
-    switch(editor->getEditMode())
+std::string SequencerViewer::toTextDisplay(const int rows, const int cols, const SequencerSnapshot& snapshot, const EditorCursor& cursor)
+{
+    unsigned int sequence = cursor.sequence;
+    unsigned int step = cursor.step;
+    if (sequence >= snapshot.sequenceCount) return "Nothing to draw...";
+    const SequenceSnapshot& seqSnap = snapshot.sequences[sequence];
+    switch(cursor.mode)
     {
     case SequencerEditorMode::settingSeqLength:
-        return getSequencerView(rows, cols, sequencer, editor);
+        return getSequencerView(rows, cols, snapshot, cursor);
     case SequencerEditorMode::selectingSeqAndStep:
-        return getSequencerView(rows, cols, sequencer, editor);
+        return getSequencerView(rows, cols, snapshot, cursor);
     case SequencerEditorMode::configuringSequence:
-        return getSequenceConfigView((unsigned int) sequencer->getStepData(editor->getCurrentSequence(), 0)[Step::channelInd], 
-                                    sequencer->getSequenceType(editor->getCurrentSequence()), 
-                                    sequencer->getSequenceTicksPerStep(editor->getCurrentSequence()), 
-                                    editor->getEditSubMode());
+        return getSequenceConfigView(seqSnap.steps[0].channel, 
+                                    seqSnap.type, 
+                                    seqSnap.ticksPerStep, 
+                                    cursor.subMode);
     case SequencerEditorMode::editingStep:
-        return getStepView(sequencer->getStepData(editor->getCurrentSequence(), editor->getCurrentStep()), 
-                            sequencer->isStepActive(editor->getCurrentSequence(), editor->getCurrentStep()),
-                            editor->getEditSubMode(), 
-                            editor->getCurrentStep(), 
-                            sequencer->getCurrentStep(editor->getCurrentSequence()));
+    {
+        if (step >= seqSnap.length) return "Nothing to draw...";
+        const StepSnapshot& stepSnap = seqSnap.steps[step];
+        std::vector<double> stepData(Step::dataSize);
+        stepData[Step::channelInd] = stepSnap.channel;
+        stepData[Step::lengthInd] = stepSnap.length;
+        stepData[Step::velInd] = stepSnap.velocity;
+        stepData[Step::note1Ind] = stepSnap.note;
+        return getStepView(stepData, 
+                            stepSnap.active,
+                            cursor.subMode, 
+                            step, 
+                            seqSnap.currentStep);
+    }
     }
     return "Nothing to draw...";
 }
@@ -791,144 +774,98 @@ std::string SequencerViewer::getSequenceConfigView(const unsigned int channel, c
  * and make two separate functions even if they are really similar
  */
 
-std::string SequencerViewer::getSequencerView(const int max_rows, const int cols,  Sequencer* sequencer, const SequencerEditor* editor)
+std::string SequencerViewer::getSequencerView(const int max_rows, const int cols,  const SequencerSnapshot& snapshot, const EditorCursor& cursor)
 {
-    std::map<int,char> noteToDrum = MidiUtils::getIntToDrumMap();
-    std::map<int,char> noteToNote = MidiUtils::getIntToNoteMap();
-    
-
+    TextGrid grid;
+    renderSequencerView(grid, max_rows, cols, snapshot, cursor);
+    return grid.toString();
+}
 
-// fix to display key info at the end of the row 
-//cols = cols - 3;
-// only display as many sequences as we have
-    int rows;
-    if (max_rows > sequencer->howManySequences()) 
+/** the character for one step in the sequencer view */
+static char getSequencerViewCell(const SequenceSnapshot& seqSnap, 
+                                unsigned int displaySeq, unsigned int displayStep, 
+                                SequencerEditorMode mode, 
+                                unsigned int cursorSeq, unsigned int cursorStep)
+{
+    // in order of priority, lowest first:
+    // note or drum name, ^ or _ for transposers and length changers
+    // . : step with no data in step edit mode
+    //   : inactive step or gone past the end of the sequence
+    // > : in sequence length mode
+    // - : the sequencer is at this step 
+    // I : the editor is at this step
+    char state = 'o';
+    bool inSequence = displayStep < seqSnap.length;
+    if (inSequence)
     {
-        rows = sequencer->howManySequences();
-    }
-    else {
-        rows = max_rows;
+        const StepSnapshot& step = seqSnap.steps[displayStep];
+        switch (seqSnap.type)
+        {
+            case SequenceType::midiNote:
+                state = MidiUtils::getNoteName(step.note);
+                break;
+            case SequenceType::drumMidi:
+                state = MidiUtils::getDrumName(step.note);
+                break;
+            case SequenceType::transposer:
+            case SequenceType::lengthChanger:
+                state = step.note < 0 ? '_' : '^';
+                break;
+            default:
+                break;
+        }
+        if (mode == SequencerEditorMode::selectingSeqAndStep && step.note == 0) state = '.';
+        if (!step.active) state = ' ';
+        if (mode == SequencerEditorMode::settingSeqLength) state = '>';
     }
+    else state = ' ';
+    if (seqSnap.currentStep == displayStep) state = '-';
+    if (cursorSeq == displaySeq && cursorStep == displayStep) state = 'I';
+    return state;
+}
+
+void SequencerViewer::renderSequencerView(TextGrid& grid, const int max_rows, const int cols, const SequencerSnapshot& snapshot, const EditorCursor& cursor)
+{
+    grid.clear();
+// only display as many sequences as we have
+    int rows = max_rows;
+    if (rows > (int) snapshot.sequenceCount) rows = snapshot.sequenceCount;
+    if (rows > TextGrid::maxRows) rows = TextGrid::maxRows;
+
+    SequencerEditorMode mode = cursor.mode;
+    unsigned int cursorSeq = cursor.sequence;
+    unsigned int cursorStep = cursor.step;
 
 // the editor cursor dictates which bit we show
-    std::string disp{""};
-    // we display the bit of the sequences
-    // that the editor is looking at
-    int seqOffset = 0;//-editor->getCurrentSequence();
-    if (editor->getCurrentSequence() >= rows)
+    int seqOffset = 0;
+    if (cursorSeq >= rows)
     {
-        seqOffset = editor->getCurrentSequence() - 1;
+        seqOffset = cursorSeq - 1;
     }
-  
-    int stepOffset = 0;//editor->getCurrentStep();
-
-    if (editor->getCurrentStep() > cols - 4)
+    int stepOffset = 0;
+    if (cursorStep > cols - 4)
     {
-        stepOffset = editor->getCurrentStep();
+        stepOffset = cursorStep;
     }
-    int displaySeq, displayStep;
-    std::string preview {""};
     for (int seq=0;seq<rows;++seq)
     {
-        displaySeq = seq + seqOffset;
-        if (displaySeq > sequencer->howManySequences()) break;
-    // the first thing is the channel number
-        disp += std::to_string(displaySeq);
-    // space pad it
-        if (displaySeq < 9) disp += " ";
-        char state{'o'};// default
-
-        for (int step=0;step<cols - 3;++step) // -3 as we we used 3 chars already
-        
+        unsigned int displaySeq = seq + seqOffset;
+        if (displaySeq >= snapshot.sequenceCount) break;
+        const SequenceSnapshot& seqSnap = snapshot.sequences[displaySeq];
+        char* row = grid.cells[seq];
+        int len = 0;
+    // the first thing is the sequence number, space padded 
+        if (displaySeq >= 10) row[len++] = '0' + (displaySeq / 10) % 10;
+        row[len++] = '0' + displaySeq % 10;
+        if (displaySeq < 9) row[len++] = ' ';
+        for (int step=0;step<cols - 3 && len < TextGrid::maxCols;++step) // -3 as we we used 3 chars already
         {
-            displayStep = step + stepOffset;
-            if (step>0) disp += state;
-            
-            // three choices, in order of priority as two can be true:
-            // I : the editor is at this step
-            // - : the sequencer is at this step 
-            // o : neither the editor or sequencer are at step
-            //   : gone past the end of the sequence
-            state = 'o';    
-            // get note name
-            if (sequencer->howManySteps(displaySeq) > displayStep  && 
-                sequencer->getSequenceType(displaySeq) == SequenceType::midiNote)
-            {
-            state = noteToNote[
-                ((int) sequencer->getStepDataDirect(displaySeq, displayStep)->at(Step::note1Ind))
-                % 12
-            ];
-            }
-            if (sequencer->howManySteps(displaySeq) > displayStep  && 
-                sequencer->getSequenceType(displaySeq) == SequenceType::drumMidi)
-            {
-            state = noteToDrum[
-                ((int) sequencer->getStepDataDirect(displaySeq, displayStep)->at(Step::note1Ind))
-                % 12
-            ];
-            }
-            if (sequencer->howManySteps(displaySeq) > displayStep  && 
-                (sequencer->getSequenceType(displaySeq) == SequenceType::transposer ||
-                sequencer->getSequenceType(displaySeq) == SequenceType::lengthChanger
-                )
-                )
-            {
-            if (sequencer->getStepDataDirect(displaySeq, displayStep)->at(Step::note1Ind)
-                < 0)
-                state = '_'; // down
-            else 
-                state = '^'; // up         
-            }
-            
-            
-            // in step edit mode, printing a particular step
-            // that does not have data
-            if (editor->getEditMode() == SequencerEditorMode::selectingSeqAndStep && 
-                sequencer->howManySteps(displaySeq) > displayStep && 
-                sequencer->getStepDataDirect(displaySeq, displayStep)->at(Step::note1Ind) == 0)
-            {
-            state = '.';
-            } 
-        
-            // inactive/ shortened/ non-existent sequence   
-            if ((sequencer->howManySteps(displaySeq) <= displayStep || 
-                sequencer->isStepActive(displaySeq, displayStep) == false)) 
-            {
-            state = ' ';
-            }
-            // sequence length mode
-            if (editor->getEditMode() == SequencerEditorMode::settingSeqLength && 
-                sequencer->howManySteps(displaySeq) > displayStep) 
-            {
-            state = '>';
-            }
-
-            // override inactive ' ' for 
-            // sequencer playback is at this position
-            if (sequencer->getCurrentStep(displaySeq) == displayStep) 
-            {
-            state = '-';
-            }
-            
-            // cursor is at this position
-            if (editor->getCurrentSequence() == displaySeq &&
-                editor->getCurrentStep() == displayStep 
-                //&& sequencer->isStepActive(displaySeq, displayStep 
-                ) 
-            {
-            state = 'I';  
-            }          
+            row[len++] = getSequencerViewCell(seqSnap, displaySeq, step + stepOffset, mode, cursorSeq, cursorStep);
         }
-
-        disp += state;
-
-        if (seq < rows - 1)
-        {
-            disp += preview + "\n";
-            preview = "";
-        }
-    }    
-    return disp;
-}   
+        row[len] = 0;
+        grid.rowLengths[seq] = len;
+        grid.rows = seq + 1;
+    }
+}
 
 
@@ -1,5 +1,7 @@
 /** TODO: split this to h and cpp */
 #include "Sequencer.h"
+#include <atomic>
+#include <cstdint>
 
 /**
  * Top level modes that dictate the main UI output 
@@ -11,9 +13,22 @@ enum class SequencerEditorMode {settingSeqLength, configuringSequence, selecting
  **/
 enum class SequencerEditorSubMode {editCol1, editCol2, editCol3};
 
+/** where an editor's cursor is and what it is doing, as one copy 
+ * that can be drawn on another thread
+ */
+struct EditorCursor {
+  int sequence;
+  int step;
+  SequencerEditorMode mode;
+  SequencerEditorSubMode subMode;
+};
+
 /** Represents an editor for a sequencer, which allows stateful edit operations to be applied 
  * to sequences. For example, select sequemce, select step, enter data
- * Used to build editing interfaces for a sequencer 
+ * Used to build editing interfaces for a sequencer.
+ * It only reads the sequencer's published snapshot and makes relative edits 
+ * the sequencer works out when it applies them, so it can run on a UI thread 
+ * while another thread ticks the sequencer with its edit queue enabled
 */
 class SequencerEditor {
   public:
@@ -80,6 +95,7 @@ class SequencerEditor {
   */
   void decrementSeqConfigParam();
 
+  /** move the current sequence on to the next channel, all steps take step 0's channel plus 1*/
   void incrementChannel();
   void decrementChannel();
   void incrementTicksPerStep();
@@ -88,6 +104,10 @@ class SequencerEditor {
   int getCurrentSequence() const;
   /**  */
   int getCurrentStep() const;
+  /** the cursor and mode as of the last edit. Lock free and safe from any thread, 
+   * e.g. a render thread, unlike the other getters which are for the editing thread
+   */
+  EditorCursor getCursor() const;
   /** which data point in a step are we editing */
   int getCurrentStepIndex() const;
   /** move the cursor to a specific sequence*/
@@ -113,6 +133,64 @@ class SequencerEditor {
     SequencerEditorMode editMode;
     SequencerEditorSubMode editSubMode;
     double stepIncrement;    
+    /** the last copy of the sequencer's state read by readCurrentSequence*/
+    SequencerSnapshot snapshot;
+    /** the cursor and modes packed into one value for getCursor */
+    std::atomic<uint64_t> publishedCursor;
+
+    /** make the cursor and modes visible to getCursor, after anything changes them */
+    void publishCursor();
+    /** read the latest snapshot, nullptr if the current sequence is not in it */
+    const SequenceSnapshot* readCurrentSequence();
+    /** keep the cursor inside the current sequence's steps */
+    void keepStepInSequence();
+    /** work out which step value the arrow keys change and by how much, 
+     * based on the sequence type and edit sub mode. 
+     * limit is the lowest value going down or the highest going up
+     */
+    void getStepDataChange(SequenceType seqType, bool up, unsigned int& dataInd, double& amount, double& limit) const;
+    /** queue a change to the current step's data, as the arrow keys do in editingStep mode */
+    void changeStepData(bool up);
+};
+
+/** A fixed size block of text the viewer can draw into without allocating,
+ * so a caller can keep one and redraw into it every frame.
+ * Each row is null terminated.
+ */
+struct TextGrid
+{
+  static const int maxRows = 16;
+  static const int maxCols = 64;
+  char cells[maxRows][maxCols + 1];
+  int rowLengths[maxRows];
+  int rows;
+
+  TextGrid()
+  {
+    clear();
+  }
+  void clear()
+  {
+    for (int row = 0; row < maxRows; ++row)
+    {
+      cells[row][0] = 0;
+      rowLengths[row] = 0;
+    }
+    rows = 0;
+  }
+  /** the rows joined with newlines. This allocates, so it is for
+   * when a string is needed, e.g. to send to a display
+  */
+  std::string toString() const
+  {
+    std::string text;
+    for (int row = 0; row < rows; ++row)
+    {
+      if (row > 0) text += '\n';
+      text.append(cells[row], rowLengths[row]);
+    }
+    return text;
+  }
 };
 
 /** Provides functions to generate string-based views of the sequencer
@@ -122,7 +200,11 @@ class SequencerViewer{
   public:
     SequencerViewer();
 
+    /** draws the live state of the sequencer, so call it from the thread that ticks it */
     static std::string toTextDisplay(const int rows, const int cols, Sequencer* sequencer, const SequencerEditor* editor);
+    /** draws from a snapshot, e.g. one from Sequencer::readSnapshot on another thread, 
+     * with a cursor from SequencerEditor::getCursor */
+    static std::string toTextDisplay(const int rows, const int cols, const SequencerSnapshot& snapshot, const EditorCursor& cursor);
 
     /**
      * Returns a view of an individual step based on the sent step data
@@ -149,7 +231,11 @@ class SequencerViewer{
      * and make two separate functions even if they are really similar
      */
    
-    static std::string getSequencerView(const int max_rows, const int cols,  Sequencer* sequencer, const SequencerEditor* editor);
+    static std::string getSequencerView(const int max_rows, const int cols, const SequencerSnapshot& snapshot, const EditorCursor& cursor);
+    /** draws the same view as getSequencerView into a caller owned grid, without allocating.
+     * Rows and columns past the grid's size are left out
+     */
+    static void renderSequencerView(TextGrid& grid, const int max_rows, const int cols, const SequencerSnapshot& snapshot, const EditorCursor& cursor);
    
 }; 
 
@@ -4,14 +4,107 @@
 #include <chrono>
 #include <functional>
 #include <iostream>
+#include <atomic>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <errno.h>
+#include <time.h>
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "LatencyHistogram.h"
 
+/** tell the cpu this is a spin-wait loop: it saves power and lets 
+ * the other hardware thread on the core run
+*/
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  asm volatile("yield");
+#endif
+}
+
+/** how the clock thread should run, see SimpleClock::setRealTime. 
+ * The defaults ask for nothing, i.e. an ordinary thread
+*/
+struct ClockRealTimeSettings{
+  /** SCHED_FIFO priority from 1 to 99, 0 for the normal scheduler*/
+  int priority{0};
+  /** lock all of the process's memory, now and future, with mlockall 
+   * so the clock never waits for a page fault
+  */
+  bool lockMemory{false};
+  /** how many bytes of the clock thread's stack to touch before the first tick
+   * so they are paged in. Keep it well under the thread's stack size
+  */
+  std::size_t prefaultStackBytes{0};
+  /** cpu to pin the clock thread to, ideally one kept free with the isolcpus 
+   * kernel parameter. -1 for any cpu
+  */
+  int cpu{-1};
+};
+
+/** which of the real time settings the clock thread actually got*/
+struct ClockRealTimeStatus{
+  /** running under SCHED_FIFO*/
+  bool fifo{false};
+  /** the SCHED_FIFO priority, 0 if not fifo*/
+  int priority{0};
+  bool memoryLocked{false};
+  std::size_t stackPrefaultedBytes{0};
+  /** the cpu the thread is pinned to, -1 if not pinned*/
+  int cpu{-1};
+  /** is that cpu in the kernel's isolcpus list*/
+  bool cpuIsolated{false};
+  /** why each setting asked for and not got was not got, empty if all went through*/
+  std::string problems{};
+  std::string toString() const
+  {
+    std::string s = "clock thread: ";
+    s += fifo ? "SCHED_FIFO priority " + std::to_string(priority) : "normal scheduling";
+    s += memoryLocked ? ", memory locked" : ", memory not locked";
+    if (stackPrefaultedBytes > 0) s += ", " + std::to_string(stackPrefaultedBytes / 1024) + "KB stack prefaulted";
+    if (cpu >= 0) s += ", pinned to cpu " + std::to_string(cpu) + (cpuIsolated ? " (isolated)" : " (not isolated)");
+    if (problems != "") s += "\n" + problems;
+    return s;
+  }
+};
+
+/**
+ * Calls a callback at a fixed interval on its own thread.
+ * Ticks are scheduled as absolute deadlines on the monotonic clock
+ * (deadline n = start + n * interval) so lateness on one tick
+ * does not push back the ones after it and wall clock (NTP) steps
+ * have no effect.
+ * The interval can be changed or ramped while the clock runs, 
+ * the thread picks the change up between ticks and keeps going.
+ * In spin mode the thread sleeps until just before each deadline and
+ * busy-waits the rest, trading cpu time for less jitter.
+ */
 class SimpleClock 
 {
   public:
+    /** sleepTimeMs is kept for compatibility with older code;
+     * precision now comes from sleeping until absolute deadlines
+     */
     SimpleClock(int sleepTimeMs = 5, 
                 std::function<void()>callback = [](){
                     std::cout << "SimpleClock::default tick callback" << std::endl;
-                }) : sleepTimeMs{sleepTimeMs}, running{false}, callback{callback}, currentTick{0}
+                }) : sleepTimeMs{sleepTimeMs}, running{false}, callback{callback}, currentTick{0},
+                     lastDeadlineNs{0}, lastLatenessNs{0}, maxLatenessNs{0}, missedDeadlines{0}, 
+                     intervalNs{sleepTimeMs * (int64_t) 1000000}, ramping{false}, 
+                     targetIntervalNs{0}, rampDurationNs{0}, tempoRequests{0}, realTimeApplied{false},
+                     spinMode{false}, spinWindowNs{initialSpinWindowNs}, spinNs{0}, totalLatenessNs{0}, 
+                     timedTicks{0}, statsStartNs{0}, wakeOvershootNs{0}, wakeOvershootDevNs{0},
+                     seenTempoRequests{0}, rampStartRate{0}, rampEndRate{0}, rampStartNs{0}, rampEndNs{0}
      {
        // constructor body
      }
@@ -19,24 +112,98 @@ class SimpleClock
     ~SimpleClock()
     {
       stop();
-      delete tickThread;
     }
     /** start with the sent interval between calls the to callback*/
     void start(int intervalMs)
+    {
+      startNs(intervalMs * (int64_t) 1000000);
+    }
+    /** start with the sent interval in nanoseconds between calls to the callback.
+     * If the clock is running its thread is stopped and started again, 
+     * use setIntervalNs to change the interval without a restart
+    */
+    void startNs(int64_t intervalNs)
     {
       stop();
+      if (intervalNs < 1) intervalNs = 1;
+      this->intervalNs = intervalNs;
+      ramping = false;
+      resetLatencyStats();
       running = true;
-      tickThread = new std::thread(SimpleClock::ticker, this, intervalMs, sleepTimeMs);
+      realTimeApplied = false;
+      tickThread = std::thread(SimpleClock::ticker, this);
+      // so getRealTimeStatus is right as soon as start returns
+      while (!realTimeApplied) std::this_thread::yield();
+    }
+    /** start ticking ppqn times per quarter note at the sent tempo*/
+    void startBPM(double bpm, unsigned int ppqn)
+    {
+      startNs(SimpleClock::bpmToIntervalNs(bpm, ppqn));
+    }
+    /** nanoseconds between ticks at the sent tempo and resolution*/
+    static int64_t bpmToIntervalNs(double bpm, unsigned int ppqn)
+    {
+      return (int64_t) (60000000000.0 / (bpm * ppqn));
     }
 
     void stop()
     {
-      if (running)
+      running = false; 
+      if (tickThread.joinable()) tickThread.join(); 
+    }
+    /** change the interval from the next tick on. Lock free, so it can be called 
+     * from the tick callback. The phase carries on: the tick after next comes
+     * the new interval after the next one. Cancels a ramp in progress.
+     * Tempo changes should only come from one thread at a time
+    */
+    void setIntervalNs(int64_t intervalNs)
+    {
+      rampIntervalNs(intervalNs, 0);
+    }
+    void setBPM(double bpm, unsigned int ppqn)
+    {
+      setIntervalNs(SimpleClock::bpmToIntervalNs(bpm, ppqn));
+    }
+    /** move smoothly to the sent interval over durationNs, starting from the next tick.
+     * The tick rate changes evenly with time, so a ramp to a higher BPM is 
+     * a steady accelerando and to a lower one a steady ritardando.
+     * A new change takes over from wherever a ramp in progress has got to.
+     * Lock free, and like setIntervalNs should only be called from one thread at a time
+    */
+    void rampIntervalNs(int64_t intervalNs, int64_t durationNs)
+    {
+      if (intervalNs < 1) intervalNs = 1;
+      if (!running)
       {
-       //t << "SimpleClock::stop shutting down " << std::endl;
-        running = false; 
-        tickThread->join(); 
+        // nothing to ramp, it starts from here
+        this->intervalNs = intervalNs;
+        return;
       }
+      // the count is odd while the pair is written, so the clock thread
+      // never takes one request's interval with another's duration
+      uint32_t requests = tempoRequests.load(std::memory_order_relaxed);
+      tempoRequests.store(requests + 1, std::memory_order_relaxed);
+      targetIntervalNs.store(intervalNs, std::memory_order_release);
+      rampDurationNs.store(durationNs, std::memory_order_release);
+      tempoRequests.store(requests + 2, std::memory_order_release);
+    }
+    void rampBPM(double bpm, unsigned int ppqn, int64_t durationNs)
+    {
+      rampIntervalNs(SimpleClock::bpmToIntervalNs(bpm, ppqn), durationNs);
+    }
+    /** the interval the clock is ticking at now, part way through a ramp if there is one*/
+    int64_t getIntervalNs() const
+    {
+      return intervalNs;
+    }
+    /** the tempo the clock is ticking at now if there are ppqn ticks per quarter note*/
+    double getBPM(unsigned int ppqn) const
+    {
+      return 60000000000.0 / ((double) intervalNs * ppqn);
+    }
+    bool isRamping() const
+    {
+      return ramping;
     }
     /** set the function to be called when the click ticks */
     void setCallback(std::function<void()> c){
@@ -53,45 +220,399 @@ class SimpleClock
     {
       return currentTick;
     }
+    /** how late (ns) the most recent tick woke up compared to its deadline.
+     * Call it from the tick callback to get the lateness of the current tick
+    */
+    int64_t getLastLatenessNs() const
+    {
+      return lastLatenessNs;
+    }
+    /** the monotonic time in ns the most recent tick was due. From the tick callback 
+     * this is the current tick's exact place on the timeline, lateness aside
+    */
+    int64_t getLastDeadlineNs() const
+    {
+      return lastDeadlineNs;
+    }
+    /** worst lateness (ns) seen since start or the last resetLatencyStats */
+    int64_t getMaxLatenessNs() const
+    {
+      return maxLatenessNs;
+    }
+    /** how many ticks were so late that they ran after the next tick's deadline*/
+    long getMissedDeadlines() const
+    {
+      return missedDeadlines;
+    }
+    void resetLatencyStats()
+    {
+      lastLatenessNs = 0;
+      maxLatenessNs = 0;
+      missedDeadlines = 0;
+      spinNs = 0;
+      totalLatenessNs = 0;
+      timedTicks = 0;
+      statsStartNs = SimpleClock::getNowNs();
+      latenessHistogram.reset();
+      callbackHistogram.reset();
+    }
+    /** how late each tick woke up compared to its deadline, since start or the last resetLatencyStats.
+     * Safe to read from any thread while the clock runs
+    */
+    const LatencyHistogram& getLatenessHistogram() const
+    {
+      return latenessHistogram;
+    }
+    /** how long each tick's callback took*/
+    const LatencyHistogram& getCallbackHistogram() const
+    {
+      return callbackHistogram;
+    }
+    /** lateness and callback time percentiles and the missed deadlines, one per line*/
+    std::string getHistogramReport() const
+    {
+      return latenessHistogram.toString("tick lateness") + ", missed deadlines " 
+             + std::to_string(missedDeadlines) + "\n" 
+             + callbackHistogram.toString("tick callback");
+    }
+    /** mean lateness (ns) since start or the last resetLatencyStats*/
+    int64_t getAverageLatenessNs() const
+    {
+      long ticks = timedTicks;
+      return ticks == 0 ? 0 : totalLatenessNs / ticks;
+    }
+    /** when on, the clock thread sleeps until the spin window before each deadline
+     * then spins on the clock, so the tick does not wait on the scheduler to wake it.
+     * The window is tuned as it goes from how late the sleeps wake up.
+     * Works best with a real time priority on a cpu of its own (see setRealTime), 
+     * as the normal scheduler preempts threads that spin.
+     * Takes effect from the next tick
+    */
+    void setSpinMode(bool spin)
+    {
+      spinMode = spin;
+    }
+    bool isSpinMode() const
+    {
+      return spinMode;
+    }
+    /** how long before each deadline spin mode stops sleeping*/
+    int64_t getSpinWindowNs() const
+    {
+      return spinWindowNs;
+    }
+    /** ns spent spinning since start or the last resetLatencyStats*/
+    int64_t getSpinNs() const
+    {
+      return spinNs;
+    }
+    /** the part of one cpu spent spinning since start or the last resetLatencyStats*/
+    double getSpinCpuFraction() const
+    {
+      int64_t elapsedNs = lastDeadlineNs - statsStartNs;
+      return elapsedNs <= 0 ? 0 : (double) spinNs / elapsedNs;
+    }
+    /** a line giving the cpu the clock has spent spinning against the jitter it got, 
+     * to choose between spin mode and sleeping for each rig
+    */
+    std::string getTimingReport() const
+    {
+      std::string report = spinMode ? "clock spin mode, window " + std::to_string(spinWindowNs / 1000) + "us, " : "clock sleep mode, ";
+      report += std::to_string(getSpinCpuFraction() * 100) + "% cpu spinning, lateness average " 
+                + std::to_string(getAverageLatenessNs() / 1000.0) + "us max " 
+                + std::to_string(maxLatenessNs / 1000.0) + "us, missed deadlines " 
+                + std::to_string(missedDeadlines);
+      return report;
+    }
+    /** ask for the clock thread to run as a real time thread from the next start.
+     * Anything the process is not allowed to do, e.g. SCHED_FIFO without 
+     * CAP_SYS_NICE or an rtprio limit, is skipped and the clock runs without it.
+     * See getRealTimeStatus for what it got
+    */
+    void setRealTime(const ClockRealTimeSettings& settings)
+    {
+      realTimeSettings = settings;
+    }
+    const ClockRealTimeSettings& getRealTimeSettings() const
+    {
+      return realTimeSettings;
+    }
+    /** what the clock thread got of the real time settings when it was last started*/
+    ClockRealTimeStatus getRealTimeStatus() const
+    {
+      return realTimeStatus;
+    }
 
- static void ticker(SimpleClock* clock, long intervalMs, long sleepTimeMs)
+ static void ticker(SimpleClock* clock)
     {
-      long nowMs = 0;
-      long elapsedMs = 0;
-      long startTimeMs = SimpleClock::getNow();
-      long remainingMs;
+      clock->realTimeStatus = SimpleClock::applyRealTime(clock->realTimeSettings);
+      clock->beginTicking();
+      // start waits for this, so tempo changes made once start returns are not missed
+      clock->realTimeApplied = true;
+      // work out the deadlines from a fixed start point
+      // rather than from when the last tick happened
+      int64_t deadlineNs = SimpleClock::getNowNs() + clock->intervalNs;
       while(clock->running)
       {
-        nowMs = SimpleClock::getNow();
-        elapsedMs = nowMs - startTimeMs;
-        if (elapsedMs >= intervalMs) // time to tick
-        { 
-          // move the start time along
-          startTimeMs = nowMs;
-          //std::cout << "SimpleClock::ticker elapsed time  " << elapsedMs << " of " << intervalMs << std::endl;
-          clock->tick();
+        if (clock->spinMode) clock->sleepThenSpinUntilNs(deadlineNs, clock->intervalNs);
+        else SimpleClock::sleepUntilNs(deadlineNs);
+        if (!clock->running) break;
+        deadlineNs += clock->driveTick(deadlineNs);
+      }
+    }
+    /** start the clock without its own thread, for running its ticks from 
+     * another loop such as an EventReactor timer. That loop calls driveTick at 
+     * each deadline. Tempo changes, ramps and the stats work as when the clock has a thread
+    */
+    void startDriven(int64_t intervalNs)
+    {
+      stop();
+      if (intervalNs < 1) intervalNs = 1;
+      this->intervalNs = intervalNs;
+      ramping = false;
+      resetLatencyStats();
+      beginTicking();
+      running = true;
+    }
+    /** tick for the sent deadline, now due, and return the interval to the next one.
+     * Only call from one thread
+    */
+    int64_t driveTick(int64_t deadlineNs)
+    {
+      int64_t intervalNs = this->intervalNs;
+      int64_t latenessNs = SimpleClock::getNowNs() - deadlineNs;
+      lastDeadlineNs = deadlineNs;
+      lastLatenessNs = latenessNs;
+      totalLatenessNs += latenessNs;
+      timedTicks ++;
+      if (latenessNs > maxLatenessNs) maxLatenessNs = latenessNs;
+      // a whole interval late: still tick, the next deadline
+      // is already due so the clock catches up straight away
+      if (latenessNs >= intervalNs) missedDeadlines ++;
+      latenessHistogram.record(latenessNs);
+      int64_t callbackStartNs = SimpleClock::getNowNs();
+      tick();
+      callbackHistogram.record(SimpleClock::getNowNs() - callbackStartNs);
+      // tempo changes are picked up between ticks, so the next 
+      // deadline follows on from this one and the phase is kept
+      int64_t targetNs;
+      int64_t durationNs;
+      if (takeTempoRequest(targetNs, durationNs))
+      {
+        if (durationNs > 0)
+        {
+          rampStartRate = 1.0 / intervalNs;
+          rampEndRate = 1.0 / targetNs;
+          rampStartNs = deadlineNs;
+          rampEndNs = deadlineNs + durationNs;
+          ramping = true;
+        }
+        else 
+        {
+          intervalNs = targetNs;
+          ramping = false;
+        }
+      }
+      if (ramping)
+      {
+        double progress = (double) (deadlineNs - rampStartNs) / (rampEndNs - rampStartNs);
+        if (progress >= 1)
+        {
+          progress = 1;
+          ramping = false;
+        }
+        intervalNs = (int64_t) (1.0 / (rampStartRate + (rampEndRate - rampStartRate) * progress));
+      }
+      this->intervalNs = intervalNs;
+      return intervalNs;
+    }
+    /** current time on the monotonic clock in nanoseconds*/
+    static int64_t getNowNs()
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    /** sleep until the sent absolute monotonic time. steady_clock is CLOCK_MONOTONIC on linux*/
+    static void sleepUntilNs(int64_t deadlineNs)
+    {
+      struct timespec ts;
+      ts.tv_sec = deadlineNs / 1000000000;
+      ts.tv_nsec = deadlineNs % 1000000000;
+      // restart the sleep if a signal interrupts it
+      while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR){}
+    }
+    /** apply the settings to the calling thread, returning what it got*/
+    static ClockRealTimeStatus applyRealTime(const ClockRealTimeSettings& settings)
+    {
+      ClockRealTimeStatus status{};
+      // memory first so the stack pages touched below are locked too
+      if (settings.lockMemory)
+      {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) status.memoryLocked = true;
+        else status.problems += "mlockall failed: " + std::string(strerror(errno)) + "\n";
+      }
+      if (settings.prefaultStackBytes > 0)
+      {
+        SimpleClock::prefaultStack(settings.prefaultStackBytes);
+        status.stackPrefaultedBytes = settings.prefaultStackBytes;
+      }
+      if (settings.cpu >= 0)
+      {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        int err = EINVAL;
+        if (settings.cpu < CPU_SETSIZE)
+        {
+          CPU_SET(settings.cpu, &cpus);
+          err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
         }
-        else {
-          // sleep - but how much?
-          remainingMs = intervalMs - elapsedMs;
-          if (remainingMs > sleepTimeMs) // sleep as much as possible
-            std::this_thread::sleep_for(std::chrono::milliseconds(remainingMs - sleepTimeMs));
-          else
-            std::this_thread::sleep_for(std::chrono::milliseconds(sleepTimeMs));
+        if (err == 0)
+        {
+          status.cpu = settings.cpu;
+          status.cpuIsolated = SimpleClock::isCpuIsolated(settings.cpu);
         }
+        else status.problems += "pinning to cpu " + std::to_string(settings.cpu) + " failed: " + strerror(err) + "\n";
+      }
+      if (settings.priority > 0)
+      {
+        struct sched_param param{};
+        param.sched_priority = std::min(std::max(settings.priority, sched_get_priority_min(SCHED_FIFO)), 
+                                        sched_get_priority_max(SCHED_FIFO));
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0) status.problems += "SCHED_FIFO failed: " + std::string(strerror(err)) + "\n";
+      }
+      // report what the thread has, not what was asked for
+      int policy;
+      struct sched_param param{};
+      if (pthread_getschedparam(pthread_self(), &policy, &param) == 0 && policy == SCHED_FIFO)
+      {
+        status.fifo = true;
+        status.priority = param.sched_priority;
       }
+      if (status.problems != "") status.problems.pop_back(); // the last newline
+      return status;
+    }
+    /** is the cpu in the list of cpus isolated from the scheduler with isolcpus, 
+     * e.g. "2-3,5"
+    */
+    static bool isCpuIsolated(int cpu)
+    {
+      std::ifstream isolated{"/sys/devices/system/cpu/isolated"};
+      std::string range;
+      while (std::getline(isolated, range, ','))
+      {
+        if (range.empty() || range[0] < '0' || range[0] > '9') continue;
+        std::size_t dash = range.find('-');
+        int first = std::stoi(range);
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        if (cpu >= first && cpu <= last) return true;
+      }
+      return false;
     }
     
+
   private:
-    static long getNow()
+    /** read the latest tempo change if there is a new one, on the ticking thread.
+     * A read that overlaps rampIntervalNs writing the pair is left for the next
+     * tick rather than waiting for the other thread
+    */
+    bool takeTempoRequest(int64_t& targetNs, int64_t& durationNs)
+    {
+      uint32_t requests = tempoRequests.load(std::memory_order_acquire);
+      if (requests == seenTempoRequests || (requests & 1) != 0) return false;
+      targetNs = targetIntervalNs.load(std::memory_order_acquire);
+      durationNs = rampDurationNs.load(std::memory_order_acquire);
+      // changed while reading, the pair might be mixed
+      if (tempoRequests.load(std::memory_order_relaxed) != requests) return false;
+      seenTempoRequests = requests;
+      return true;
+    }
+    /** set up the state the ticking thread keeps between ticks*/
+    void beginTicking()
+    {
+      seenTempoRequests = tempoRequests.load(std::memory_order_acquire);
+      rampStartRate = 0;
+      rampEndRate = 0;
+      rampStartNs = 0;
+      rampEndNs = 0;
+    }
+    /** sleep until the spin window before the deadline, then spin until it. 
+     * How late the sleep wakes up tunes the window: it is kept at the mean
+     * overshoot plus four mean deviations, as for a tcp retransmit timer,
+     * so almost every wakeup lands inside it
+    */
+    void sleepThenSpinUntilNs(int64_t deadlineNs, int64_t intervalNs)
+    {
+      int64_t windowNs = spinWindowNs;
+      int64_t wakeNs = deadlineNs - windowNs;
+      SimpleClock::sleepUntilNs(wakeNs);
+      int64_t nowNs = SimpleClock::getNowNs();
+      double overshootNs = nowNs - wakeNs;
+      wakeOvershootNs += (overshootNs - wakeOvershootNs) / 8;
+      wakeOvershootDevNs += (std::abs(overshootNs - wakeOvershootNs) - wakeOvershootDevNs) / 4;
+      windowNs = (int64_t) (wakeOvershootNs + 4 * wakeOvershootDevNs);
+      // never spin for most of the interval
+      windowNs = std::min(windowNs, std::min(maxSpinWindowNs, intervalNs / 2));
+      spinWindowNs = std::max(windowNs, minSpinWindowNs);
+      int64_t spinStartNs = nowNs;
+      while (nowNs < deadlineNs)
+      {
+        cpuRelax();
+        nowNs = SimpleClock::getNowNs();
+      }
+      spinNs += nowNs - spinStartNs;
+    }
+    /** touch the next bytes of stack a page at a time so they are mapped in 
+     * before they are needed. Not inlined so the space is below the caller's frame
+    */
+    __attribute__((noinline)) static void prefaultStack(std::size_t bytes)
     {
-      return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+      volatile unsigned char* stack = (volatile unsigned char*) alloca(bytes);
+      long pageSize = sysconf(_SC_PAGESIZE);
+      for (std::size_t i = 0; i < bytes; i += pageSize) stack[i] = 0;
+      stack[bytes - 1] = 0;
     }
-    long intervalMs;
-    long sleepTimeMs; // lower means more precision in the timing
-    bool running;     
-    std::thread* tickThread;
+    long sleepTimeMs; // no longer used, see the constructor
+    std::atomic<bool> running;     
+    std::thread tickThread;
     std::function<void()> callback;
-    long currentTick;
+    std::atomic<long> currentTick;
+    std::atomic<int64_t> lastDeadlineNs;
+    std::atomic<int64_t> lastLatenessNs;
+    std::atomic<int64_t> maxLatenessNs;
+    std::atomic<long> missedDeadlines;
+    LatencyHistogram latenessHistogram;
+    LatencyHistogram callbackHistogram;
+    /** the interval now, written by the clock thread while it runs*/
+    std::atomic<int64_t> intervalNs;
+    std::atomic<bool> ramping;
+    // the latest tempo change, read by the clock thread 
+    // when tempoRequests goes up to an even count
+    std::atomic<int64_t> targetIntervalNs;
+    std::atomic<int64_t> rampDurationNs;
+    std::atomic<uint32_t> tempoRequests;
+    ClockRealTimeSettings realTimeSettings;
+    /** written by the clock thread before it sets realTimeApplied*/
+    ClockRealTimeStatus realTimeStatus;
+    std::atomic<bool> realTimeApplied;
+    constexpr static int64_t initialSpinWindowNs{200000};
+    constexpr static int64_t minSpinWindowNs{10000};
+    constexpr static int64_t maxSpinWindowNs{2000000};
+    std::atomic<bool> spinMode;
+    std::atomic<int64_t> spinWindowNs;
+    std::atomic<int64_t> spinNs;
+    std::atomic<int64_t> totalLatenessNs;
+    std::atomic<long> timedTicks;
+    std::atomic<int64_t> statsStartNs;
+    // running means of how late the spin mode sleeps wake up, 
+    // only used on the clock thread
+    double wakeOvershootNs;
+    double wakeOvershootDevNs;
+    // only used by the ticking thread: the tempo changes it has seen, and
+    // the ramp, from one tick rate (ticks per ns) to another evenly over time
+    uint32_t seenTempoRequests;
+    double rampStartRate;
+    double rampEndRate;
+    int64_t rampStartNs;
+    int64_t rampEndNs;
 };
 
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Fixed size ring buffer for passing values from one thread to one other thread.
+ * push and pop are wait free and never allocate: push fails
+ * when the ring is full and pop fails when it is empty.
+ * Only one thread may push and only one thread may pop.
+ */
+template<typename T>
+class SpscRing
+{
+  public:
+    /** capacity is rounded up to a power of 2 */
+    SpscRing(std::size_t capacity = 1024) : readPos{0}, writePos{0}
+    {
+      std::size_t size = 2;
+      while (size < capacity) size <<= 1;
+      buffer.resize(size);
+      mask = size - 1;
+    }
+    /** producer thread only. Returns false if the ring is full */
+    bool push(const T& value)
+    {
+      std::size_t write = writePos.load(std::memory_order_relaxed);
+      if (write - readPos.load(std::memory_order_acquire) > mask) return false;
+      buffer[write & mask] = value;
+      writePos.store(write + 1, std::memory_order_release);
+      return true;
+    }
+    /** consumer thread only. Returns false if the ring is empty */
+    bool pop(T& value)
+    {
+      std::size_t read = readPos.load(std::memory_order_relaxed);
+      if (read == writePos.load(std::memory_order_acquire)) return false;
+      value = buffer[read & mask];
+      readPos.store(read + 1, std::memory_order_release);
+      return true;
+    }
+    /** how many values are waiting. Exact only on the consumer thread when nothing is pushing */
+    std::size_t size() const
+    {
+      return writePos.load(std::memory_order_acquire) - readPos.load(std::memory_order_acquire);
+    }
+    bool empty() const
+    {
+      return size() == 0;
+    }
+    std::size_t capacity() const
+    {
+      return mask + 1;
+    }
+  private:
+    std::vector<T> buffer;
+    std::size_t mask;
+    // on separate cache lines so the two threads do not fight over them
+    alignas(64) std::atomic<std::size_t> readPos;
+    alignas(64) std::atomic<std::size_t> writePos;
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * A persistent pool of threads for splitting a tick's work up.
+ * run hands out tasks 0 to count-1 in one contiguous range per thread,
+ * the calling thread being one of them. A thread that finishes its own range
+ * steals tasks from the far end of the others', so one slow task does not
+ * hold up the rest. Each range is a begin and end packed into one atomic word,
+ * so taking a task is a single compare and swap and run never allocates.
+ * Only one thread at a time may call run.
+*/
+class TickPool
+{
+  public:
+    /** threads is how many threads to start on top of the one calling run*/
+    TickPool(unsigned int threads) :
+      participants{threads + 1}, ranges{new std::atomic<uint64_t>[threads + 1]},
+      running{true}, generation{0}, remaining{0}, stolenCount{0},
+      taskContext{nullptr}, taskCall{nullptr}
+    {
+      for (unsigned int p = 0; p < participants; ++p) ranges[p] = 0;
+      for (unsigned int p = 1; p < participants; ++p)
+      {
+        workers.push_back(std::thread(&TickPool::runWorker, this, p));
+      }
+    }
+    ~TickPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock{waitMutex};
+        running = false;
+      }
+      wakeWorkers.notify_all();
+      for (std::thread& worker : workers) worker.join();
+    }
+    /** call task(i) for every i from 0 to count-1 across the pool,
+     * returning once they have all finished.
+     * Tasks can run in any order and on any thread
+    */
+    template<typename Func>
+    void run(unsigned int count, Func&& task)
+    {
+      if (count == 0) return;
+      // no point waking the pool for a single task
+      if (count == 1 || participants == 1)
+      {
+        for (unsigned int i = 0; i < count; ++i) task(i);
+        return;
+      }
+      taskContext = (void*) &task;
+      taskCall = [](void* context, unsigned int i){
+        (*(typename std::remove_reference<Func>::type*) context)(i);
+      };
+      remaining.store(count, std::memory_order_relaxed);
+      for (unsigned int p = 0; p < participants; ++p)
+      {
+        uint64_t begin = (uint64_t) count * p / participants;
+        uint64_t end = (uint64_t) count * (p + 1) / participants;
+        ranges[p].store(begin << 32 | end, std::memory_order_release);
+      }
+      {
+        std::lock_guard<std::mutex> lock{waitMutex};
+        ++generation;
+      }
+      wakeWorkers.notify_all();
+      doTasks(0);
+      // the others might still be finishing tasks they took
+      while (remaining.load(std::memory_order_acquire) != 0) std::this_thread::yield();
+    }
+    /** how many threads work on a run, including the caller*/
+    unsigned int getThreadCount() const { return participants; }
+    /** how many tasks have been taken from another thread's range*/
+    long getStolenCount() const { return stolenCount; }
+
+  private:
+    void runWorker(unsigned int p)
+    {
+      uint64_t seen = 0;
+      while (true)
+      {
+        {
+          std::unique_lock<std::mutex> lock{waitMutex};
+          wakeWorkers.wait(lock, [this, seen]{ return generation != seen || !running; });
+          if (!running) return;
+          seen = generation;
+        }
+        doTasks(p);
+      }
+    }
+    /** work through participant p's range, then steal until nothing is left*/
+    void doTasks(unsigned int p)
+    {
+      unsigned int task;
+      while (takeTask(p, true, task)) runTask(task);
+      bool stole = true;
+      while (stole)
+      {
+        stole = false;
+        for (unsigned int offset = 1; offset < participants; ++offset)
+        {
+          unsigned int victim = (p + offset) % participants;
+          while (takeTask(victim, false, task))
+          {
+            stolenCount ++;
+            runTask(task);
+            stole = true;
+          }
+        }
+      }
+    }
+    /** take a task from the front (the owner) or the back (a thief) of a range*/
+    bool takeTask(unsigned int p, bool front, unsigned int& task)
+    {
+      uint64_t range = ranges[p].load(std::memory_order_acquire);
+      while (true)
+      {
+        uint32_t begin = range >> 32;
+        uint32_t end = (uint32_t) range;
+        if (begin >= end) return false;
+        uint64_t next = front ?
+          ((uint64_t) (begin + 1) << 32 | end) :
+          ((uint64_t) begin << 32 | (end - 1));
+        if (ranges[p].compare_exchange_weak(range, next, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+          task = front ? begin : end - 1;
+          return true;
+        }
+      }
+    }
+    void runTask(unsigned int task)
+    {
+      taskCall(taskContext, task);
+      remaining.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    const unsigned int participants;
+    // ranges[p] holds participant p's next task in the high half
+    // and one past its last task in the low half
+    std::unique_ptr<std::atomic<uint64_t>[]> ranges;
+    std::vector<std::thread> workers;
+    std::mutex waitMutex;
+    std::condition_variable wakeWorkers;
+    bool running;
+    uint64_t generation;
+    std::atomic<unsigned int> remaining;
+    std::atomic<long> stolenCount;
+    // the task for the current run, set before the ranges are
+    // filled so a thread that takes a task sees it
+    void* taskContext;
+    void (*taskCall)(void*, unsigned int);
+};
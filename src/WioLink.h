@@ -0,0 +1,425 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+/**
+ * The binary protocol used to send screen updates to the wio terminal
+ * (see wio-serial-str-display.ino). The screen is a grid of maxRows
+ * by maxCols character cells. Every packet is
+ *   sync, type, row, col, len, len payload bytes, checksum
+ * where checksum is the xor of type, row, col, len and the payload.
+ * cellsPacket writes the payload characters into the grid from row, col.
+ * clearPacket fills the grid with spaces.
+ * showPacket draws the rows that changed since the last show.
+ * The sync byte is never part of the ascii text the old protocol sends
+ * (text ended by a tab), so the sketch still understands both.
+ */
+struct WioProtocol
+{
+  static const unsigned char sync = 0xA5;
+  static const unsigned char cellsPacket = 1;
+  static const unsigned char clearPacket = 2;
+  static const unsigned char showPacket = 3;
+  static const int maxRows = 16;
+  static const int maxCols = 40;
+  static const int headerSize = 5;
+};
+
+/**
+ * Turns text frames into wio packets, only sending the cells that
+ * changed since the last frame. Every keyframeInterval frames the whole
+ * screen is sent again, so a screen that missed bytes gets back in step.
+ */
+class WioFrameEncoder
+{
+  public:
+    WioFrameEncoder(int keyframeInterval = 64) :
+      keyframeInterval{keyframeInterval}, framesSinceKeyframe{0}, fullFrame{true}
+    {
+      clearGrid(lastGrid);
+      packets.reserve(1024);
+    }
+    /** the packets that take the screen from the last frame to this one.
+     * Empty if nothing changed.
+    */
+    const std::vector<unsigned char>& encode(const std::string& frame)
+    {
+      packets.clear();
+      toGrid(frame, nextGrid);
+      if (fullFrame || ++framesSinceKeyframe >= keyframeInterval)
+      {
+        addPacket(WioProtocol::clearPacket, 0, 0, nullptr, 0);
+        for (int row = 0; row < WioProtocol::maxRows; ++row)
+        {
+          int len = WioProtocol::maxCols;
+          while (len > 0 && nextGrid[row][len - 1] == ' ') --len;
+          if (len > 0) addPacket(WioProtocol::cellsPacket, row, 0, nextGrid[row], len);
+        }
+        fullFrame = false;
+        framesSinceKeyframe = 0;
+      }
+      else
+      {
+        for (int row = 0; row < WioProtocol::maxRows; ++row) diffRow(row);
+      }
+      if (!packets.empty()) addPacket(WioProtocol::showPacket, 0, 0, nullptr, 0);
+      for (int row = 0; row < WioProtocol::maxRows; ++row)
+      {
+        for (int col = 0; col < WioProtocol::maxCols; ++col) lastGrid[row][col] = nextGrid[row][col];
+      }
+      return packets;
+    }
+    /** send the whole screen with the next frame*/
+    void invalidate()
+    {
+      fullFrame = true;
+    }
+    /** the checksum for a packet with this header and payload*/
+    static unsigned char checksum(unsigned char type, unsigned char row, unsigned char col,
+                                  const unsigned char* payload, unsigned char len)
+    {
+      unsigned char sum = type ^ row ^ col ^ len;
+      for (int i = 0; i < len; ++i) sum ^= payload[i];
+      return sum;
+    }
+    /** lay a text frame out on the grid, clipping what does not fit */
+    static void toGrid(const std::string& frame, unsigned char grid[WioProtocol::maxRows][WioProtocol::maxCols])
+    {
+      clearGrid(grid);
+      int row = 0;
+      int col = 0;
+      for (char c : frame)
+      {
+        if (c == '\n')
+        {
+          ++row;
+          col = 0;
+          if (row == WioProtocol::maxRows) break;
+          continue;
+        }
+        if (c == '\r' || c == '\t') continue;
+        if (col < WioProtocol::maxCols) grid[row][col++] = (c & 0x80) ? '?' : c;
+      }
+    }
+
+  private:
+    static void clearGrid(unsigned char grid[WioProtocol::maxRows][WioProtocol::maxCols])
+    {
+      for (int row = 0; row < WioProtocol::maxRows; ++row)
+      {
+        for (int col = 0; col < WioProtocol::maxCols; ++col) grid[row][col] = ' ';
+      }
+    }
+    /** one cells packet per run of changed cells. Gaps of a few
+     * unchanged cells are sent again as that is cheaper than a new header
+    */
+    void diffRow(int row)
+    {
+      int col = 0;
+      while (col < WioProtocol::maxCols)
+      {
+        if (lastGrid[row][col] == nextGrid[row][col])
+        {
+          ++col;
+          continue;
+        }
+        int lastChanged = col;
+        for (int i = col + 1; i < WioProtocol::maxCols && i - lastChanged <= WioProtocol::headerSize; ++i)
+        {
+          if (lastGrid[row][i] != nextGrid[row][i]) lastChanged = i;
+        }
+        addPacket(WioProtocol::cellsPacket, row, col, &nextGrid[row][col], lastChanged + 1 - col);
+        col = lastChanged + 1;
+      }
+    }
+    void addPacket(unsigned char type, unsigned char row, unsigned char col,
+                  const unsigned char* payload, unsigned char len)
+    {
+      packets.push_back((unsigned char) WioProtocol::sync);
+      packets.push_back(type);
+      packets.push_back(row);
+      packets.push_back(col);
+      packets.push_back(len);
+      for (int i = 0; i < len; ++i) packets.push_back(payload[i]);
+      packets.push_back(checksum(type, row, col, payload, len));
+    }
+    int keyframeInterval;
+    int framesSinceKeyframe;
+    bool fullFrame;
+    unsigned char lastGrid[WioProtocol::maxRows][WioProtocol::maxCols];
+    unsigned char nextGrid[WioProtocol::maxRows][WioProtocol::maxCols];
+    std::vector<unsigned char> packets;
+};
+
+/**
+ * Does on linux what the wio sketch does with the bytes it receives,
+ * so the protocol can be tested without the hardware.
+ * Decodes packets into a character grid. Bytes outside packets are
+ * old style text frames, which replace the screen when their tab arrives.
+ */
+class WioScreenEmulator
+{
+  public:
+    WioScreenEmulator() : state{waitingForSync}, showCount{0}, badPacketCount{0}
+    {
+      clear();
+    }
+    void feed(const unsigned char* bytes, std::size_t size)
+    {
+      for (std::size_t i = 0; i < size; ++i) feedByte(bytes[i]);
+    }
+    void feed(const std::vector<unsigned char>& bytes)
+    {
+      feed(bytes.data(), bytes.size());
+    }
+    /** the screen as shown at the last show packet or text frame,
+     * one line per row with trailing spaces and empty rows at the end left out
+    */
+    std::string getText() const
+    {
+      std::string text;
+      int lastRow = WioProtocol::maxRows - 1;
+      while (lastRow >= 0 && rowLength(shown[lastRow]) == 0) --lastRow;
+      for (int row = 0; row <= lastRow; ++row)
+      {
+        text.append((const char*) shown[row], rowLength(shown[row]));
+        text += '\n';
+      }
+      return text;
+    }
+    /** how many times the screen has been drawn*/
+    long getShowCount() const { return showCount; }
+    /** packets thrown away for a bad checksum or header*/
+    long getBadPacketCount() const { return badPacketCount; }
+
+  private:
+    enum State {waitingForSync, readingHeader, readingPayload, readingChecksum};
+    static int rowLength(const unsigned char* row)
+    {
+      int len = WioProtocol::maxCols;
+      while (len > 0 && row[len - 1] == ' ') --len;
+      return len;
+    }
+    void clear()
+    {
+      for (int row = 0; row < WioProtocol::maxRows; ++row)
+      {
+        for (int col = 0; col < WioProtocol::maxCols; ++col)
+        {
+          grid[row][col] = ' ';
+          shown[row][col] = ' ';
+        }
+      }
+      text.clear();
+    }
+    void feedByte(unsigned char b)
+    {
+      switch (state)
+      {
+        case waitingForSync:
+          if (b == WioProtocol::sync)
+          {
+            state = readingHeader;
+            headerPos = 0;
+          }
+          else textByte(b);
+          break;
+        case readingHeader:
+          header[headerPos++] = b;
+          if (headerPos < WioProtocol::headerSize - 1) break;
+          payloadPos = 0;
+          state = header[3] > 0 ? readingPayload : readingChecksum;
+          break;
+        case readingPayload:
+          payload[payloadPos++] = b;
+          if (payloadPos == header[3]) state = readingChecksum;
+          break;
+        case readingChecksum:
+          state = waitingForSync;
+          if (b != WioFrameEncoder::checksum(header[0], header[1], header[2], payload, header[3]))
+          {
+            badPacketCount ++;
+            break;
+          }
+          applyPacket();
+          break;
+      }
+    }
+    void applyPacket()
+    {
+      unsigned char type = header[0];
+      int row = header[1];
+      int col = header[2];
+      int len = header[3];
+      if (type == WioProtocol::cellsPacket)
+      {
+        if (row >= WioProtocol::maxRows || col + len > WioProtocol::maxCols)
+        {
+          badPacketCount ++;
+          return;
+        }
+        for (int i = 0; i < len; ++i) grid[row][col + i] = payload[i];
+      }
+      else if (type == WioProtocol::clearPacket)
+      {
+        for (int r = 0; r < WioProtocol::maxRows; ++r)
+        {
+          for (int c = 0; c < WioProtocol::maxCols; ++c) grid[r][c] = ' ';
+        }
+      }
+      else if (type == WioProtocol::showPacket)
+      {
+        for (int r = 0; r < WioProtocol::maxRows; ++r)
+        {
+          for (int c = 0; c < WioProtocol::maxCols; ++c) shown[r][c] = grid[r][c];
+        }
+        showCount ++;
+      }
+      else badPacketCount ++;
+    }
+    /** the old protocol: text up to a tab, carriage returns ignored*/
+    void textByte(unsigned char b)
+    {
+      if (b == '\r') return;
+      if (b != '\t')
+      {
+        text += (char) b;
+        return;
+      }
+      WioFrameEncoder::toGrid(text, grid);
+      for (int r = 0; r < WioProtocol::maxRows; ++r)
+      {
+        for (int c = 0; c < WioProtocol::maxCols; ++c) shown[r][c] = grid[r][c];
+      }
+      text.clear();
+      showCount ++;
+    }
+    State state;
+    int headerPos;
+    int payloadPos;
+    unsigned char header[WioProtocol::headerSize - 1];
+    unsigned char payload[256];
+    unsigned char grid[WioProtocol::maxRows][WioProtocol::maxCols];
+    unsigned char shown[WioProtocol::maxRows][WioProtocol::maxCols];
+    std::string text;
+    long showCount;
+    long badPacketCount;
+};
+
+/**
+ * Keeps the wio's serial port open for the life of the program,
+ * in raw non blocking mode, and sends frames to it as packets.
+ * The port is opened once because opening it can reset the board.
+ * sendFrame never blocks: bytes the port will not take yet are kept
+ * and sent before the next frame. If the backlog grows past maxPending
+ * it is thrown away and the next frame goes out in full.
+ */
+class WioSerialLink
+{
+  public:
+    WioSerialLink(const std::string& device, std::size_t maxPending = 4096) :
+      maxPending{maxPending}, bytesSent{0}, droppedFrames{0}
+    {
+      fd = open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+      if (fd < 0)
+      {
+        std::cout << "WioSerialLink::WioSerialLink could not open " << device << std::endl;
+        return;
+      }
+      configurePort();
+      pending.reserve(maxPending);
+    }
+    /** for sending to an already open fd, e.g. a pipe in tests. The fd is not closed */
+    WioSerialLink(int existingFd, std::size_t maxPending = 4096) :
+      fd{existingFd}, ownsFd{false}, maxPending{maxPending}, bytesSent{0}, droppedFrames{0}
+    {
+      pending.reserve(maxPending);
+    }
+    ~WioSerialLink()
+    {
+      if (fd >= 0 && ownsFd) close(fd);
+    }
+    WioSerialLink(const WioSerialLink&) = delete;
+    WioSerialLink& operator=(const WioSerialLink&) = delete;
+
+    /** queue the changes for this frame and send as much as the port will take */
+    void sendFrame(const std::string& frame)
+    {
+      if (fd < 0) return;
+      const std::vector<unsigned char>& packets = encoder.encode(frame);
+      if (pending.size() + packets.size() > maxPending)
+      {
+        // the screen has fallen too far behind, start again from a full frame
+        pending.clear();
+        droppedFrames ++;
+        encoder.invalidate();
+        const std::vector<unsigned char>& full = encoder.encode(frame);
+        pending.insert(pending.end(), full.begin(), full.end());
+      }
+      else pending.insert(pending.end(), packets.begin(), packets.end());
+      flush();
+    }
+    /** send what is waiting, without blocking*/
+    void flush()
+    {
+      std::size_t done = 0;
+      while (done < pending.size())
+      {
+        ssize_t written = write(fd, pending.data() + done, pending.size() - done);
+        if (written < 0)
+        {
+          if (errno == EINTR) continue;
+          // EAGAIN: the port is full, try again next frame
+          break;
+        }
+        done += written;
+      }
+      bytesSent += done;
+      pending.erase(pending.begin(), pending.begin() + done);
+    }
+    bool isOpen() const { return fd >= 0; }
+    /** bytes waiting for the port to take them*/
+    std::size_t getPendingBytes() const { return pending.size(); }
+    long getBytesSent() const { return bytesSent; }
+    /** times the backlog was thrown away for a full frame*/
+    long getDroppedFrames() const { return droppedFrames; }
+
+  private:
+    /** raw 8N1 at 115200 with no flow control. HUPCL is cleared
+     * so closing the port does not drop DTR and reset the board
+    */
+    void configurePort()
+    {
+      struct termios tty;
+      if (tcgetattr(fd, &tty) != 0)
+      {
+        std::cout << "WioSerialLink::configurePort not a tty, sending as is" << std::endl;
+        return;
+      }
+      cfmakeraw(&tty);
+      cfsetispeed(&tty, B115200);
+      cfsetospeed(&tty, B115200);
+      tty.c_cflag |= CLOCAL | CREAD;
+      tty.c_cflag &= ~(HUPCL | CRTSCTS);
+      tty.c_cc[VMIN] = 0;
+      tty.c_cc[VTIME] = 0;
+      if (tcsetattr(fd, TCSANOW, &tty) != 0)
+      {
+        std::cout << "WioSerialLink::configurePort could not configure the port" << std::endl;
+      }
+    }
+    int fd;
+    bool ownsFd{true};
+    std::size_t maxPending;
+    WioFrameEncoder encoder;
+    std::vector<unsigned char> pending;
+    long bytesSent;
+    long droppedFrames;
+};
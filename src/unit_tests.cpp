@@ -5,7 +5,37 @@
 #include "MidiUtils.h"
 #include "RapidLibUtils.h"
 #include "EventQueue.h"
+#include "SimpleClock.h"
+#include "RenderThread.h"
+#include "IOUtils.h"
+#include "WioLink.h"
+#include "TickPool.h"
+#include "EventReactor.h"
+#include "LatencyHistogram.h"
 #include <fstream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/** counts heap allocations so tests can check 
+ * that the clock thread paths do not allocate */
+std::atomic<long> global_alloc_count{0};
+
+void* operator new(std::size_t size)
+{
+  global_alloc_count ++;
+  void* p = std::malloc(size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+void operator delete(void* p, std::size_t size) noexcept
+{
+  std::free(p);
+}
 
 
 bool assertStrEqual(std::string want, std::string got)
@@ -40,9 +70,9 @@ bool testUpdate()
 {
   Sequencer* seqrP;
 Sequence seq{seqrP};
-  seq.setStepData(0, std::vector<double>{0.1f});
+  seq.setStepData(0, std::vector<double>{1});
   std::vector<double> data = seq.getStepData(0);
-  if (data[0] == 0.1f) return true;
+  if (data[0] == 1) return true;
   return false;
 }
 
@@ -50,9 +80,9 @@ bool testUpdate2()
 {
   Sequencer* seqrP;
 Sequence seq{seqrP};
-  seq.setStepData(1, std::vector<double>{0.5f});
+  seq.setStepData(1, std::vector<double>{5});
   std::vector<double> data = seq.getStepData(1);
-  if (data[0] == 0.5f) return true;
+  if (data[0] == 5) return true;
   return false;
 }
 
@@ -68,14 +98,14 @@ bool testTick2()
 {
   // set a value and check we get it back after a tick
   Sequencer seqr;
-  seqr.setStepData(0, 0, std::vector<double>{0.1f});
-  seqr.setStepData(0, 1, std::vector<double>{0.2f});
+  seqr.setStepData(0, 0, std::vector<double>{1});
+  seqr.setStepData(0, 1, std::vector<double>{2});
   // pull data for track 0, current step
   std::vector<double> data = seqr.getCurrentStepData(0);
-  if (data[0] != 0.1f) return false;
+  if (data[0] != 1) return false;
   seqr.tick();
   data = seqr.getCurrentStepData(0);
-  if (data[0] != 0.2f) return false;
+  if (data[0] != 2) return false;
   return true;
 }
 
@@ -1016,7 +1046,7 @@ bool testTPSSeqChangesOther()
   bool res;
   Sequencer seqr{};
   seqr.getSequence(0)->setType(SequenceType::tickChanger);
-  std::vector<double>* data = seqr.getStepDataDirect(0, 0);
+  StepDataView data = seqr.getStepDataDirect(0, 0);
   // target seq
   data->at(Step::channelInd) =  1;// change seq 1
   data->at(Step::note1Ind) =  10; // set ticks per beat to 2
@@ -1184,7 +1214,7 @@ bool testSetStepDataV2()
   std::vector<double> dataIn {0, 0, 0, 0, 0};
   dataIn[Step::note1Ind] = 48;
   seqr.setStepData(0, 1, dataIn);// note A/48 maps to bassdrum 36  
-  std::vector<double>* data = seqr.getStepDataDirect(0, 1); 
+  StepDataView data = seqr.getStepDataDirect(0, 1); 
   if (data->at(Step::note1Ind) == 48)
   {
     return true;
@@ -1359,6 +1389,1560 @@ bool testSongMode()
 }
 
 
+bool testClockNoDrift()
+{
+  // 1ms ticks for 200ms. The old clock restarted its interval
+  // from whenever it woke up so it lost time on every tick
+  SimpleClock clock{};
+  clock.setCallback([](){});
+  int64_t start = SimpleClock::getNowNs();
+  clock.startNs(1000000);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  clock.stop();
+  long want = (SimpleClock::getNowNs() - start) / 1000000;
+  long got = clock.getCurrentTick();
+  if (got < want - 2 || got > want) 
+  {
+    std::cout << "testClockNoDrift want " << want << " ticks got " << got << std::endl;
+    return false;
+  }
+  return clock.getMaxLatenessNs() >= clock.getLastLatenessNs();
+}
+
+
+bool testPPQNStepTiming()
+{
+  // at 96 PPQN a step with the default 4 ticks per step
+  // should take 96 sequencer ticks and lengths scale to match
+  Sequencer seqr{1, 4};
+  seqr.setPPQN(96);
+  seqr.setStepData(0, 0, std::vector<double>{0, 2, 64, 60});
+  std::vector<long> triggerTicks{};
+  double length = 0;
+  long tick = 0;
+  seqr.setAllCallbacks([&triggerTicks, &tick, &length](std::vector<double>* data){
+    triggerTicks.push_back(tick);
+    length = data->at(Step::lengthInd);
+  });
+  for (tick = 1; tick <= 96 * 4; ++tick) seqr.tick();
+  bool res = assertNumEqual(1, triggerTicks.size());
+  if (res) res = assertNumEqual(96, triggerTicks[0]);
+  if (res) res = assertNumEqual(2 * 24, length);
+  return res;
+}
+
+bool testStepOffsetEarlyLate()
+{
+  Sequencer seqr{1, 4};
+  seqr.setPPQN(96);
+  seqr.setStepData(0, 0, std::vector<double>{0, 1, 64, 60});
+  seqr.setStepData(0, 1, std::vector<double>{0, 1, 64, 62});
+  seqr.setStepOffset(0, 0, -10);
+  seqr.setStepOffset(0, 1, 10);
+  std::vector<long> triggerTicks{};
+  long tick = 0;
+  seqr.setAllCallbacks([&triggerTicks, &tick](std::vector<double>* data){
+    triggerTicks.push_back(tick);
+  });
+  for (tick = 1; tick <= 96 * 4; ++tick) seqr.tick();
+  bool res = assertNumEqual(2, triggerTicks.size());
+  if (res) res = assertNumEqual(96 - 10, triggerTicks[0]);
+  if (res) res = assertNumEqual(96 * 2 + 10, triggerTicks[1]);
+  // a reset puts the steps back on the grid
+  seqr.resetSequence(0);
+  res &= assertNumEqual(0, seqr.getStepOffset(0, 0));
+  res &= assertNumEqual(0, seqr.getStepOffset(0, 1));
+  return res;
+}
+
+
+/** a sequencer with a note, drum and transposer sequence all playing every tick*/
+void setupBusySequencer(Sequencer& seqr)
+{
+  seqr.setSequenceType(1, SequenceType::drumMidi);
+  seqr.setSequenceType(2, SequenceType::transposer);
+  for (int step=0;step<seqr.howManySteps(0);++step)
+  {
+    seqr.setStepData(0, step, std::vector<double>{0, 1, 64, 60});
+    seqr.setStepData(1, step, std::vector<double>{1, 1, 64, 48.0 + step % 12});
+    seqr.setStepData(2, step, std::vector<double>{0, 1, 64, 2});
+  }
+  for (int seq=0;seq<seqr.howManySequences();++seq) 
+  {
+    seqr.getSequence(seq)->setTicksPerStep(1);
+    seqr.getSequence(seq)->setTicksPerStepAdjustment(1);
+  }
+}
+
+bool testTriggerNoAllocEventCallback()
+{
+  Sequencer seqr{4, 16};
+  setupBusySequencer(seqr);
+  int notes = 0;
+  seqr.setEventCallback([&notes](const StepEvent& event){
+    notes ++;
+  });
+  seqr.tick();
+  long before = global_alloc_count;
+  for (int i=0;i<1000;++i) seqr.tick();
+  long allocs = global_alloc_count - before;
+  bool res = assertNumEqual(0, allocs);
+  if (res) res = assertNumEqual(2002, notes);
+  return res;
+}
+
+bool testTriggerNoAllocStepCallback()
+{
+  Sequencer seqr{4, 16};
+  setupBusySequencer(seqr);
+  int notes = 0;
+  seqr.setAllCallbacks([&notes](std::vector<double>* data){
+    notes ++;
+  });
+  seqr.tick();
+  long before = global_alloc_count;
+  for (int i=0;i<1000;++i) seqr.tick();
+  long allocs = global_alloc_count - before;
+  bool res = assertNumEqual(0, allocs);
+  if (res) res = assertNumEqual(2002, notes);
+  return res;
+}
+
+bool testEventCallbackTransposed()
+{
+  Sequencer seqr{4, 16};
+  setupBusySequencer(seqr);
+  std::vector<int> notes{};
+  notes.reserve(8);
+  seqr.setEventCallback([&notes](const StepEvent& event){
+    if (event.channel == 0) notes.push_back(event.note);
+  });
+  // the transposer is after the note sequence but ticks
+  // before it, so it affects the note sequence from the first tick
+  seqr.tick();
+  seqr.tick();
+  bool res = assertNumEqual(2, notes.size());
+  if (res) res = assertNumEqual(62, notes[0]);
+  if (res) res = assertNumEqual(62, notes[1]);
+  return res;
+}
+
+bool testStepDataViewClamps()
+{
+  bool res = true;
+  Sequencer seqr{};
+  // writes through the view land in the step arrays
+  StepDataView data = seqr.getStepDataDirect(0, 2);
+  data[Step::note1Ind] = 60;
+  data[Step::velInd] = 200; // over midi range
+  data[Step::lengthInd] = -3;
+  std::vector<double> stored = seqr.getStepData(0, 2);
+  res &= assertNumEqual(stored[Step::note1Ind], 60);
+  res &= assertNumEqual(stored[Step::velInd], 127);
+  res &= assertNumEqual(stored[Step::lengthInd], 0);
+  res &= assertNumEqual(data.size(), Step::dataSize);
+  // setLength adds steps on step 0's channel
+  seqr.getStepDataDirect(0, 0)[Step::channelInd] = 3;
+  seqr.getSequence(0)->setLength(32);
+  res &= assertNumEqual(seqr.getStepData(0, 20)[Step::channelInd], 3);
+  return res;
+}
+
+bool testMidiQueueDrainsInOrder()
+{
+  bool res = true;
+  MidiQueue q{};
+  q.addMessage(5, 128, 60, 0);
+  q.addMessage(7, 128, 62, 0);
+  q.addMessage(5, 129, 61, 0);
+  std::vector<int> notes;
+  std::vector<long> ticks;
+  for (long tick = 1; tick <= 8; ++tick)
+  {
+    q.drainMessages(tick, [&notes, &ticks, tick](const ShortMidiMessage& msg){
+      notes.push_back(msg.bytes[1]);
+      ticks.push_back(tick);
+    });
+  }
+  res &= assertNumEqual(3, notes.size());
+  if (!res) return res;
+  res &= assertNumEqual(60, notes[0]);
+  res &= assertNumEqual(61, notes[1]);
+  res &= assertNumEqual(62, notes[2]);
+  res &= assertNumEqual(5, ticks[1]);
+  res &= assertNumEqual(7, ticks[2]);
+  res &= assertNumEqual(0, q.size());
+  return res;
+}
+
+bool testMidiQueueOverflow()
+{
+  bool res = true;
+  // 16 tick wheel with room for 2 messages
+  MidiQueue q{16, 2};
+  q.addMessage(100, 128, 1, 0); // past the end of the wheel
+  q.addMessage(3, 128, 2, 0);
+  q.addMessage(3, 128, 3, 0);
+  q.addMessage(4, 128, 4, 0); // pool full
+  res &= assertNumEqual(2, q.overflowSize());
+  std::vector<long> ticks(5, 0);
+  for (long tick = 1; tick <= 100; ++tick)
+  {
+    q.drainMessages(tick, [&ticks, tick](const ShortMidiMessage& msg){
+      ticks[msg.bytes[1]] = tick;
+    });
+  }
+  res &= assertNumEqual(100, ticks[1]);
+  res &= assertNumEqual(3, ticks[2]);
+  res &= assertNumEqual(3, ticks[3]);
+  res &= assertNumEqual(4, ticks[4]);
+  res &= assertNumEqual(0, q.size());
+  return res;
+}
+
+bool testMidiQueueLateMessageNotLost()
+{
+  MidiQueue q{};
+  q.drainMessages(10, [](const ShortMidiMessage& msg){});
+  // due on a tick that was already drained
+  q.addMessage(10, 128, 60, 0);
+  int sent = 0;
+  q.drainMessages(11, [&sent](const ShortMidiMessage& msg){ sent ++; });
+  return assertNumEqual(1, sent);
+}
+
+bool testMidiQueueNoAlloc()
+{
+  MidiQueue q{};
+  int sent = 0;
+  long before = global_alloc_count;
+  for (long tick = 1; tick <= 1000; ++tick)
+  {
+    q.addMessage(tick + 4, 128, 36, 0);
+    q.addMessage(tick + 960, 128, 38, 0);
+    q.drainMessages(tick, [&sent](const ShortMidiMessage& msg){ sent ++; });
+  }
+  long allocs = global_alloc_count - before;
+  bool res = assertNumEqual(0, allocs);
+  res &= assertNumEqual(996 + 40, sent);
+  return res;
+}
+
+bool testEQFiresDueInOrder()
+{
+  bool res = true;
+  EventQueue q;
+  std::vector<int> fired;
+  q.addEvent(20, [&fired](){fired.push_back(3);});
+  q.addEvent(5, [&fired](){fired.push_back(1);});
+  q.addEvent(5, [&fired](){fired.push_back(2);});
+  q.addEvent(30, [&fired](){fired.push_back(4);});
+  // everything up to 25, including the events at 5 that were never triggered
+  q.triggerAndClearEventsAtTimestamp(25);
+  res &= assertNumEqual(3, fired.size());
+  if (!res) return res;
+  res &= assertNumEqual(1, fired[0]);
+  res &= assertNumEqual(2, fired[1]);
+  res &= assertNumEqual(3, fired[2]);
+  res &= assertNumEqual(1, q.size());
+  int64_t next = 0;
+  res &= q.getNextTimestamp(next);
+  res &= assertNumEqual(30, next);
+  return res;
+}
+
+bool testEQTriggerAtNow()
+{
+  bool res = true;
+  EventQueue q;
+  int64_t now = 100;
+  q.setTimeSource([&now](){return now;});
+  int fired = 0;
+  q.addEvent(100, [&fired](){fired ++;});
+  q.addEvent(101, [&fired](){fired ++;});
+  q.triggerAndClearEventsAtNow();
+  res &= assertNumEqual(1, fired);
+  now = 101;
+  q.triggerAndClearEventsAtNow();
+  res &= assertNumEqual(2, fired);
+  // default time source is the monotonic clock
+  EventQueue q2;
+  q2.addEvent(EventQueue::getMonotonicNs(), [&fired](){fired ++;});
+  q2.triggerAndClearEventsAtNow();
+  res &= assertNumEqual(3, fired);
+  return res;
+}
+
+bool testEQAddFromThreads()
+{
+  EventQueue q;
+  std::atomic<int> fired{0};
+  std::vector<std::thread> threads;
+  for (int t=0; t<4; ++t)
+  {
+    threads.push_back(std::thread([&q, &fired, t](){
+      for (int i=0; i<1000; ++i) q.addEvent(i, [&fired](){fired ++;});
+    }));
+  }
+  // trigger while the other threads add
+  for (int i=0; i<100; ++i) q.triggerAndClearEventsAtTimestamp(500);
+  for (std::thread& thread : threads) thread.join();
+  q.triggerAndClearEventsAtTimestamp(1000);
+  return assertNumEqual(4000, fired);
+}
+
+bool testNullMidiBackendCounts()
+{
+  NullMidiBackend backend{};
+  MidiUtils midiUtils{&backend};
+  midiUtils.resetAllChannels();
+  bool res = assertNumEqual(16, backend.getMessageCount());
+  res &= assertNumEqual(48, backend.getByteCount());
+  return res;
+}
+
+bool testFileMidiBackendWrites()
+{
+  std::string filename = "/tmp/oto_midi_capture_test.bin";
+  {
+    FileMidiBackend backend{filename};
+    if (!backend.isOpen()) return false;
+    MidiUtils midiUtils{&backend};
+    midiUtils.playSingleNote(1, 60, 100, 2);
+    midiUtils.sendQueuedMessages(2);
+  }
+  std::ifstream in(filename, std::ios::binary);
+  std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  // 2 messages, each 8 byte time + size + 3 bytes
+  bool res = assertNumEqual(24, bytes.size());
+  if (!res) return res;
+  res &= assertNumEqual(3, bytes[8]);
+  res &= assertNumEqual(145, (unsigned char) bytes[9]);
+  res &= assertNumEqual(129, (unsigned char) bytes[12 + 9]);
+  return res;
+}
+
+bool testLoopbackTickToWire()
+{
+  LoopbackMidiBackend backend{};
+  MidiUtils midiUtils{&backend};
+  Sequencer seqr{4, 16};
+  long tick = 0;
+  seqr.setEventCallback([&midiUtils, &tick](const StepEvent& event){
+    midiUtils.playSingleNote(event.channel, event.note, event.velocity, tick + event.length);
+  });
+  seqr.setStepData(0, 0, std::vector<double>{0, 2, 100, 60});
+  // same order as the clock callback in Main.cpp
+  for (tick = 1; tick <= 16; ++tick)
+  {
+    midiUtils.sendQueuedMessages(tick);
+    seqr.tick();
+  }
+  const std::vector<LoopbackMidiMessage>& sent = backend.getMessages();
+  bool res = assertNumEqual(2, sent.size());
+  if (!res) return res;
+  res &= assertNumEqual(144, sent[0].bytes[0]);
+  res &= assertNumEqual(60, sent[0].bytes[1]);
+  res &= assertNumEqual(128, sent[1].bytes[0]);
+  res &= sent[1].sendNs >= sent[0].sendNs;
+  return res;
+}
+
+bool testSpscRingWraps()
+{
+  bool res = true;
+  SpscRing<int> ring{4};
+  int value = 0;
+  for (int i=0; i<4; ++i) res &= ring.push(i);
+  res &= !ring.push(4); // full
+  res &= assertNumEqual(4, ring.size());
+  for (int i=0; i<10; ++i)
+  {
+    res &= ring.pop(value);
+    res &= assertNumEqual(i, value);
+    res &= ring.push(i + 4);
+  }
+  return res;
+}
+
+bool testThreadedMidiBackendSendsInOrder()
+{
+  LoopbackMidiBackend loopback{};
+  {
+    ThreadedMidiBackend threaded{&loopback};
+    unsigned char msg[3] = {144, 0, 100};
+    for (int i=0; i<100; ++i)
+    {
+      msg[1] = i;
+      threaded.sendMessage(msg, 3);
+    }
+    threaded.sendAllNotesOff();
+  }// destructor sends everything still queued
+  const std::vector<LoopbackMidiMessage>& sent = loopback.getMessages();
+  bool res = assertNumEqual(116, sent.size());
+  if (!res) return res;
+  for (int i=0; i<100; ++i) res &= assertNumEqual(i, sent[i].bytes[1]);
+  res &= assertNumEqual(176, sent[100].bytes[0]);
+  return res;
+}
+
+/** a port that takes a long time to write to */
+class SlowMidiBackend : public MidiOutputBackend
+{
+  public:
+    void sendMessage(const unsigned char* bytes, std::size_t size) override
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+};
+
+bool testThreadedMidiBackendOverruns()
+{
+  SlowMidiBackend slow{};
+  ThreadedMidiBackend threaded{&slow, 8};
+  unsigned char msg[3] = {144, 60, 100};
+  int64_t startNs = SimpleClock::getNowNs();
+  for (int i=0; i<100; ++i) threaded.sendMessage(msg, 3);
+  int64_t tookNs = SimpleClock::getNowNs() - startNs;
+  bool res = threaded.getOverruns() > 0;
+  res &= threaded.getMaxQueueDepth() <= 8;
+  // the sender never waited for the slow port
+  res &= tookNs < 50000000;
+  return res;
+}
+
+bool testBatchOffsBeforeOnsRunningStatus()
+{
+  LoopbackMidiBackend loopback{};
+  MidiUtils midiUtils{&loopback};
+  midiUtils.setBatchMode(true);
+  // tick 1: two notes on channel 0, one on channel 1
+  midiUtils.playSingleNote(0, 36, 100, 2);
+  midiUtils.playSingleNote(1, 40, 100, 2);
+  midiUtils.playSingleNote(0, 38, 100, 2);
+  midiUtils.flushBatch();
+  // tick 2: note offs from tick 1 and new note ons
+  midiUtils.sendQueuedMessages(2);
+  midiUtils.playSingleNote(0, 42, 90, 3);
+  midiUtils.flushBatch();
+  const std::vector<LoopbackMidiMessage>& sent = loopback.getMessages();
+  bool res = assertNumEqual(7, sent.size());
+  if (!res) return res;
+  // channel 0 note ons were grouped
+  res &= assertNumEqual(144, sent[0].bytes[0]);
+  res &= assertNumEqual(36, sent[0].bytes[1]);
+  res &= assertNumEqual(38, sent[1].bytes[1]);
+  res &= assertNumEqual(145, sent[2].bytes[0]);
+  // offs before the new on
+  res &= assertNumEqual(128, sent[3].bytes[0]);
+  res &= assertNumEqual(128, sent[4].bytes[0]);
+  res &= assertNumEqual(129, sent[5].bytes[0]);
+  res &= assertNumEqual(144, sent[6].bytes[0]);
+  res &= assertNumEqual(42, sent[6].bytes[1]);
+  // one status byte saved in each batch
+  res &= assertNumEqual(2, midiUtils.getBatchBytesSaved());
+  return res;
+}
+
+bool testBatchOneWrite()
+{
+  std::string filename = "/tmp/oto_raw_midi_test.bin";
+  std::ofstream(filename).close();
+  std::vector<unsigned char> bytes;
+  {
+    RawMidiBackend raw{filename};
+    if (!raw.isOpen()) return false;
+    MidiUtils midiUtils{&raw};
+    midiUtils.setBatchMode(true);
+    for (int i=0; i<16; ++i) midiUtils.playSingleNote(9, 36 + i, 100, 2);
+    midiUtils.flushBatch();
+    if (!assertNumEqual(1, raw.getWriteCount())) return false;
+  }
+  std::ifstream in(filename, std::ios::binary);
+  bytes.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  // one status byte then 16 pairs of data bytes
+  bool res = assertNumEqual(33, bytes.size());
+  if (res) res = assertNumEqual(153, bytes[0]);
+  return res;
+}
+
+bool testThreadedMidiBackendKeepsBatchesWhole()
+{
+  std::string filename = "/tmp/oto_raw_midi_threaded_test.bin";
+  std::ofstream(filename).close();
+  RawMidiBackend raw{filename};
+  if (!raw.isOpen()) return false;
+  bool res = true;
+  {
+    ThreadedMidiBackend threaded{&raw, 16};
+    MidiUtils midiUtils{&threaded};
+    midiUtils.setBatchMode(true);
+    for (int i=0; i<16; ++i) midiUtils.playSingleNote(9, 36 + i, 100, 2);
+    midiUtils.flushBatch();
+    // too big for the ring: dropped whole rather than sent in part
+    unsigned char big[1024] = {153};
+    threaded.sendBytes(big, sizeof(big));
+    res &= assertNumEqual(1, threaded.getOverruns());
+  }// destructor sends everything still queued
+  // the batch crossed to the output thread and still went out in one write
+  res &= assertNumEqual(1, raw.getWriteCount());
+  std::ifstream in(filename, std::ios::binary);
+  std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  res &= assertNumEqual(33, bytes.size());
+  if (res) res = assertNumEqual(153, bytes[0]) && assertNumEqual(36 + 15, bytes[31]);
+  // the default constructor's port can be swapped for a raw device
+  MidiUtils rawUtils{};
+  res &= !rawUtils.openRawDevice("/tmp/no_such_dir/midi");
+  res &= rawUtils.openRawDevice(filename);
+  res &= rawUtils.getOutputStage() != nullptr;
+  return res;
+}
+
+bool testActiveNotesCount()
+{
+  bool res = true;
+  NullMidiBackend backend{};
+  MidiUtils midiUtils{&backend};
+  midiUtils.playSingleNote(0, 60, 100, 4);
+  midiUtils.playSingleNote(9, 36, 100, 2);
+  res &= assertNumEqual(2, midiUtils.getActiveNoteCount());
+  for (long tick = 1; tick <= 4; ++tick) midiUtils.sendQueuedMessages(tick);
+  res &= assertNumEqual(0, midiUtils.getActiveNoteCount());
+  return res;
+}
+
+bool testRetriggerSuppressesStaleNoteOff()
+{
+  bool res = true;
+  LoopbackMidiBackend loopback{};
+  MidiUtils midiUtils{&loopback};
+  // long note then a retrigger before it ends
+  midiUtils.playSingleNote(0, 60, 100, 4);
+  midiUtils.sendQueuedMessages(1);
+  midiUtils.sendQueuedMessages(2);
+  midiUtils.playSingleNote(0, 60, 100, 8);
+  // the first trigger's note off must not cut the second one short
+  for (long tick = 3; tick <= 7; ++tick) midiUtils.sendQueuedMessages(tick);
+  res &= assertNumEqual(1, midiUtils.getActiveNoteCount());
+  res &= assertNumEqual(1, midiUtils.getStaleNoteOffCount());
+  res &= assertNumEqual(2, loopback.getMessages().size());
+  midiUtils.sendQueuedMessages(8);
+  res &= assertNumEqual(0, midiUtils.getActiveNoteCount());
+  res &= assertNumEqual(3, loopback.getMessages().size());
+  return res;
+}
+
+bool testMinimalPanic()
+{
+  bool res = true;
+  LoopbackMidiBackend loopback{};
+  MidiUtils midiUtils{&loopback};
+  midiUtils.playSingleNote(2, 64, 100, 10);
+  midiUtils.playSingleNote(15, 127, 100, 10);
+  loopback.clear();
+  midiUtils.allNotesOff();
+  const std::vector<LoopbackMidiMessage>& sent = loopback.getMessages();
+  res &= assertNumEqual(2, sent.size());
+  if (!res) return res;
+  res &= assertNumEqual(130, sent[0].bytes[0]);
+  res &= assertNumEqual(64, sent[0].bytes[1]);
+  res &= assertNumEqual(143, sent[1].bytes[0]);
+  res &= assertNumEqual(127, sent[1].bytes[1]);
+  res &= assertNumEqual(0, midiUtils.getActiveNoteCount());
+  // requested panics happen on the next tick
+  midiUtils.playSingleNote(0, 60, 100, 10);
+  midiUtils.requestAllNotesOff();
+  res &= assertNumEqual(1, midiUtils.getActiveNoteCount());
+  midiUtils.sendQueuedMessages(1);
+  res &= assertNumEqual(0, midiUtils.getActiveNoteCount());
+  // batched note offs go out straight away too, with no tick to flush them
+  midiUtils.setBatchMode(true);
+  midiUtils.playSingleNote(3, 50, 100, 10);
+  midiUtils.flushBatch();
+  loopback.clear();
+  midiUtils.allNotesOff();
+  res &= assertNumEqual(1, loopback.getMessages().size());
+  if (!res) return res;
+  res &= assertNumEqual(131, loopback.getMessages()[0].bytes[0]);
+  res &= assertNumEqual(50, loopback.getMessages()[0].bytes[1]);
+  res &= assertNumEqual(0, midiUtils.getActiveNoteCount());
+  return res;
+}
+
+bool testEditQueueAppliedAtTick()
+{
+  bool res = true;
+  Sequencer seqr{2, 16};
+  seqr.setEditQueueEnabled(true);
+  seqr.updateStepData(0, 1, Step::note1Ind, 60);
+  seqr.extendSequence(1);
+  seqr.toggleActive(0, 2);
+  // nothing changes until the tick
+  res &= assertNumEqual(0, seqr.getStepData(0, 1)[Step::note1Ind]);
+  res &= assertNumEqual(16, seqr.howManySteps(1));
+  seqr.tick();
+  res &= assertNumEqual(60, seqr.getStepData(0, 1)[Step::note1Ind]);
+  res &= assertNumEqual(17, seqr.howManySteps(1));
+  res &= !seqr.isStepActive(0, 2);
+  // disabling applies whatever is left and goes back to direct edits
+  seqr.setStepData(0, 3, std::vector<double>{1, 2, 3, 4});
+  seqr.setEditQueueEnabled(false);
+  res &= assertNumEqual(4, seqr.getStepData(0, 3)[Step::note1Ind]);
+  seqr.updateStepData(0, 3, Step::note1Ind, 5);
+  res &= assertNumEqual(5, seqr.getStepData(0, 3)[Step::note1Ind]);
+  return res;
+}
+
+bool testEditQueueFromOtherThread()
+{
+  Sequencer seqr{4, 16};
+  seqr.setEventCallback([](const StepEvent& event){});
+  seqr.setEditQueueEnabled(true);
+  std::atomic<bool> editing{true};
+  // ticks run while another thread grows and shrinks the sequences
+  std::thread ticker([&seqr, &editing](){
+    while (editing) seqr.tick();
+  });
+  for (int i=0; i<2000; ++i)
+  {
+    // keep well inside the queue so nothing has to wait for room
+    while (seqr.getQueuedEditCount() > 512) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    seqr.extendSequence(i % 4);
+    seqr.updateStepData(i % 4, i % 16, Step::note1Ind, 60);
+    if (i % 2 == 0) seqr.shrinkSequence(i % 4);
+    if (i % 100 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  editing = false;
+  ticker.join();
+  seqr.setEditQueueEnabled(false);
+  long applied = 0;
+  for (int s=0; s<4; ++s) applied += seqr.getSequence(s)->getLength() - 16;
+  bool res = assertNumEqual(0, seqr.getDroppedEditCount());
+  res &= assertNumEqual(1000, applied);
+  return res;
+}
+
+bool testEditorEditsBetweenTicksAllCount()
+{
+  Sequencer seqr{2, 8};
+  seqr.setEventCallback([](const StepEvent& event){});
+  SequencerEditor editor{&seqr};
+  editor.setEditMode(SequencerEditorMode::editingStep);
+  // applied straight away with the queue off
+  editor.enterNoteData(36);
+  bool res = assertNumEqual(36, seqr.getStepData(0, 0)[Step::note1Ind]);
+  res &= assertNumEqual(64, seqr.getStepData(0, 0)[Step::velInd]);
+  seqr.setEditQueueEnabled(true);
+  // two octaves up before the clock gets to either of them
+  editor.moveCursorUp();
+  editor.moveCursorUp();
+  editor.incrementChannel();
+  editor.incrementChannel();
+  seqr.getStepDataDirect(0, 1)->at(Step::velInd) = 100;
+  res &= assertNumEqual(36, seqr.getStepData(0, 0)[Step::note1Ind]);
+  res &= assertNumEqual(0, seqr.getStepData(0, 1)[Step::velInd]);
+  seqr.tick();
+  res &= assertNumEqual(60, seqr.getStepData(0, 0)[Step::note1Ind]);
+  res &= assertNumEqual(100, seqr.getStepData(0, 1)[Step::velInd]);
+  res &= assertNumEqual(2, seqr.getStepData(0, 7)[Step::channelInd]);
+  // down goes round from channel 0 to 15
+  editor.decrementChannel();
+  editor.decrementChannel();
+  editor.decrementChannel();
+  seqr.tick();
+  res &= assertNumEqual(15, seqr.getStepData(0, 3)[Step::channelInd]);
+  seqr.setEditQueueEnabled(false);
+  return res;
+}
+
+bool testSnapshotVersionOnlyOnChange()
+{
+  Sequencer seqr{2, 8};
+  seqr.setEventCallback([](const StepEvent& event){});
+  uint64_t start = seqr.getSnapshotVersion();
+  // at 4 ticks per step the playhead only moves on the 4th tick
+  for (int i=0; i<3; ++i) seqr.tick();
+  bool res = assertNumEqual(start, seqr.getSnapshotVersion());
+  seqr.tick();
+  res &= assertNumEqual(start + 1, seqr.getSnapshotVersion());
+  seqr.updateStepData(1, 3, Step::note1Ind, 64);
+  res &= assertNumEqual(start + 2, seqr.getSnapshotVersion());
+  return res;
+}
+
+bool testSnapshotMatchesSequencer()
+{
+  Sequencer seqr{3, 8};
+  seqr.setEventCallback([](const StepEvent& event){});
+  seqr.updateStepData(2, 5, Step::note1Ind, 72);
+  seqr.toggleActive(2, 5);
+  seqr.extendSequence(1);
+  for (int i=0; i<6; ++i) seqr.tick();
+  SequencerSnapshot snap;
+  seqr.readSnapshot(snap);
+  bool res = assertNumEqual(3, snap.sequenceCount);
+  res &= assertNumEqual(9, snap.sequences[1].length);
+  res &= assertNumEqual(72, snap.sequences[2].steps[5].note);
+  res &= assertNumEqual(seqr.isStepActive(2, 5), snap.sequences[2].steps[5].active);
+  res &= assertNumEqual(seqr.getCurrentStep(0), snap.sequences[0].currentStep);
+  return res;
+}
+
+bool testSnapshotNoTearing()
+{
+  Sequencer seqr{4, 16};
+  seqr.setEventCallback([](const StepEvent& event){});
+  seqr.setEditQueueEnabled(true);
+  std::atomic<bool> running{true};
+  std::thread ticker([&seqr, &running](){
+    while (running) seqr.tick();
+  });
+  // every write keeps each step's note and velocity equal,
+  // so a reader seeing them differ has read a half written step
+  std::atomic<long> torn{0};
+  std::atomic<long> reads{0};
+  std::thread reader([&seqr, &running, &torn, &reads](){
+    SequencerSnapshot snap;
+    while (running)
+    {
+      seqr.readSnapshot(snap);
+      for (unsigned int s=0; s<snap.sequenceCount; ++s)
+      {
+        const SequenceSnapshot& seqSnap = snap.sequences[s];
+        if (seqSnap.currentStep >= seqSnap.length) torn ++;
+        for (unsigned int step=0; step<seqSnap.length; ++step)
+        {
+          if (seqSnap.steps[step].note != seqSnap.steps[step].velocity) torn ++;
+        }
+      }
+      reads ++;
+    }
+  });
+  std::vector<double> data(Step::dataSize);
+  for (int i=0; i<20000; ++i)
+  {
+    double value = 1 + i % 100;
+    data[Step::channelInd] = 1;
+    data[Step::note1Ind] = value;
+    data[Step::velInd] = value;
+    data[Step::lengthInd] = 1;
+    seqr.setStepData(i % 4, i % 16, data);
+    if (i % 1000 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  running = false;
+  ticker.join();
+  reader.join();
+  bool res = assertNumEqual(0, torn);
+  res &= reads > 0;
+  return res;
+}
+
+bool testRenderThreadCoalescesAndCaps()
+{
+  std::atomic<long> frames{0};
+  RenderThread renderer{[&frames](){ frames ++; }, 50};
+  // 200ms of requests at 50fps is about 10 frames however many requests there are
+  int64_t endNs = SimpleClock::getNowNs() + 200000000;
+  long requests = 0;
+  while (SimpleClock::getNowNs() < endNs)
+  {
+    renderer.requestRedraw();
+    requests ++;
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  renderer.stop();
+  bool res = frames > 0 && frames <= 12;
+  res &= assertNumEqual(frames, renderer.getFrameCount());
+  res &= renderer.getCoalescedCount() > 0;
+  res &= renderer.getCoalescedCount() + renderer.getFrameCount() <= requests;
+  return res;
+}
+
+bool testSlowRenderDoesNotBlockRequests()
+{
+  RenderThread renderer{[](){
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }, 100};
+  int64_t maxRequestNs = 0;
+  for (int i=0; i<200; ++i)
+  {
+    int64_t startNs = SimpleClock::getNowNs();
+    renderer.requestRedraw();
+    int64_t took = SimpleClock::getNowNs() - startNs;
+    if (took > maxRequestNs) maxRequestNs = took;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  renderer.stop();
+  // a request never waits for the 20ms render
+  bool res = maxRequestNs < 5000000;
+  res &= renderer.getFrameCount() > 0;
+  res &= renderer.getAverageFrameNs() >= 20000000;
+  res &= renderer.getMaxFrameNs() >= renderer.getLastFrameNs();
+  return res;
+}
+
+bool testTerminalDiffOnlyChangedCells()
+{
+  TerminalDiffRenderer term{-1};
+  std::string first = term.makeUpdate("0 CoDoEo\n1 FoGoAo\n");
+  bool res = first.find("\x1B[2J") != std::string::npos;
+  // same frame again, nothing to send
+  res &= assertNumEqual(0, term.makeUpdate("0 CoDoEo\n1 FoGoAo\n").size());
+  // playhead moves on row 2: one cursor move to row 2 col 4, the new cell, then park the cursor
+  std::string update = term.makeUpdate("0 CoDoEo\n1 F-GoAo\n");
+  res &= update == "\x1B[2;4H-\x1B[3;1H";
+  // shorter line is cleared to the end
+  update = term.makeUpdate("0 CoDoEo\n1 F-\n");
+  res &= update == "\x1B[2;5H\x1B[K\x1B[3;1H";
+  term.invalidate();
+  res &= term.makeUpdate("0 CoDoEo\n1 F-\n").find("\x1B[2J") != std::string::npos;
+  return res;
+}
+
+bool testTerminalDiffOneWritePerFrame()
+{
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  TerminalDiffRenderer term{fds[1]};
+  std::size_t sent = term.render("0 CoDoEo\n1 FoGoAo\n");
+  sent += term.render("0 C-DoEo\n1 FoG-Ao\n");
+  // unchanged frame makes no write
+  sent += term.render("0 C-DoEo\n1 FoG-Ao\n");
+  char buffer[256];
+  ssize_t got = read(fds[0], buffer, sizeof(buffer));
+  close(fds[0]);
+  close(fds[1]);
+  bool res = assertNumEqual(2, term.getWriteCount());
+  res &= assertNumEqual(sent, got);
+  return res;
+}
+
+bool testWioDeltaRoundTrip()
+{
+  WioFrameEncoder encoder{};
+  WioScreenEmulator screen{};
+  std::string frame1 = "0 CoDoEoFo\n1 GoAoBoCo\n2 ooooooo\n";
+  std::string frame2 = "0 C-DoEoFo\n1 GoA-BoCo\n2 ooooooo\n";
+  std::string frame3 = "0 CoD-EoFo\n1 Go\n";
+  const std::vector<unsigned char>& full = encoder.encode(frame1);
+  std::size_t fullSize = full.size();
+  screen.feed(full);
+  bool res = screen.getText() == frame1;
+  const std::vector<unsigned char>& delta = encoder.encode(frame2);
+  // just the two playhead cells, far less than the whole screen
+  res &= delta.size() < fullSize / 2;
+  screen.feed(delta);
+  res &= screen.getText() == frame2;
+  screen.feed(encoder.encode(frame3));
+  res &= screen.getText() == frame3;
+  // nothing changed, nothing sent
+  res &= assertNumEqual(0, encoder.encode(frame3).size());
+  res &= assertNumEqual(0, screen.getBadPacketCount());
+  return res;
+}
+
+bool testWioRecoversFromCorruption()
+{
+  WioFrameEncoder encoder{4};
+  WioScreenEmulator screen{};
+  screen.feed(encoder.encode("0 CoDo\n1 EoFo\n"));
+  std::vector<unsigned char> bad = encoder.encode("0 C-Do\n1 EoFo\n");
+  bad[bad.size() / 2] ^= 0x10;
+  screen.feed(bad);
+  bool res = screen.getBadPacketCount() > 0;
+  // the keyframe every 4 frames puts the screen right
+  std::string last;
+  for (int i=0; i<4; ++i)
+  {
+    last = i % 2 == 0 ? "0 CoD-\n1 EoFo\n" : "0 CoDo\n1 E-Fo\n";
+    screen.feed(encoder.encode(last));
+  }
+  res &= screen.getText() == last;
+  // old style text frames still work
+  std::string text = "hello\nwio\t";
+  screen.feed((const unsigned char*) text.data(), text.size());
+  res &= screen.getText() == "hello\nwio\n";
+  return res;
+}
+
+bool testWioSerialLinkNonBlocking()
+{
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  bool res = true;
+  {
+    WioSerialLink link{fds[1], 512};
+    // nothing reads the pipe so it fills, sendFrame must still return
+    std::string frame;
+    for (int i=0; i<WioProtocol::maxRows; ++i) frame += std::string(WioProtocol::maxCols, 'a' + (i % 26)) + "\n";
+    int64_t startNs = SimpleClock::getNowNs();
+    for (int i=0; i<2000; ++i)
+    {
+      frame[i % frame.size()] = frame[i % frame.size()] == '\n' ? '\n' : 'A' + (i % 26);
+      link.sendFrame(frame);
+    }
+    res &= SimpleClock::getNowNs() - startNs < 1000000000;
+    res &= link.getPendingBytes() <= 512 + 1024;
+    res &= link.getDroppedFrames() > 0;
+    res &= link.getBytesSent() > 0;
+  }
+  close(fds[0]);
+  close(fds[1]);
+  return res;
+}
+
+bool testTextGridMatchesSequencerView()
+{
+  Sequencer seqr{12, 16};
+  seqr.setEventCallback([](const StepEvent& event){});
+  seqr.setSequenceType(1, SequenceType::drumMidi);
+  seqr.setSequenceType(2, SequenceType::transposer);
+  seqr.updateStepData(0, 2, Step::note1Ind, 61);
+  seqr.updateStepData(1, 3, Step::note1Ind, 38);
+  seqr.updateStepData(2, 1, Step::note1Ind, -2);
+  seqr.toggleActive(0, 5);
+  seqr.shrinkSequence(3);
+  for (int i=0; i<9; ++i) seqr.tick();
+  SequencerEditor cursor{&seqr};
+  cursor.setEditMode(SequencerEditorMode::selectingSeqAndStep);
+  SequencerSnapshot snap;
+  seqr.readSnapshot(snap);
+  TextGrid grid;
+  // cursor, empty steps, playhead, drum name, transposer down and an inactive step
+  SequencerViewer::renderSequencerView(grid, 3, 13, snap, cursor.getCursor());
+  bool res = grid.toString() == "0 I.-.. ....\n1 ..-S......\n2 ._-.......";
+  for (int move=0; move<12; ++move)
+  {
+    if (move % 2 == 0) cursor.moveCursorDown();
+    else cursor.moveCursorRight();
+  }
+  // the cursor is on sequence 6 so the view scrolls to start at 5
+  SequencerViewer::renderSequencerView(grid, 4, 13, snap, cursor.getCursor());
+  res &= assertNumEqual(4, grid.rows);
+  res &= assertNumEqual(12, grid.rowLengths[0]);
+  res &= grid.toString() == SequencerViewer::getSequencerView(4, 13, snap, cursor.getCursor());
+  res &= grid.cells[0][0] == '5';
+  return res;
+}
+
+bool testEditorCursorPublished()
+{
+  Sequencer seqr{4, 8};
+  SequencerEditor editor{&seqr};
+  editor.setEditMode(SequencerEditorMode::selectingSeqAndStep);
+  editor.moveCursorDown();
+  editor.moveCursorRight();
+  editor.moveCursorRight();
+  EditorCursor cursor = editor.getCursor();
+  bool res = assertNumEqual(1, cursor.sequence);
+  res &= assertNumEqual(2, cursor.step);
+  res &= cursor.mode == SequencerEditorMode::selectingSeqAndStep;
+  editor.enterAtCursor();
+  editor.cycleEditMode();
+  cursor = editor.getCursor();
+  res &= cursor.mode == SequencerEditorMode::editingStep;
+  res &= cursor.subMode == SequencerEditorSubMode::editCol2;
+  editor.resetCursor();
+  cursor = editor.getCursor();
+  res &= assertNumEqual(0, cursor.sequence);
+  res &= assertNumEqual(0, cursor.step);
+  res &= cursor.subMode == SequencerEditorSubMode::editCol1;
+  return res;
+}
+
+bool testTextGridNoAlloc()
+{
+  Sequencer seqr{16, 16};
+  seqr.setEventCallback([](const StepEvent& event){});
+  SequencerEditor cursor{&seqr};
+  cursor.setEditMode(SequencerEditorMode::selectingSeqAndStep);
+  SequencerSnapshot snap;
+  TextGrid grid;
+  long before = global_alloc_count;
+  for (int i=0; i<1000; ++i)
+  {
+    seqr.readSnapshot(snap);
+    SequencerViewer::renderSequencerView(grid, 9, 13, snap, cursor.getCursor());
+  }
+  return assertNumEqual(0, global_alloc_count - before);
+}
+
+bool testMidiTablesMatchMaps()
+{
+  // the lookups work at compile time
+  static_assert(MidiUtils::scaleToDrumNote(48) == 36, "bass drum");
+  static_assert(MidiUtils::keyToNote('z') == 48, "z is c");
+  static_assert(MidiUtils::getNoteName(-1) == 'b', "negative notes wrap");
+  // what the maps held before they were tables
+  std::map<int,int> scaleToDrum = {{48, 36}, {49, 38}, {50, 40}, {51, 37}, {52, 42}, {53, 46}, 
+                                   {54, 50}, {55, 45}, {56, 39}, {57, 51}, {58, 57}, {59, 75}};
+  std::map<char,int> drumToNote = {{'B', 36}, {'s', 38}, {'S', 40}, {'r', 37}, {'H', 42}, {'h', 46}, 
+                                   {'t', 50}, {'T', 45}, {'c', 39}, {'R', 51}, {'C', 57}, {'p', 75}};
+  std::map<char,double> keyToNote = {{'z', 48}, {'s', 49}, {'x', 50}, {'d', 51}, {'c', 52}, {'v', 53}, 
+                                     {'g', 54}, {'b', 55}, {'h', 56}, {'n', 57}, {'j', 58}, {'m', 59}};
+  bool res = MidiUtils::getScaleMidiToDrumMidi() == scaleToDrum;
+  res &= MidiUtils::getDrumToMidiNoteMap() == drumToNote;
+  res &= MidiUtils::getKeyboardToMidiNotes() == keyToNote;
+  std::map<char,double> transposed = MidiUtils::getKeyboardToMidiNotes(2);
+  res &= assertNumEqual(50, transposed['z']);
+  res &= assertNumEqual(61, transposed['m']);
+  for (int note = 0; note < 128; ++note)
+  {
+    int want = scaleToDrum.count(note) ? scaleToDrum[note] : 0;
+    res &= assertNumEqual(want, MidiUtils::scaleToDrumNote(note));
+  }
+  for (int c = 0; c < 128; ++c)
+  {
+    char ch = (char) c;
+    res &= assertNumEqual(drumToNote.count(ch) ? drumToNote[ch] : 0, MidiUtils::drumNameToNote(ch));
+    res &= assertNumEqual(keyToNote.count(ch) ? keyToNote[ch] + 2 : -1, MidiUtils::keyToNote(ch, 2));
+  }
+  res &= MidiUtils::getDrumName(38) == 'S';
+  return res;
+}
+
+/** sequences with offsets, different step rates and modulators 
+ * pointing both ways, recording every note with the tick it played on
+ */
+void setupModulatedSequencer(Sequencer& seqr, std::vector<std::vector<long>>& played)
+{
+  seqr.setPPQN(8);
+  seqr.setSequenceType(1, SequenceType::drumMidi);
+  seqr.setSequenceType(2, SequenceType::transposer);
+  seqr.setSequenceType(3, SequenceType::transposer);
+  seqr.setSequenceType(4, SequenceType::tickChanger);
+  seqr.setSequenceType(6, SequenceType::lengthChanger);
+  for (int step=0; step<16; ++step)
+  {
+    seqr.setStepData(0, step, {0, 1, 64, 60.0 + step});
+    seqr.setStepData(1, step, {1, 1, 64, 48.0 + step % 12});
+    seqr.setStepData(2, step, {0, 1, 64, step % 2 == 0 ? 2.0 : 0.0});
+    seqr.setStepData(3, step, {5, 1, 64, 5});
+    seqr.setStepData(4, step, {5, 1, 64, step == 4 ? 3.0 : 0.0});
+    seqr.setStepData(5, step, {5, 1, 64, 50});
+    seqr.setStepData(6, step, {0, 1, 64, step == 7 ? 2.0 : 0.0});
+    seqr.setStepData(7, step, {7, 1, 64, 70});
+  }
+  seqr.setSequenceTicksPerStep(1, 2);
+  seqr.setSequenceTicksPerStep(7, 8);
+  // leaves room for the length changer to lengthen it
+  seqr.setSequenceLength(0, 10);
+  seqr.setStepOffset(0, 3, 3);
+  seqr.setStepOffset(0, 5, -2);
+  seqr.toggleActive(7, 2);
+  seqr.setEventCallback([&seqr, &played](const StepEvent& event){
+    played.push_back({(long) seqr.getTickCount(), event.channel, event.note});
+  });
+}
+
+bool testScheduledTickingMatchesUnscheduled()
+{
+  Sequencer plain{8, 16};
+  Sequencer scheduled{8, 16};
+  std::vector<std::vector<long>> plainPlayed;
+  std::vector<std::vector<long>> scheduledPlayed;
+  setupModulatedSequencer(plain, plainPlayed);
+  setupModulatedSequencer(scheduled, scheduledPlayed);
+  scheduled.setScheduledTicking(true);
+  bool res = true;
+  for (int i=0; i<3000; ++i)
+  {
+    if (i == 1000)
+    {
+      // edits part way through have to reschedule
+      for (Sequencer* seqr : {&plain, &scheduled})
+      {
+        seqr->setSequenceTicksPerStep(7, 3);
+        seqr->setStepOffset(5, 2, -3);
+      }
+    }
+    if (i == 2000)
+    {
+      plain.setPPQN(16);
+      scheduled.setPPQN(16);
+    }
+    plain.tick();
+    scheduled.tick();
+    for (int s=0; s<8; ++s)
+    {
+      if (plain.getCurrentStep(s) != scheduled.getCurrentStep(s)) res = false;
+    }
+  }
+  res &= plainPlayed.size() > 100;
+  res &= plainPlayed == scheduledPlayed;
+  // and back again carries on the same
+  scheduled.setScheduledTicking(false);
+  for (int i=0; i<500; ++i)
+  {
+    plain.tick();
+    scheduled.tick();
+  }
+  res &= plainPlayed == scheduledPlayed;
+  return res;
+}
+
+bool testScheduledTickingScalesWithWork()
+{
+  Sequencer seqr{200, 16};
+  seqr.setPPQN(96);
+  long notes = 0;
+  seqr.setEventCallback([&notes](const StepEvent& event){ notes ++; });
+  for (int s=0; s<200; ++s) seqr.updateStepData(s, 0, Step::note1Ind, 60);
+  seqr.setScheduledTicking(true);
+  seqr.tick();
+  long work = 0;
+  long before = global_alloc_count;
+  // one step is 96 ticks at 96 PPQN, so each sequence wakes once per 96 ticks
+  for (int i=0; i<96 * 16; ++i)
+  {
+    seqr.tick();
+    work += seqr.getLastTickWorkCount();
+  }
+  bool res = assertNumEqual(0, global_alloc_count - before);
+  res &= assertNumEqual(200 * 16, work);
+  res &= assertNumEqual(200, notes);
+  return res;
+}
+
+bool testModulatorTicksBeforeTarget()
+{
+  Sequencer seqr{4, 16};
+  seqr.setSequenceType(3, SequenceType::transposer);
+  for (int step=0; step<16; ++step)
+  {
+    seqr.setStepData(1, step, {1, 1, 64, 60});
+    seqr.setStepData(3, step, {1, 1, 64, 2});
+  }
+  std::vector<int> notes{};
+  seqr.setEventCallback([&notes](const StepEvent& event){
+    if (event.channel == 1) notes.push_back(event.note);
+  });
+  // the transposer is after its target in the list but
+  // still transposes its first step
+  for (int i=0; i<4; ++i) seqr.tick();
+  bool res = assertNumEqual(1, notes.size());
+  if (res) res = assertNumEqual(62, notes[0]);
+  res &= seqr.getTickOrder() == std::vector<unsigned int>{0, 2, 3, 1};
+  res &= !seqr.hasModulationCycle();
+  res &= assertNumEqual(1, seqr.getModulationGroup(3));
+  res &= assertNumEqual(1, seqr.getModulationGroup(1));
+  res &= assertNumEqual(0, seqr.getModulationGroup(0));
+  res &= assertNumEqual(2, seqr.getModulationGroup(2));
+  // retargeting sorts again
+  for (int step=0; step<16; ++step) seqr.updateStepData(3, step, Step::channelInd, 0);
+  res &= seqr.getTickOrder() == std::vector<unsigned int>{1, 2, 3, 0};
+  res &= assertNumEqual(0, seqr.getModulationGroup(3));
+  return res;
+}
+
+bool testModulationCycleDetected()
+{
+  Sequencer seqr{4, 16};
+  seqr.setSequenceType(1, SequenceType::transposer);
+  seqr.setSequenceType(2, SequenceType::transposer);
+  seqr.setSequenceType(3, SequenceType::tickChanger);
+  // 1 and 2 change each other, 2 changes 0 too and 3 changes 1
+  seqr.setStepData(1, 0, {2, 1, 64, 1});
+  seqr.setStepData(2, 0, {1, 1, 64, 1});
+  seqr.setStepData(2, 1, {0, 1, 64, 1});
+  seqr.setStepData(3, 0, {1, 1, 64, 2});
+  bool res = seqr.hasModulationCycle();
+  res &= seqr.isOnModulationCycle(1);
+  res &= seqr.isOnModulationCycle(2);
+  res &= !seqr.isOnModulationCycle(0);
+  res &= !seqr.isOnModulationCycle(3);
+  // broken at 1, 0 still comes after the loop that changes it
+  res &= seqr.getTickOrder() == std::vector<unsigned int>{3, 1, 2, 0};
+  res &= assertNumEqual(0, seqr.getModulationGroup(3));
+  for (int i=0; i<100; ++i) seqr.tick();
+  seqr.updateStepData(2, 0, Step::note1Ind, 0);
+  res &= !seqr.hasModulationCycle();
+  res &= !seqr.isOnModulationCycle(1);
+  res &= seqr.getTickOrder() == std::vector<unsigned int>{3, 1, 2, 0};
+  return res;
+}
+
+bool testTickPoolRunsEveryTaskOnce()
+{
+  TickPool pool{3};
+  std::vector<std::atomic<int>> runs(1000);
+  for (std::atomic<int>& r : runs) r = 0;
+  long before = global_alloc_count;
+  for (int batch=0; batch<100; ++batch)
+  {
+    pool.run(1000, [&runs](unsigned int i){ runs[i] ++; });
+  }
+  bool res = assertNumEqual(0, global_alloc_count - before);
+  for (std::atomic<int>& r : runs) res &= r == 100;
+  // uneven tasks give the other threads something to steal
+  std::atomic<long> total{0};
+  pool.run(64, [&total](unsigned int i){
+    if (i < 16) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    total += i;
+  });
+  res &= assertNumEqual(64 * 63 / 2, total);
+  res &= assertNumEqual(4, pool.getThreadCount());
+  return res;
+}
+
+bool testParallelTickMatchesSerial()
+{
+  Sequencer serial{8, 16};
+  Sequencer parallel{8, 16};
+  std::vector<std::vector<long>> serialPlayed;
+  std::vector<std::vector<long>> parallelPlayed;
+  setupModulatedSequencer(serial, serialPlayed);
+  setupModulatedSequencer(parallel, parallelPlayed);
+  TickPool pool{3};
+  parallel.setTickPool(&pool);
+  // 0 with its modulators 2 and 6, 3 and 4 with their target 5, then 1 and 7
+  bool res = assertNumEqual(4, parallel.getModulationGroupCount());
+  for (int i=0; i<3000; ++i)
+  {
+    if (i == 1000)
+    {
+      for (Sequencer* seqr : {&serial, &parallel})
+      {
+        seqr->setSequenceTicksPerStep(7, 3);
+        // 7 now transposes 1, joining their groups
+        seqr->setSequenceType(7, SequenceType::transposer);
+        seqr->updateStepData(7, 0, Step::channelInd, 1);
+      }
+    }
+    serial.tick();
+    parallel.tick();
+  }
+  res &= assertNumEqual(3, parallel.getModulationGroupCount());
+  res &= serialPlayed.size() > 100;
+  res &= serialPlayed == parallelPlayed;
+  return res;
+}
+
+bool testTickAllMatchesSerial()
+{
+  std::vector<Sequencer*> serial{};
+  std::vector<Sequencer*> parallel{};
+  std::vector<std::vector<long>> serialPlayed;
+  std::vector<std::vector<long>> parallelPlayed;
+  for (int i=0; i<4; ++i)
+  {
+    serial.push_back(new Sequencer{8, 16});
+    parallel.push_back(new Sequencer{8, 16});
+    setupModulatedSequencer(*serial[i], serialPlayed);
+    setupModulatedSequencer(*parallel[i], parallelPlayed);
+    // so the sequencers play different things
+    for (Sequencer* seqr : {serial[i], parallel[i]}) seqr->setSequenceTicksPerStep(0, i + 1);
+  }
+  TickPool pool{3};
+  for (int i=0; i<1000; ++i)
+  {
+    for (Sequencer* seqr : serial) seqr->tick();
+    Sequencer::tickAll(parallel, pool);
+  }
+  bool res = serialPlayed.size() > 100;
+  res &= serialPlayed == parallelPlayed;
+  for (int i=0; i<4; ++i)
+  {
+    delete serial[i];
+    delete parallel[i];
+  }
+  return res;
+}
+
+bool testClockRealTimeReportsWhatItGot()
+{
+  SimpleClock clock{};
+  clock.setCallback([](){});
+  // nothing asked for, nothing got and nothing to complain about
+  clock.startNs(1000000);
+  ClockRealTimeStatus status = clock.getRealTimeStatus();
+  clock.stop();
+  bool res = !status.fifo && !status.memoryLocked && status.cpu == -1 && status.problems == "";
+  // memory is not locked here as it would lock the whole test process. 
+  // Without privileges the priority falls back and says why
+  ClockRealTimeSettings settings{};
+  settings.priority = 10;
+  settings.prefaultStackBytes = 64 * 1024;
+  settings.cpu = 0;
+  clock.setRealTime(settings);
+  clock.startNs(1000000);
+  status = clock.getRealTimeStatus();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  clock.stop();
+  res &= clock.getCurrentTick() > 5;
+  res &= assertNumEqual(64 * 1024, status.stackPrefaultedBytes);
+  if (status.fifo) res &= assertNumEqual(10, status.priority);
+  else res &= status.problems.find("SCHED_FIFO") != std::string::npos;
+  if (status.cpu == -1) res &= status.problems.find("cpu 0") != std::string::npos;
+  else res &= assertNumEqual(0, status.cpu);
+  res &= status.toString().find("clock thread") == 0;
+  return res;
+}
+
+/** run the clock at 1ms, calling change(clock) on tick 10, and 
+ * return each tick's deadline
+*/
+std::vector<int64_t> getClockDeadlines(int ticks, std::function<void(SimpleClock&)> change)
+{
+  SimpleClock clock{};
+  std::vector<int64_t> deadlines{};
+  deadlines.reserve(ticks + 16);
+  clock.setCallback([&clock, &deadlines, &change](){
+    deadlines.push_back(clock.getLastDeadlineNs());
+    if (deadlines.size() == 10) change(clock);
+  });
+  clock.startNs(1000000);
+  while (clock.getCurrentTick() < ticks) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  clock.stop();
+  deadlines.resize(ticks);
+  return deadlines;
+}
+
+bool testClockTempoChangeKeepsPhase()
+{
+  std::vector<int64_t> deadlines = getClockDeadlines(40, [](SimpleClock& clock){
+    clock.setIntervalNs(2000000);
+  });
+  bool res = true;
+  // the tick after the change is the new interval after the last
+  for (int i=1; i<deadlines.size(); ++i)
+  {
+    res &= assertNumEqual(i < 10 ? 1000000 : 2000000, deadlines[i] - deadlines[i - 1]);
+  }
+  // stopping twice and restarting a running clock are fine
+  SimpleClock clock{};
+  clock.setCallback([](){});
+  clock.startNs(1000000);
+  clock.startBPM(120, 96);
+  res &= clock.getBPM(96) > 119.9 && clock.getBPM(96) < 120.1;
+  clock.stop();
+  clock.stop();
+  return res;
+}
+
+bool testClockTempoRamp()
+{
+  // 1ms to 2ms ticks evenly over 30ms
+  std::vector<int64_t> deadlines = getClockDeadlines(60, [](SimpleClock& clock){
+    clock.rampIntervalNs(2000000, 30000000);
+  });
+  bool res = true;
+  int64_t rampStart = deadlines[9];
+  for (int i=1; i<deadlines.size(); ++i)
+  {
+    int64_t interval = deadlines[i] - deadlines[i - 1];
+    if (i < 10) res &= assertNumEqual(1000000, interval);
+    else if (deadlines[i - 1] >= rampStart + 30000000) res &= assertNumEqual(2000000, interval);
+    else 
+    {
+      // slowing down all the way
+      res &= interval >= 1000000 && interval < 2000000;
+      res &= interval >= deadlines[i - 1] - deadlines[i - 2];
+    }
+  }
+  return res;
+}
+
+bool testClockTempoRequestsNotMixed()
+{
+  SimpleClock clock{};
+  std::atomic<int64_t> longestNs{0};
+  clock.setCallback([&clock, &longestNs](){
+    if (clock.getIntervalNs() > longestNs) longestNs = clock.getIntervalNs();
+  });
+  clock.startNs(1000000);
+  // straight to 1ms or a slow ramp towards 2ms, so 2ms only happens
+  // if a request's interval is taken with the other's duration
+  for (int i=0; i<20000 && clock.getCurrentTick() < 60; ++i)
+  {
+    if (i % 2 == 0) clock.rampIntervalNs(1000000, 0);
+    else clock.rampIntervalNs(2000000, 1000000000);
+    if (i % 100 == 0) std::this_thread::yield();
+  }
+  clock.stop();
+  return longestNs < 2000000;
+}
+
+bool testClockSpinMode()
+{
+  SimpleClock clock{};
+  clock.setCallback([](){});
+  clock.setSpinMode(true);
+  clock.startNs(1000000);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  clock.stop();
+  bool res = clock.getSpinNs() > 0;
+  res &= clock.getSpinCpuFraction() > 0 && clock.getSpinCpuFraction() < 1;
+  // tuned to somewhere between the limits, never more than half the interval
+  res &= clock.getSpinWindowNs() >= 10000 && clock.getSpinWindowNs() <= 500000;
+  res &= clock.getAverageLatenessNs() <= clock.getMaxLatenessNs();
+  res &= clock.getTimingReport().find("spin mode") != std::string::npos;
+  // sleeping does not spin at all
+  clock.setSpinMode(false);
+  clock.startNs(1000000);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  clock.stop();
+  res &= assertNumEqual(0, clock.getSpinNs());
+  return res;
+}
+
+bool testEventReactorOrderAndStop()
+{
+  EventReactor reactor{};
+  std::string handled{};
+  int pipes[2][2];
+  bool res = pipe(pipes[0]) == 0 && pipe(pipes[1]) == 0;
+  for (int p=0; p<2; ++p)
+  {
+    res &= reactor.addReader(pipes[p][0], [&handled, p](int fd){
+      char got;
+      if (read(fd, &got, 1) == 1) handled += std::to_string(p);
+    });
+  }
+  reactor.startTimer(1000000, [&handled, &reactor](int64_t deadlineNs){
+    handled += "t";
+    reactor.stopTimer();
+  });
+  // everything is ready by the time it looks, it goes timer then readers in order
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  res &= write(pipes[1][1], "x", 1) == 1;
+  res &= write(pipes[0][1], "x", 1) == 1;
+  res &= reactor.runOnce(0);
+  res &= assertStrEqual("t01", handled);
+  res &= assertNumEqual(1, reactor.getTickCount());
+  // a removed reader is left alone
+  reactor.removeReader(pipes[0][0]);
+  res &= write(pipes[0][1], "x", 1) == 1;
+  res &= write(pipes[1][1], "x", 1) == 1;
+  res &= reactor.runOnce(0);
+  res &= assertStrEqual("t011", handled);
+  // pollers keep being called while it runs
+  std::atomic<int> polls{0};
+  res &= reactor.addPoller(1000000, [&polls](){ polls ++; }) >= 0;
+  // stop from another thread ends run
+  std::thread stopper{[&reactor](){
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    reactor.stop();
+  }};
+  reactor.run();
+  stopper.join();
+  res &= polls > 0;
+  for (int p=0; p<2; ++p)
+  {
+    close(pipes[p][0]);
+    close(pipes[p][1]);
+  }
+  return res;
+}
+
+bool testEventReactorStopEndsCatchUp()
+{
+  EventReactor reactor{};
+  int ticks = 0;
+  reactor.startTimer(1000000, [&ticks, &reactor](int64_t deadlineNs){
+    if (++ticks == 2) reactor.stop();
+  });
+  // several ticks are due by the time it looks, the catch up ends at the stop
+  std::this_thread::sleep_for(std::chrono::milliseconds(6));
+  reactor.runOnce(0);
+  bool res = assertNumEqual(2, ticks);
+  res &= !reactor.runOnce(0);
+  // run again, it carries on catching up
+  res &= reactor.runOnce(0);
+  res &= ticks > 2;
+  reactor.stopTimer();
+  return res;
+}
+
+bool testClockDrivenByReactor()
+{
+  SimpleClock clock{};
+  EventReactor reactor{};
+  std::vector<int64_t> deadlines{};
+  deadlines.reserve(64);
+  clock.setCallback([&clock, &deadlines](){
+    deadlines.push_back(clock.getLastDeadlineNs());
+    if (deadlines.size() == 10) clock.setIntervalNs(2000000);
+  });
+  clock.startDriven(1000000);
+  reactor.startTimer(clock.getIntervalNs(), [&clock, &reactor](int64_t deadlineNs){
+    reactor.setTimerIntervalNs(clock.driveTick(deadlineNs));
+    if (clock.getCurrentTick() == 30) reactor.stop();
+  });
+  reactor.run();
+  clock.stop();
+  bool res = assertNumEqual(30, clock.getCurrentTick());
+  res &= assertNumEqual(30, reactor.getTickCount());
+  // same deadlines as the clock thread would keep, the change picked up from the next tick
+  for (int i=1; i<deadlines.size(); ++i)
+  {
+    res &= assertNumEqual(i < 10 ? 1000000 : 2000000, deadlines[i] - deadlines[i - 1]);
+  }
+  res &= reactor.getWakeupCount() > 0;
+  return res;
+}
+
+bool testLatencyHistogramPercentiles()
+{
+  LatencyHistogram histogram{};
+  bool res = assertNumEqual(0, histogram.getPercentileNs(50));
+  // 1us to 1000us
+  for (int i=1; i<=1000; ++i) histogram.record(i * 1000);
+  res &= assertNumEqual(1000, histogram.getCount());
+  res &= assertNumEqual(1000000, histogram.getMaxNs());
+  res &= assertNumEqual(500500, histogram.getMeanNs());
+  // to within a bucket, about 3%
+  int64_t p50 = histogram.getPercentileNs(50);
+  int64_t p99 = histogram.getPercentileNs(99);
+  res &= p50 >= 500000 && p50 <= 500000 * 1.032;
+  res &= p99 >= 990000 && p99 <= 1000000;
+  res &= assertNumEqual(1000000, histogram.getPercentileNs(100));
+  // small values are exact, negative ones count as 0
+  histogram.reset();
+  histogram.record(-5);
+  histogram.record(7);
+  histogram.record(63);
+  res &= assertNumEqual(0, histogram.getPercentileNs(30));
+  res &= assertNumEqual(7, histogram.getPercentileNs(50));
+  res &= assertNumEqual(63, histogram.getPercentileNs(99));
+  // nothing lost recording from two threads at once
+  histogram.reset();
+  std::thread other{[&histogram](){ for (int i=0; i<10000; ++i) histogram.record(i); }};
+  for (int i=0; i<10000; ++i) histogram.record(i);
+  other.join();
+  res &= assertNumEqual(20000, histogram.getCount());
+  res &= assertNumEqual(9999, histogram.getMaxNs());
+  res &= histogram.toString("x").find("x: 20000 values, p50") == 0;
+  return res;
+}
+
+bool testTimingHistogramsRecorded()
+{
+  SimpleClock clock{};
+  clock.setCallback([](){
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  });
+  clock.startNs(1000000);
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  clock.stop();
+  // one of each per tick
+  bool res = assertNumEqual(clock.getCurrentTick(), clock.getLatenessHistogram().getCount());
+  res &= assertNumEqual(clock.getCurrentTick(), clock.getCallbackHistogram().getCount());
+  res &= clock.getCallbackHistogram().getPercentileNs(50) >= 200000;
+  res &= assertNumEqual(clock.getMaxLatenessNs(), clock.getLatenessHistogram().getMaxNs());
+  res &= clock.getHistogramReport().find("missed deadlines") != std::string::npos;
+  // the port writes are timed on the output thread
+  SlowMidiBackend slow{};
+  ThreadedMidiBackend threaded{&slow};
+  unsigned char msg[3] = {144, 60, 100};
+  for (int i=0; i<5; ++i) threaded.sendMessage(msg, 3);
+  while (threaded.getSentCount() < 5) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  res &= assertNumEqual(5, threaded.getSendHistogram().getCount());
+  res &= threaded.getSendHistogram().getPercentileNs(50) >= 1000000;
+  res &= threaded.getQueueDelayHistogram().getMaxNs() >= 5000000;
+  return res;
+}
 
 int global_pass_count = 0;
 int global_fail_count = 0;
@@ -1473,6 +3057,66 @@ int main()
 //log("testDrumDisplay", testDrumDisplay());
 //log("testExtendSeqCorrectStepChannel", testExtendSeqCorrectStepChannel());
 log("testSongMode", testSongMode());
+log("testClockNoDrift", testClockNoDrift());
+log("testPPQNStepTiming", testPPQNStepTiming());
+log("testStepOffsetEarlyLate", testStepOffsetEarlyLate());
+log("testTriggerNoAllocEventCallback", testTriggerNoAllocEventCallback());
+log("testTriggerNoAllocStepCallback", testTriggerNoAllocStepCallback());
+log("testEventCallbackTransposed", testEventCallbackTransposed());
+log("testStepDataViewClamps", testStepDataViewClamps());
+log("testMidiQueueDrainsInOrder", testMidiQueueDrainsInOrder());
+log("testMidiQueueOverflow", testMidiQueueOverflow());
+log("testMidiQueueLateMessageNotLost", testMidiQueueLateMessageNotLost());
+log("testMidiQueueNoAlloc", testMidiQueueNoAlloc());
+log("testEQFiresDueInOrder", testEQFiresDueInOrder());
+log("testEQTriggerAtNow", testEQTriggerAtNow());
+log("testEQAddFromThreads", testEQAddFromThreads());
+log("testNullMidiBackendCounts", testNullMidiBackendCounts());
+log("testFileMidiBackendWrites", testFileMidiBackendWrites());
+log("testLoopbackTickToWire", testLoopbackTickToWire());
+log("testSpscRingWraps", testSpscRingWraps());
+log("testThreadedMidiBackendSendsInOrder", testThreadedMidiBackendSendsInOrder());
+log("testThreadedMidiBackendOverruns", testThreadedMidiBackendOverruns());
+log("testBatchOffsBeforeOnsRunningStatus", testBatchOffsBeforeOnsRunningStatus());
+log("testBatchOneWrite", testBatchOneWrite());
+log("testActiveNotesCount", testActiveNotesCount());
+log("testRetriggerSuppressesStaleNoteOff", testRetriggerSuppressesStaleNoteOff());
+log("testMinimalPanic", testMinimalPanic());
+log("testEditQueueAppliedAtTick", testEditQueueAppliedAtTick());
+log("testEditQueueFromOtherThread", testEditQueueFromOtherThread());
+log("testSnapshotVersionOnlyOnChange", testSnapshotVersionOnlyOnChange());
+log("testSnapshotMatchesSequencer", testSnapshotMatchesSequencer());
+log("testSnapshotNoTearing", testSnapshotNoTearing());
+log("testRenderThreadCoalescesAndCaps", testRenderThreadCoalescesAndCaps());
+log("testSlowRenderDoesNotBlockRequests", testSlowRenderDoesNotBlockRequests());
+log("testTerminalDiffOnlyChangedCells", testTerminalDiffOnlyChangedCells());
+log("testTerminalDiffOneWritePerFrame", testTerminalDiffOneWritePerFrame());
+log("testWioDeltaRoundTrip", testWioDeltaRoundTrip());
+log("testWioRecoversFromCorruption", testWioRecoversFromCorruption());
+log("testWioSerialLinkNonBlocking", testWioSerialLinkNonBlocking());
+log("testTextGridMatchesSequencerView", testTextGridMatchesSequencerView());
+log("testTextGridNoAlloc", testTextGridNoAlloc());
+log("testMidiTablesMatchMaps", testMidiTablesMatchMaps());
+log("testScheduledTickingMatchesUnscheduled", testScheduledTickingMatchesUnscheduled());
+log("testScheduledTickingScalesWithWork", testScheduledTickingScalesWithWork());
+log("testModulatorTicksBeforeTarget", testModulatorTicksBeforeTarget());
+log("testModulationCycleDetected", testModulationCycleDetected());
+log("testTickPoolRunsEveryTaskOnce", testTickPoolRunsEveryTaskOnce());
+log("testParallelTickMatchesSerial", testParallelTickMatchesSerial());
+log("testTickAllMatchesSerial", testTickAllMatchesSerial());
+log("testClockRealTimeReportsWhatItGot", testClockRealTimeReportsWhatItGot());
+log("testClockTempoChangeKeepsPhase", testClockTempoChangeKeepsPhase());
+log("testClockTempoRamp", testClockTempoRamp());
+log("testClockSpinMode", testClockSpinMode());
+log("testEventReactorOrderAndStop", testEventReactorOrderAndStop());
+log("testClockDrivenByReactor", testClockDrivenByReactor());
+log("testThreadedMidiBackendKeepsBatchesWhole", testThreadedMidiBackendKeepsBatchesWhole());
+log("testLatencyHistogramPercentiles", testLatencyHistogramPercentiles());
+log("testTimingHistogramsRecorded", testTimingHistogramsRecorded());
+log("testEditorEditsBetweenTicksAllCount", testEditorEditsBetweenTicksAllCount());
+log("testEditorCursorPublished", testEditorCursorPublished());
+log("testClockTempoRequestsNotMixed", testClockTempoRequestsNotMixed());
+log("testEventReactorStopEndsCatchUp", testEventReactorStopEndsCatchUp());
 
   std::cout << "passed: " << global_pass_count << " \nfailed: " << global_fail_count << std::endl;
 }
@@ -4,6 +4,16 @@
 // how much serial data we expect before the tab char appears
 const unsigned int MAX_INPUT = 500;
 
+// binary delta protocol, must match WioProtocol in src/WioLink.h
+// every packet is: sync, type, row, col, len, len payload bytes, checksum
+// checksum is the xor of type, row, col, len and the payload
+const byte SYNC_BYTE = 0xA5;
+const byte CELLS_PACKET = 1; // write the payload into the grid from row, col
+const byte CLEAR_PACKET = 2; // fill the grid with spaces
+const byte SHOW_PACKET = 3;  // draw the rows that changed
+const int GRID_ROWS = 16;
+const int GRID_COLS = 40;
+
 //Libraries 
 #include "TFT_eSPI.h" //TFT LCD library 
 #include "Free_Fonts.h" //include the font library
@@ -14,6 +24,9 @@ TFT_eSprite spr = TFT_eSprite(&tft); //Initializing buffer
 int y_pos{5};
 int row_h{30};
 int max_height{200};
+// the screen as a grid of characters, plus which rows need drawing
+char grid[GRID_ROWS][GRID_COLS + 1]; // +1 for the terminating null byte
+bool row_dirty[GRID_ROWS];
 void setup() {
   Serial.begin(115200); //start serial communication 
   tft.begin(); //Start TFT LCD
@@ -21,9 +34,96 @@ void setup() {
   spr.createSprite(TFT_HEIGHT,TFT_WIDTH); //Create buffer
   spr.fillSprite(tft.color565(0,0,0)); //Fill background with white color
  spr.pushSprite(0,0); //Push to LCD
-
+  clear_grid();
 }
 
+void clear_grid()
+  {
+  for (int row = 0; row < GRID_ROWS; row++)
+    {
+    memset(grid[row], ' ', GRID_COLS);
+    grid[row][GRID_COLS] = 0;
+    row_dirty[row] = true;
+    }
+  }
+
+// draw only the rows that changed since the last show
+void show_grid()
+  {
+  spr.setTextColor(TFT_WHITE); //set text color
+  spr.setFreeFont(FMB18); //set font 
+  for (int row = 0; row < GRID_ROWS; row++)
+    {
+    if (!row_dirty[row]) continue;
+    int y = 5 + row * 25;
+    spr.fillRect(0, y, TFT_HEIGHT, 25, tft.color565(0,0,0));
+    spr.drawString(grid[row], 5, y); //draw string 
+    row_dirty[row] = false;
+    }
+  spr.pushSprite(0,0); //Push to LCD
+  }
+
+void apply_packet (const byte * header, const byte * payload)
+  {
+  byte type = header[0];
+  int row = header[1];
+  int col = header[2];
+  int len = header[3];
+  switch (type)
+    {
+    case CELLS_PACKET:
+      if (row >= GRID_ROWS || col + len > GRID_COLS) return;
+      memcpy(&grid[row][col], payload, len);
+      row_dirty[row] = true;
+      break;
+    case CLEAR_PACKET:
+      clear_grid();
+      break;
+    case SHOW_PACKET:
+      show_grid();
+      break;
+    }
+  }
+
+// returns true if the byte was part of a binary packet
+bool processPacketByte (const byte inByte)
+  {
+  static byte header [4]; // type, row, col, len
+  static byte payload [256];
+  static int header_pos = 0;
+  static int payload_pos = 0;
+  static int state = 0; // 0 waiting for sync, 1 header, 2 payload, 3 checksum
+
+  switch (state)
+    {
+    case 0:
+      if (inByte != SYNC_BYTE) return false;
+      header_pos = 0;
+      state = 1;
+      break;
+    case 1:
+      header[header_pos++] = inByte;
+      if (header_pos < 4) break;
+      payload_pos = 0;
+      state = header[3] > 0 ? 2 : 3;
+      break;
+    case 2:
+      payload[payload_pos++] = inByte;
+      if (payload_pos == header[3]) state = 3;
+      break;
+    case 3:
+      {
+      state = 0;
+      byte sum = header[0] ^ header[1] ^ header[2] ^ header[3];
+      for (int i = 0; i < header[3]; i++) sum ^= payload[i];
+      // a bad packet is dropped, the host resends the whole screen now and then
+      if (sum == inByte) apply_packet(header, payload);
+      }
+      break;
+    }
+  return true;
+  } // end of processPacketByte
+
 
 // void setup ()
 //   {
@@ -103,7 +203,12 @@ void loop()
   {
   // if serial data available, process it
   while (Serial.available () > 0)
-    processIncomingByte (Serial.read ());
+    {
+    byte inByte = Serial.read ();
+    // anything outside a binary packet is the old tab terminated text
+    if (!processPacketByte (inByte))
+      processIncomingByte (inByte);
+    }
 
   // do other stuff here like testing digital input (button presses) ...
 